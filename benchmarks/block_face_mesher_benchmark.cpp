@@ -0,0 +1,245 @@
+#include "block_face_mesher.h"
+#include "constants.h"
+#include "direction.h"
+#include "terrain_chunk.h"
+
+#include <QDebug>
+#include <QTest>
+
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <ranges>
+#include <vector>
+
+namespace minecraft {
+
+namespace {
+
+constexpr auto FaceDirections{std::to_array<glm::ivec3>({
+    {1, 0, 0},
+    {-1, 0, 0},
+    {0, 1, 0},
+    {0, -1, 0},
+    {0, 0, 1},
+    {0, 0, -1},
+})};
+
+bool isFaceVisible(const BlockType block, const BlockType neighbor, const int faceIndex)
+{
+    const auto isFluid{neighbor == BlockType::Air || neighbor == BlockType::Water
+                       || neighbor == BlockType::Lava};
+    switch (block) {
+    case BlockType::Air:
+        return false;
+    case BlockType::Water:
+        return Direction{faceIndex} == Direction::PositiveY && neighbor == BlockType::Air;
+    case BlockType::Lava:
+        return neighbor == BlockType::Air || neighbor == BlockType::Water;
+    default:
+        return isFluid;
+    }
+}
+
+// Fills the blocks and paddings with rolling terrain that crosses the water level, with caves, lava
+// pockets, and snow caps, which is roughly what TerrainChunkGenerationTask produces.
+void generateTerrain(BlockFaceMesher::PaddedBlockArray &blocks)
+{
+    std::mt19937 generator{1234u};
+    std::bernoulli_distribution isCave{0.03};
+    for (const auto x : std::views::iota(0, TerrainChunk::SizeX + 2)) {
+        for (const auto z : std::views::iota(0, TerrainChunk::SizeZ + 2)) {
+            const auto height{static_cast<int>(WaterLevel
+                                               + 12.0 * std::sin(x * 0.15) * std::cos(z * 0.11)
+                                               + 6.0 * std::sin(z * 0.4))};
+            for (const auto y : std::views::iota(0, TerrainChunk::SizeY + 2)) {
+                const auto blockY{y - 1};
+                auto block{BlockType::Air};
+                if (y == 0 || y == TerrainChunk::SizeY + 1) {
+                    block = BlockType::Air;
+                } else if (blockY == 0) {
+                    block = BlockType::Bedrock;
+                } else if (blockY < height - 4) {
+                    block = isCave(generator) ? BlockType::Air
+                            : blockY < 20     ? BlockType::Lava
+                                              : BlockType::Stone;
+                } else if (blockY < height) {
+                    block = BlockType::Dirt;
+                } else if (blockY == height) {
+                    block = height > WaterLevel + 12 ? BlockType::Snow : BlockType::Grass;
+                } else if (blockY < WaterLevel) {
+                    block = BlockType::Water;
+                }
+                blocks[x][y][z] = block;
+            }
+        }
+    }
+}
+
+// Layout of BlockFace before it was packed into 8 bytes, kept to compare the instance data sizes
+struct UnpackedBlockFace
+{
+    glm::ivec3 faceOrigin;
+    GLubyte faceIndex;
+    GLubyte textureIndex;
+    GLubyte blockType;
+    GLubyte mediumType;
+    GLubyte width;
+    GLubyte height;
+};
+
+static_assert(sizeof(UnpackedBlockFace) == 20);
+
+// Copies the faces of all slots into one buffer, as BlockFaceUploader does with a staging buffer,
+// and returns the number of copied bytes.
+template<typename Face>
+std::size_t copyInstances(const std::vector<std::vector<Face>> &slotFaces,
+                          std::vector<std::byte> &buffer)
+{
+    std::size_t offset{0};
+    for (const auto &faces : slotFaces) {
+        const auto size{faces.size() * sizeof(Face)};
+        if (offset + size > buffer.size()) {
+            buffer.resize(offset + size);
+        }
+        std::memcpy(buffer.data() + offset, faces.data(), size);
+        offset += size;
+    }
+    return offset;
+}
+
+} // namespace
+
+// Run with -median to report the median of several runs. Build in the Release configuration.
+class BlockFaceMesherBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void perBlockMesher();
+    void greedyMesher();
+    void packedInstanceCopy();
+    void unpackedInstanceCopy();
+
+private:
+    void generateGreedyFaces(BlockFaceSlots &blockFaces);
+
+    std::unique_ptr<BlockFaceMesher> _mesher{std::make_unique<BlockFaceMesher>()};
+    BlockFaceSlots _blockFaces{TerrainChunk::BlockFaceSlotCount};
+    // Faces of the greedy mesher, which are uploaded to the GPU
+    BlockFaceSlots _greedyBlockFaces{TerrainChunk::BlockFaceSlotCount};
+    std::vector<std::byte> _instanceBuffer;
+};
+
+void BlockFaceMesherBenchmark::initTestCase()
+{
+    generateTerrain(_mesher->blocks());
+    generateGreedyFaces(_greedyBlockFaces);
+}
+
+void BlockFaceMesherBenchmark::generateGreedyFaces(BlockFaceSlots &blockFaces)
+{
+    std::bitset<TerrainChunk::SizeY> meshedLayers;
+    meshedLayers.set();
+    BlockFaceMesher::SectionPoints minPoints;
+    BlockFaceMesher::SectionPoints maxPoints;
+    for (auto &slotBlockFaces : blockFaces) {
+        slotBlockFaces.clear();
+    }
+    for (const auto i : std::views::iota(0, 4)) {
+        minPoints[i].fill(glm::ivec3{std::numeric_limits<int>::max()});
+        maxPoints[i].fill(glm::ivec3{std::numeric_limits<int>::min()});
+    }
+    _mesher->generate(1, meshedLayers, {0, 0}, blockFaces, minPoints, maxPoints);
+}
+
+void BlockFaceMesherBenchmark::perBlockMesher()
+{
+    // The mesher before bit rows and greedy merging, which tests the face rules per block and
+    // emits a face for every visible side. Face attributes other than the types are left out.
+    const auto &blocks{_mesher->blocks()};
+    QBENCHMARK {
+        for (auto &blockFaces : _blockFaces) {
+            blockFaces.clear();
+        }
+        for (const auto x : std::views::iota(0, TerrainChunk::SizeX)) {
+            for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
+                for (const auto z : std::views::iota(0, TerrainChunk::SizeZ)) {
+                    const auto block{blocks[x + 1][y + 1][z + 1]};
+                    for (const auto faceIndex : std::views::iota(0, 6)) {
+                        const auto neighborPosition{glm::ivec3{x + 1, y + 1, z + 1}
+                                                    + FaceDirections[faceIndex]};
+                        const auto neighbor{
+                            blocks[neighborPosition.x][neighborPosition.y][neighborPosition.z]};
+                        if (!isFaceVisible(block, neighbor, faceIndex)) {
+                            continue;
+                        }
+                        const auto section{y / TerrainChunk::SectionSizeY};
+                        const auto slot{TerrainChunk::getBlockFaceSlot(faceIndex, 0, section)};
+                        _blockFaces[slot].push_back(BlockFace::pack({x, y, z},
+                                                                    faceIndex,
+                                                                    1,
+                                                                    1,
+                                                                    0,
+                                                                    static_cast<int>(block),
+                                                                    static_cast<int>(neighbor)));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void BlockFaceMesherBenchmark::greedyMesher()
+{
+    QBENCHMARK {
+        generateGreedyFaces(_blockFaces);
+    }
+}
+
+void BlockFaceMesherBenchmark::packedInstanceCopy()
+{
+    std::size_t byteCount{0};
+    QBENCHMARK {
+        byteCount = copyInstances(_greedyBlockFaces, _instanceBuffer);
+    }
+    qInfo().noquote().nospace() << "Packed instance data: " << byteCount << " bytes";
+}
+
+void BlockFaceMesherBenchmark::unpackedInstanceCopy()
+{
+    std::vector<std::vector<UnpackedBlockFace>> unpackedBlockFaces;
+    for (const auto &blockFaces : _greedyBlockFaces) {
+        auto &unpackedFaces{unpackedBlockFaces.emplace_back()};
+        for (const auto &blockFace : blockFaces) {
+            unpackedFaces.push_back({
+                .faceOrigin = {blockFace.geometry & 0x3Fu,
+                               (blockFace.geometry >> 6) & 0xFFu,
+                               (blockFace.geometry >> 14) & 0x3Fu},
+                .faceIndex = static_cast<GLubyte>((blockFace.geometry >> 20) & 0x7u),
+                .textureIndex = static_cast<GLubyte>((blockFace.material >> 8) & 0xFFu),
+                .blockType = static_cast<GLubyte>((blockFace.material >> 16) & 0x7u),
+                .mediumType = static_cast<GLubyte>((blockFace.material >> 19) & 0x7u),
+                .width = static_cast<GLubyte>((blockFace.geometry >> 23) & 0x7Fu),
+                .height = static_cast<GLubyte>(blockFace.material & 0xFFu),
+            });
+        }
+    }
+    std::size_t byteCount{0};
+    QBENCHMARK {
+        byteCount = copyInstances(unpackedBlockFaces, _instanceBuffer);
+    }
+    qInfo().noquote().nospace() << "Unpacked instance data: " << byteCount << " bytes";
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::BlockFaceMesherBenchmark)
+
+#include "block_face_mesher_benchmark.moc"
@@ -24,3 +24,49 @@ const ivec3 FaceBitangents[6] = ivec3[](ivec3(0, 1, 0),
                                         ivec3(0, 0, 1),
                                         ivec3(0, 1, 0),
                                         ivec3(0, 1, 0));
+
+// Corners of unit faces where the face texture coordinates are (0, 0)
+const ivec3 FaceOrigins[6] = ivec3[](ivec3(1, 0, 1),
+                                     ivec3(0, 0, 0),
+                                     ivec3(0, 1, 1),
+                                     ivec3(0, 0, 0),
+                                     ivec3(0, 0, 1),
+                                     ivec3(1, 0, 0));
+
+struct BlockFace
+{
+    ivec3 faceOrigin;
+    int faceIndex;
+    // Number of blocks covered along the face tangent and bitangent. Both are zero for unused
+    // instances, which gives empty faces.
+    int width;
+    int height;
+    int textureIndex;
+    int blockType;
+    int mediumType;
+};
+
+// See the BlockFace struct in vertex_attribute.h for the bit layout.
+BlockFace unpackBlockFace(uvec2 packedBlockFace, ivec2 chunkOriginXZ)
+{
+    BlockFace blockFace;
+
+    ivec3 minPosition = ivec3(bitfieldExtract(packedBlockFace.x, 0, 6),
+                              bitfieldExtract(packedBlockFace.x, 6, 8),
+                              bitfieldExtract(packedBlockFace.x, 14, 6));
+    blockFace.faceIndex = int(bitfieldExtract(packedBlockFace.x, 20, 3));
+    blockFace.width = int(bitfieldExtract(packedBlockFace.x, 23, 7));
+    blockFace.height = int(bitfieldExtract(packedBlockFace.y, 0, 8));
+    blockFace.textureIndex = int(bitfieldExtract(packedBlockFace.y, 8, 8));
+    blockFace.blockType = int(bitfieldExtract(packedBlockFace.y, 16, 3));
+    blockFace.mediumType = int(bitfieldExtract(packedBlockFace.y, 19, 3));
+
+    // The face origin is at a corner of the face, which is offset from the minimum point along the
+    // axes where the tangent or bitangent is negative.
+    ivec3 extent = ivec3(1) + (blockFace.width - 1) * abs(FaceTangents[blockFace.faceIndex])
+                   + (blockFace.height - 1) * abs(FaceBitangents[blockFace.faceIndex]);
+    blockFace.faceOrigin = ivec3(chunkOriginXZ.x, 0, chunkOriginXZ.y) + minPosition
+                           + FaceOrigins[blockFace.faceIndex] * extent;
+
+    return blockFace;
+}
@@ -1,13 +1,16 @@
 #version 410 core
 
 #include "block_type.glsl"
+#include "geometry_buffer.glsl"
 #include "uniform_buffer_data.glsl"
 #include "water_wave.glsl"
 
+// CameraIndex and WaterClipMode are defined by ShaderProgram for each permutation.
+const int WaterClipModeNone = 0;
+const int WaterClipModeAboveWaterOnly = 1;
+const int WaterClipModeUnderWaterOnly = 2;
+
 uniform float u_waterWaveAmplitudeScale;
-uniform int u_cameraIndex;
-uniform int u_isAboveWaterOnly;
-uniform int u_isUnderWaterOnly;
 uniform sampler2DArray u_colorTexture;
 uniform sampler2DArray u_normalTexture;
 
@@ -20,15 +23,15 @@ in vec2 v_textureCoords;
 in float v_waterLevel;
 
 layout(location = 0) out float f_depth;
-layout(location = 1) out vec4 f_normal;
+layout(location = 1) out vec2 f_normal;
 layout(location = 2) out vec4 f_albedo;
 
 void main()
 {
-    {
+    if (WaterClipMode != WaterClipModeNone) {
         bool isAboveWater = v_worldSpacePosition.y >= v_waterLevel;
-        if ((u_isAboveWaterOnly != 0 && !isAboveWater)
-            || (u_isUnderWaterOnly != 0 && isAboveWater)) {
+        if ((WaterClipMode == WaterClipModeAboveWaterOnly && !isAboveWater)
+            || (WaterClipMode == WaterClipModeUnderWaterOnly && isAboveWater)) {
             discard;
         }
     }
@@ -41,8 +44,10 @@ void main()
         }
     }
 
-    mat4 viewMatrix = u_viewMatrices[u_cameraIndex];
+    mat4 viewMatrix = u_viewMatrices[CameraIndex];
 
+    // Linear depths are written out, because reconstructing them from the depth buffer loses too
+    // much precision at a distance for the ray marching in the lighting pass.
     f_depth = -(viewMatrix * vec4(v_worldSpacePosition, 1.0)).z;
 
     vec3 textureCoords = vec3(v_textureCoords, float(v_textureIndex));
@@ -50,28 +55,24 @@ void main()
 
     {
         vec4 textureNormal = texture(u_normalTexture, textureCoords);
+        vec3 normal;
         if (textureNormal.w > 0.5) {
             // The normal map is available for this texture.
             vec3 tangentSpaceNormal = textureNormal.xyz * 2.0 - 1.0;
             // The x component is somehow inverted in the normal map.
             tangentSpaceNormal.x = -tangentSpaceNormal.x;
-            f_normal.xyz = normalize(v_viewSpaceTBNMatrix * tangentSpaceNormal);
+            normal = normalize(v_viewSpaceTBNMatrix * tangentSpaceNormal);
         } else if (v_blockType == BlockTypeWater) {
-            f_normal.xyz = mat3(viewMatrix)
-                           * getWaterWaveNormal(v_worldSpacePosition.xz,
-                                                u_time,
-                                                u_waterWaveAmplitudeScale);
+            normal = mat3(viewMatrix)
+                     * getWaterWaveNormal(v_worldSpacePosition.xz,
+                                          u_time,
+                                          u_waterWaveAmplitudeScale);
         } else {
-            f_normal.xyz = viewSpaceNormal;
+            normal = viewSpaceNormal;
         }
+        f_normal = encodeNormal(normal);
     }
 
-    // In the lighting pass, the water surface needs to know whether it is front-facing to compute
-    // the correct reflection and refraction vectors. Rather than checking the signs of dot products
-    // which may be inaccurate, we store the precise gl_FrontFacing value in the unused w channel of
-    // the normal output.
-    f_normal.w = gl_FrontFacing ? 1.0 : 0.0;
-
     f_albedo.rgb = texture(u_colorTexture, textureCoords).rgb;
 
     // The medium types of the front and back faces may differ, so we determine the actual medium
@@ -93,7 +94,10 @@ void main()
         }
 
         // Medium types are used in the lighting pass, but a separate texture is unnecessary. We
-        // store them in the unused alpha channel of the albedo output.
-        f_albedo.a = blockTypeToFloat(actualMediumType);
+        // store them in the unused alpha channel of the albedo output. The water surface also
+        // needs to know whether it is front-facing to compute the correct reflection and
+        // refraction vectors. Rather than checking the signs of dot products which may be
+        // inaccurate, we store the precise gl_FrontFacing value alongside.
+        f_albedo.a = encodeSurfaceFlags(actualMediumType, gl_FrontFacing);
     }
 }
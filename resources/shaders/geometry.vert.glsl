@@ -5,14 +5,12 @@
 #include "uniform_buffer_data.glsl"
 #include "water_wave.glsl"
 
+// CameraIndex is defined by ShaderProgram for each permutation.
+
 uniform float u_waterWaveAmplitudeScale;
-uniform int u_cameraIndex;
+uniform ivec2 u_chunkOriginXZ;
 
-layout(location = 0) in ivec3 a_faceOrigin;
-layout(location = 1) in int a_faceIndex;
-layout(location = 2) in int a_textureIndex;
-layout(location = 3) in int a_blockType;
-layout(location = 4) in int a_mediumType;
+layout(location = 0) in uvec2 a_blockFace;
 
 flat out mat3 v_viewSpaceTBNMatrix;
 flat out int v_textureIndex;
@@ -32,28 +30,34 @@ vec2 randomOffset(float frequency)
 
 void main()
 {
-    v_viewSpaceTBNMatrix = mat3(u_viewMatrices[u_cameraIndex]) * FaceTBNMatrices[a_faceIndex];
-    v_textureIndex = a_textureIndex;
-    v_blockType = a_blockType;
-    v_mediumType = a_mediumType;
+    BlockFace blockFace = unpackBlockFace(a_blockFace, u_chunkOriginXZ);
+
+    v_viewSpaceTBNMatrix = mat3(u_viewMatrices[CameraIndex])
+                           * FaceTBNMatrices[blockFace.faceIndex];
+    v_textureIndex = blockFace.textureIndex;
+    v_blockType = blockFace.blockType;
+    v_mediumType = blockFace.mediumType;
 
-    ivec2 textureCoords = FaceTextureCoords[gl_VertexID];
+    // Merged faces cover multiple blocks, and the texture repeats once per block.
+    ivec2 textureCoords = FaceTextureCoords[gl_VertexID] * ivec2(blockFace.width, blockFace.height);
 
-    v_worldSpacePosition = vec3(a_faceOrigin + textureCoords.x * FaceTangents[a_faceIndex]
-                                + textureCoords.y * FaceBitangents[a_faceIndex]);
-    if (a_blockType == BlockTypeWater) {
+    v_worldSpacePosition = vec3(blockFace.faceOrigin
+                                + textureCoords.x * FaceTangents[blockFace.faceIndex]
+                                + textureCoords.y * FaceBitangents[blockFace.faceIndex]);
+    if (blockFace.blockType == BlockTypeWater) {
         v_worldSpacePosition.y += getWaterWaveOffset(v_worldSpacePosition.xz,
                                                      u_time,
                                                      u_waterWaveAmplitudeScale);
     }
 
     v_textureCoords = vec2(textureCoords);
-    if (a_blockType == BlockTypeLava) {
+    if (blockFace.blockType == BlockTypeLava) {
         v_textureCoords += randomOffset(4.0);
     }
 
     // TODO: Replace the hardcoded water level.
-    if (a_blockType == BlockTypeWater || a_faceOrigin.y < 137 || a_faceOrigin.y > 138) {
+    if (blockFace.blockType == BlockTypeWater || blockFace.faceOrigin.y < 137
+        || blockFace.faceOrigin.y > 138) {
         // Water block faces do not need the water level. For block faces far away from the water.
         // the precise water level is not important. They only need to know if they are above or
         // below the water level.
@@ -67,5 +71,5 @@ void main()
                                             u_waterWaveAmplitudeScale);
     }
 
-    gl_Position = u_viewProjectionMatrices[u_cameraIndex] * vec4(v_worldSpacePosition, 1.0);
+    gl_Position = u_viewProjectionMatrices[CameraIndex] * vec4(v_worldSpacePosition, 1.0);
 }
@@ -0,0 +1,43 @@
+// Encodings of the geometry buffers, which are written in the geometry passes and read in the
+// lighting pass
+
+// Projects a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfolds the lower half over
+// the corners, mapping it into [0, 1]^2:
+// https://jcgt.org/published/0003/02/01/
+vec2 encodeNormal(vec3 normal)
+{
+    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+    vec2 encoded = normal.xy;
+    if (normal.z < 0.0) {
+        vec2 signs = vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+        encoded = (1.0 - abs(normal.yx)) * signs;
+    }
+    return encoded * 0.5 + 0.5;
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+
+// The medium type and whether the surface is front-facing are packed into the 8-bit alpha channel
+// of the albedo: the block type takes the low 3 bits, and the front-facing flag the next one.
+float encodeSurfaceFlags(int mediumType, bool isFrontFacing)
+{
+    return float(mediumType | (isFrontFacing ? 8 : 0)) / 255.0;
+}
+
+int decodeMediumType(float flags)
+{
+    return int(round(flags * 255.0)) & 7;
+}
+
+bool decodeIsFrontFacing(float flags)
+{
+    return (int(round(flags * 255.0)) & 8) != 0;
+}
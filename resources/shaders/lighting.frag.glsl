@@ -1,12 +1,19 @@
 #version 410 core
 
 #include "block_type.glsl"
+#include "geometry_buffer.glsl"
 #include "uniform_buffer_data.glsl"
 
+// The quality tier is selected by ShaderProgram definitions: ShadowFilterGridSize is the number of
+// taps per side of a filtered shadow map fetch, and RayMarchStepCount is the number of steps of a
+// screen-space ray.
+
 uniform vec3 u_sunDirection;
 uniform float u_waterRefractiveIndex;
 
-uniform sampler2DArray u_shadowDepthTexture;
+// The near and far cascades are in separate arrays with different resolutions.
+uniform sampler2DArray u_nearShadowDepthTexture;
+uniform sampler2DArray u_farShadowDepthTexture;
 uniform sampler2D u_opaqueDepthTexture;
 uniform sampler2D u_opaqueNormalTexture;
 uniform sampler2D u_opaqueAlbedoTexture;
@@ -61,113 +68,83 @@ struct DepthMapResult
     float depthSquared;
 };
 
+// Returns the depth and squared depth at the coordinates and mip level, scaled back from normalized
+// depths.
+vec2 sampleMoments(vec3 sampleCoords, int cascadeIndex, float lod)
+{
+    // The explicit LOD gives the same results in non-uniform control flow.
+    vec2 moments;
+    if (cascadeIndex < ShadowMapNearCascadeCount) {
+        moments = textureLod(u_nearShadowDepthTexture, sampleCoords, lod).rg;
+    } else {
+        moments = textureLod(u_farShadowDepthTexture, sampleCoords, lod).rg;
+    }
+    float depthRange = u_shadowMapMomentScales[cascadeIndex].x;
+    return moments * vec2(depthRange, depthRange * depthRange);
+}
+
+float getShadowMapSize(int cascadeIndex)
+{
+    if (cascadeIndex < ShadowMapNearCascadeCount) {
+        return float(textureSize(u_nearShadowDepthTexture, 0).x);
+    }
+    return float(textureSize(u_farShadowDepthTexture, 0).x);
+}
+
+// Returns the depth and squared depth averaged over a square with the given half-width in texture
+// coordinates, read from the prefiltered mip chain. A grid of taps at a level as fine as the grid
+// smooths out the blocks of a single trilinear fetch.
+vec2 sampleFilteredMoments(vec3 sampleCoords, int cascadeIndex, vec2 radius)
+{
+    const float GridSize = float(ShadowFilterGridSize);
+    float texelRadius = max(radius.x, radius.y) * getShadowMapSize(cascadeIndex);
+    if (texelRadius <= 1.0) {
+        return sampleMoments(sampleCoords, cascadeIndex, 0.0);
+    }
+    float lod = max(log2(texelRadius / GridSize), 0.0);
+    vec2 textureCoords = sampleCoords.xy;
+    vec2 moments = vec2(0.0);
+    for (int i = 0; i < ShadowFilterGridSize * ShadowFilterGridSize; ++i) {
+        vec2 cell = vec2(i % ShadowFilterGridSize, i / ShadowFilterGridSize);
+        vec2 offset = (cell + 0.5) / GridSize * 2.0 - 1.0;
+        sampleCoords.xy = textureCoords + offset * radius;
+        moments += sampleMoments(sampleCoords, cascadeIndex, lod) / (GridSize * GridSize);
+    }
+    return moments;
+}
+
 DepthMapResult sampleDepthMap(vec2 textureCoords, int cascadeIndex, float shadowViewSpaceZ)
 {
-    const vec2 PoissonDisk[64] = vec2[](vec2(-0.268162, 0.963373),
-                                        vec2(0.184829, -0.907099),
-                                        vec2(-0.909545, -0.349339),
-                                        vec2(0.785118, 0.078684),
-                                        vec2(-0.264434, 0.264612),
-                                        vec2(0.451911, 0.794221),
-                                        vec2(-0.797057, 0.327004),
-                                        vec2(-0.281018, -0.412816),
-                                        vec2(0.590372, -0.458336),
-                                        vec2(-0.016768, -0.053056),
-                                        vec2(0.882930, -0.227795),
-                                        vec2(0.010505, 0.652915),
-                                        vec2(-0.247481, -0.832999),
-                                        vec2(0.396323, 0.072193),
-                                        vec2(0.236256, -0.283675),
-                                        vec2(0.335115, -0.655360),
-                                        vec2(-0.630958, -0.581301),
-                                        vec2(0.187185, 0.358205),
-                                        vec2(-0.691275, -0.037720),
-                                        vec2(0.787785, 0.577194),
-                                        vec2(-0.503022, 0.487893),
-                                        vec2(-0.151739, 0.472888),
-                                        vec2(-0.580189, 0.796109),
-                                        vec2(-0.481153, -0.240615),
-                                        vec2(-0.462645, 0.083268),
-                                        vec2(0.598832, 0.389393),
-                                        vec2(-0.361799, 0.657831),
-                                        vec2(0.536547, -0.164466),
-                                        vec2(0.885464, 0.299293),
-                                        vec2(0.651634, -0.742260),
-                                        vec2(0.233854, 0.962372),
-                                        vec2(0.788198, -0.540091),
-                                        vec2(-0.038986, -0.790140),
-                                        vec2(-0.896057, 0.082593),
-                                        vec2(-0.635764, 0.579397),
-                                        vec2(-0.672952, -0.217837),
-                                        vec2(-0.460501, -0.885826),
-                                        vec2(-0.005650, 0.235694),
-                                        vec2(-0.239609, -0.202354),
-                                        vec2(-0.028256, -0.486447),
-                                        vec2(0.188953, -0.006466),
-                                        vec2(0.329823, 0.590900),
-                                        vec2(-0.821751, 0.510541),
-                                        vec2(0.926230, 0.099059),
-                                        vec2(0.018844, 0.993394),
-                                        vec2(0.432647, -0.855831),
-                                        vec2(-0.588625, -0.757227),
-                                        vec2(-0.645142, 0.090054),
-                                        vec2(0.491468, -0.595039),
-                                        vec2(-0.822799, -0.558776),
-                                        vec2(-0.476589, -0.506042),
-                                        vec2(-0.486940, 0.308349),
-                                        vec2(-0.522408, -0.097521),
-                                        vec2(0.607207, 0.010414),
-                                        vec2(-0.329584, -0.652477),
-                                        vec2(0.093296, -0.239199),
-                                        vec2(0.507924, 0.609814),
-                                        vec2(0.547759, 0.203847),
-                                        vec2(0.221560, -0.438634),
-                                        vec2(-0.976587, -0.155931),
-                                        vec2(0.411172, 0.376810),
-                                        vec2(0.976072, -0.091997),
-                                        vec2(0.160935, -0.721607),
-                                        vec2(0.707924, -0.121700));
-
-    vec3 sampleCoords = vec3(textureCoords, float(cascadeIndex));
-
-    float centerDepth = texture(u_shadowDepthTexture, sampleCoords).r;
+    // The window of the cascade wraps around its texture layer.
+    textureCoords += u_shadowMapTextureOffsets[cascadeIndex].xy;
+    int layer = cascadeIndex < ShadowMapNearCascadeCount ? cascadeIndex
+                                                         : cascadeIndex - ShadowMapNearCascadeCount;
+    vec3 sampleCoords = vec3(textureCoords, float(layer));
+
+    float centerDepth = sampleMoments(sampleCoords, cascadeIndex, 0.0).r;
     float centerDepthDifference = clamp(-shadowViewSpaceZ - centerDepth, 0.0, 100.0);
 
     // By estimating the average depth instead of using the center depth directly, we reduce light
     // bleeding artifacts. This is because we want to reduce the blur radius when the sampled point
     // has abrupt depth changes nearby.
-    float averageDepth = 0.0;
-    float averageDepthSquared = 0.0;
-    {
-        const int SampleCount = 16;
-        vec2 blurRadius = u_shadowMapDepthBlurScales[cascadeIndex].xy * centerDepthDifference;
-        for (int i = 0; i < SampleCount; ++i) {
-            sampleCoords.xy = textureCoords + PoissonDisk[i] * blurRadius;
-            vec4 depthData = texture(u_shadowDepthTexture, sampleCoords);
-            averageDepth += depthData.r / float(SampleCount);
-            averageDepthSquared += depthData.g / float(SampleCount);
-        }
-    }
-    float averageDepthDifference = clamp(-shadowViewSpaceZ - averageDepth, 0.0, 100.0);
-
-    // Sample the average depth and depth squared in a larger neighborhood.
+    vec2 averageMoments = sampleFilteredMoments(sampleCoords,
+                                                cascadeIndex,
+                                                u_shadowMapDepthBlurScales[cascadeIndex].xy
+                                                    * centerDepthDifference);
+    float averageDepthDifference = clamp(-shadowViewSpaceZ - averageMoments.r, 0.0, 100.0);
+
+    // Sample the average depth and depth squared in a larger neighborhood. The amount of blurring
+    // is proportional to the distance between the shadow-casting object and the shadow receiver.
+    vec2 moments = sampleFilteredMoments(sampleCoords,
+                                         cascadeIndex,
+                                         u_shadowMapDepthBlurScales[cascadeIndex].xy
+                                             * averageDepthDifference);
+
+    // The prefiltered moments cannot be clamped per texel, so the average of the neighborhood is
+    // clamped to the average near the center instead.
     DepthMapResult result;
-    result.depth = 0.0;
-    result.depthSquared = 0.0;
-    {
-        const int SampleCount = 64;
-        // The amount of blurring is proportional to the distance between the shadow-casting object
-        // and the shadow receiver.
-        vec2 blurRadius = u_shadowMapDepthBlurScales[cascadeIndex].xy * averageDepthDifference;
-        for (int i = 0; i < SampleCount; ++i) {
-            sampleCoords.xy = textureCoords + PoissonDisk[i] * blurRadius;
-            vec4 depthData = texture(u_shadowDepthTexture, sampleCoords);
-            float sampleDepth = max(depthData.r, averageDepth);
-            float sampleDepthSquared = max(depthData.g, averageDepthSquared);
-            result.depth += sampleDepth / float(SampleCount);
-            result.depthSquared += sampleDepthSquared / float(SampleCount);
-        }
-    }
+    result.depth = max(moments.r, averageMoments.r);
+    result.depthSquared = max(moments.g, averageMoments.g);
     return result;
 }
 
@@ -196,7 +173,9 @@ float getNonOccludedProbability(vec3 viewSpacePosition, float shadowBias)
     DepthMapResult result = sampleDepthMap(shadowTextureCoords,
                                            cascadeIndex,
                                            shadowViewSpacePosition.z);
-    float depthVariance = max(result.depthSquared - result.depth * result.depth, 2e-5);
+    // The minimum variance covers the precision of the stored moments.
+    float depthVariance = max(result.depthSquared - result.depth * result.depth,
+                              u_shadowMapMomentScales[cascadeIndex].y);
     float depthDifference = max(-shadowBias - shadowViewSpacePosition.z - result.depth, 0.0);
     float probability = depthVariance / (depthVariance + depthDifference * depthDifference);
     // Rescale the probability to reduce light-bleeding artifacts.
@@ -232,7 +211,7 @@ RayMarchResult rayMarch(vec3 fromViewSpacePosition,
     float rayDepth;
     vec2 textureCoords;
 
-    for (int i = 0; i < 100; ++i) {
+    for (int i = 0; i < RayMarchStepCount; ++i) {
         vec4 clipSpacePosition = projectionMatrix * vec4(viewSpacePosition, 1.0);
         clipSpacePosition /= clipSpacePosition.w;
         textureCoords = clipSpacePosition.xy * 0.5 + 0.5;
@@ -409,11 +388,11 @@ vec3 getOpaqueFragmentColorWithMediumEffects(float depth,
         {
             vec4 albedoData = texture(albedoTexture, textureCoords);
             albedo = linearColorFromSRGB(albedoData.rgb);
-            mediumType = blockTypeFromFloat(albedoData.a);
+            mediumType = decodeMediumType(albedoData.a);
         }
 
         vec3 viewSpacePosition = viewSpaceDirection * (depth / -viewSpaceDirection.z);
-        vec3 viewSpaceNormal = normalize(texture(normalTexture, textureCoords).xyz);
+        vec3 viewSpaceNormal = decodeNormal(texture(normalTexture, textureCoords).rg);
 
         vec3 lightColor = getDirectionalLightColor(viewSpaceNormal, viewSpaceSunDirection);
         lightColor *= getNonOccludedProbability((viewSpaceConversionMatrix
@@ -466,9 +445,9 @@ void main()
         vec3 viewSpaceNormal;
         bool isFrontFacing;
         {
-            vec4 normalData = texture(u_translucentNormalTexture, v_textureCoords);
-            viewSpaceNormal = normalize(normalData.xyz);
-            isFrontFacing = normalData.w > 0.5;
+            viewSpaceNormal = decodeNormal(texture(u_translucentNormalTexture, v_textureCoords).rg);
+            isFrontFacing = decodeIsFrontFacing(
+                texture(u_translucentAlbedoTexture, v_textureCoords).a);
         }
         float cosTheta1 = dot(viewSpaceNormal, -viewSpaceDirection);
 
@@ -566,7 +545,7 @@ void main()
 
         vec3 surfaceColor = mix(refractedColor, reflectedColor, reflectionCoefficient);
 
-        int mediumType = blockTypeFromFloat(texture(u_translucentAlbedoTexture, v_textureCoords).a);
+        int mediumType = decodeMediumType(texture(u_translucentAlbedoTexture, v_textureCoords).a);
         f_color.rgb = applyMediumEffects(mediumType,
                                          surfaceColor,
                                          translucentDistance,
@@ -6,6 +6,9 @@ layout(location = 0) out vec2 f_depth;
 
 void main()
 {
-    f_depth.r = v_shadowViewSpaceDepth;
-    f_depth.g = v_shadowViewSpaceDepth * v_shadowViewSpaceDepth;
+    // Occluders in front of the near plane are flattened onto it, so that the squared depth stays
+    // monotonic and both moments fit normalized formats.
+    float depth = clamp(v_shadowViewSpaceDepth, 0.0, 1.0);
+    f_depth.r = depth;
+    f_depth.g = depth * depth;
 }
@@ -4,23 +4,30 @@
 #include "uniform_buffer_data.glsl"
 
 uniform int u_cascadeIndex;
+// Maps the region of the cascade being rendered to the viewport
+uniform mat4 u_shadowViewProjectionMatrix;
+uniform ivec2 u_chunkOriginXZ;
 
-layout(location = 0) in ivec3 a_faceOrigin;
-layout(location = 1) in int a_faceIndex;
+layout(location = 0) in uvec2 a_blockFace;
 
 out float v_shadowViewSpaceDepth;
 
 void main()
 {
-    ivec2 textureCoords = FaceTextureCoords[gl_VertexID];
+    BlockFace blockFace = unpackBlockFace(a_blockFace, u_chunkOriginXZ);
 
-    vec4 worldSpacePosition = vec4(vec3(a_faceOrigin + textureCoords.x * FaceTangents[a_faceIndex]
-                                        + textureCoords.y * FaceBitangents[a_faceIndex]),
+    ivec2 textureCoords = FaceTextureCoords[gl_VertexID] * ivec2(blockFace.width, blockFace.height);
+
+    vec4 worldSpacePosition = vec4(vec3(blockFace.faceOrigin
+                                        + textureCoords.x * FaceTangents[blockFace.faceIndex]
+                                        + textureCoords.y * FaceBitangents[blockFace.faceIndex]),
                                    1.0);
 
-    v_shadowViewSpaceDepth = -(u_shadowViewMatrices[u_cascadeIndex] * worldSpacePosition).z;
+    // Depths are normalized by the depth range, so that they fit 16-bit formats.
+    v_shadowViewSpaceDepth = -(u_shadowViewMatrices[u_cascadeIndex] * worldSpacePosition).z
+                             / u_shadowMapMomentScales[u_cascadeIndex].x;
 
-    gl_Position = u_shadowViewProjectionMatrices[u_cascadeIndex] * worldSpacePosition;
+    gl_Position = u_shadowViewProjectionMatrix * worldSpacePosition;
 
     // Clamping the depth ensures that geometry outside the shadow frustum can still cast shadows,
     // even if their actual depth values fall outside the valid clip space range. This may produce
@@ -0,0 +1,51 @@
+#version 410 core
+
+#include "uniform_buffer_data.glsl"
+
+// One invocation per cascade. ShaderProgram defines the count as a literal.
+layout(triangles, invocations = ShadowMapCascadeCount) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+// Maps the region of each cascade being rendered to the viewport of the same index
+uniform mat4 u_regionViewProjectionMatrices[ShadowMapCascadeCount];
+// Cascades that the chunk may cast shadows into in this pass, all in the bound tier
+uniform int u_cascadeMask;
+// Index of the first cascade in the bound tier, which is stored in layer 0
+uniform int u_firstCascadeIndex;
+
+out float v_shadowViewSpaceDepth;
+
+void main()
+{
+    int cascadeIndex = gl_InvocationID;
+    if (((u_cascadeMask >> cascadeIndex) & 1) == 0) {
+        return;
+    }
+
+    vec4 clipSpacePositions[3];
+    for (int i = 0; i < 3; ++i) {
+        clipSpacePositions[i] = u_regionViewProjectionMatrices[cascadeIndex]
+                                * gl_in[i].gl_Position;
+    }
+
+    // Skip triangles entirely outside the region. Orthographic projection keeps w at 1.
+    vec2 minPosition = min(min(clipSpacePositions[0].xy, clipSpacePositions[1].xy),
+                           clipSpacePositions[2].xy);
+    vec2 maxPosition = max(max(clipSpacePositions[0].xy, clipSpacePositions[1].xy),
+                           clipSpacePositions[2].xy);
+    if (any(lessThan(maxPosition, vec2(-1.0))) || any(greaterThan(minPosition, vec2(1.0)))) {
+        return;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        gl_Layer = cascadeIndex - u_firstCascadeIndex;
+        gl_ViewportIndex = cascadeIndex;
+        v_shadowViewSpaceDepth = -(u_shadowViewMatrices[cascadeIndex] * gl_in[i].gl_Position).z
+                                 / u_shadowMapMomentScales[cascadeIndex].x;
+        gl_Position = clipSpacePositions[i];
+        // See shadow_depth.vert.glsl for why the depth is clamped.
+        gl_Position.z = clamp(gl_Position.z, -gl_Position.w, gl_Position.w);
+        EmitVertex();
+    }
+    EndPrimitive();
+}
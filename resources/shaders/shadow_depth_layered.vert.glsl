@@ -0,0 +1,20 @@
+#version 410 core
+
+#include "block_face.glsl"
+
+uniform ivec2 u_chunkOriginXZ;
+
+layout(location = 0) in uvec2 a_blockFace;
+
+void main()
+{
+    BlockFace blockFace = unpackBlockFace(a_blockFace, u_chunkOriginXZ);
+
+    ivec2 textureCoords = FaceTextureCoords[gl_VertexID] * ivec2(blockFace.width, blockFace.height);
+
+    // The geometry shader transforms the world space position for each cascade.
+    gl_Position = vec4(vec3(blockFace.faceOrigin
+                            + textureCoords.x * FaceTangents[blockFace.faceIndex]
+                            + textureCoords.y * FaceBitangents[blockFace.faceIndex]),
+                       1.0);
+}
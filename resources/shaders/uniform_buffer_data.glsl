@@ -1,4 +1,4 @@
-const int ShadowMapCascadeCount = 6;
+// ShadowMapCascadeCount is defined by ShaderProgram.
 
 layout(std140) uniform UniformBufferData
 {
@@ -20,6 +20,8 @@ layout(std140) uniform UniformBufferData
     mat4 u_mainToShadowViewProjectionMatrices[ShadowMapCascadeCount];
 
     vec4 u_shadowMapDepthBlurScales[ShadowMapCascadeCount];
+    vec4 u_shadowMapTextureOffsets[ShadowMapCascadeCount];
+    vec4 u_shadowMapMomentScales[ShadowMapCascadeCount];
 
     mat4 u_viewMatrixInverse;
     mat4 u_projectionMatrixInverse;
@@ -0,0 +1,146 @@
+#include "block_face_arena.h"
+
+#include "performance_counters.h"
+
+#include <algorithm>
+
+namespace minecraft {
+
+int BlockFaceArena::allocate(const GLsizei instanceCount)
+{
+    auto allocation{_allocator.allocate(instanceCount)};
+    if (allocation < 0) {
+        reallocate(instanceCount);
+        allocation = _allocator.allocate(instanceCount);
+    }
+    updateCounters();
+    return allocation;
+}
+
+void BlockFaceArena::free(const int allocation)
+{
+    _allocator.free(allocation);
+    updateCounters();
+}
+
+void BlockFaceArena::updateInstances(const int allocation,
+                                     const GLsizei offset,
+                                     const std::vector<BlockFace> &instances)
+{
+    _renderer.updateInstances(first(allocation) + offset, instances);
+}
+
+void BlockFaceArena::copyInstances(const int sourceAllocation,
+                                   const int destinationAllocation,
+                                   std::vector<InstanceRangeCopy> copies)
+{
+    for (auto &copy : copies) {
+        copy.sourceFirst += first(sourceAllocation);
+        copy.destinationFirst += first(destinationAllocation);
+    }
+    _renderer.copyInstances<BlockFace>(copies);
+}
+
+void BlockFaceArena::copyInstancesFromBuffer(const GLuint sourceBuffer,
+                                             const int destinationAllocation,
+                                             std::vector<InstanceRangeCopy> copies)
+{
+    for (auto &copy : copies) {
+        copy.destinationFirst += first(destinationAllocation);
+    }
+    _renderer.copyInstances<BlockFace>(copies, sourceBuffer);
+}
+
+void BlockFaceArena::clearInstances(const int allocation,
+                                    const std::vector<std::pair<GLsizei, GLsizei>> &ranges)
+{
+    std::vector<InstanceRangeCopy> copies;
+    GLsizei maxCount{0};
+    for (const auto &[offset, instanceCount] : ranges) {
+        if (instanceCount > 0) {
+            copies.push_back({
+                .sourceFirst = 0,
+                .destinationFirst = first(allocation) + offset,
+                .count = instanceCount,
+            });
+            maxCount = std::max(maxCount, instanceCount);
+        }
+    }
+    if (copies.empty()) {
+        return;
+    }
+
+    if (maxCount > _zeroInstanceCount) {
+        const auto context{OpenGLContext::instance()};
+        if (!_zeroBuffer) {
+            GLuint buffer{0u};
+            context->glGenBuffers(1, &buffer);
+            context->checkError();
+            _zeroBuffer = OpenGLObject{
+                buffer,
+                [](OpenGLContext *const context, const GLuint buffer) {
+                    context->glDeleteBuffers(1, &buffer);
+                },
+            };
+        }
+        _zeroInstanceCount = std::max(maxCount, _zeroInstanceCount * 2);
+        const std::vector<BlockFace> zeros(static_cast<std::size_t>(_zeroInstanceCount));
+        context->glBindBuffer(GL_COPY_READ_BUFFER, _zeroBuffer.get());
+        context->checkError();
+        context->glBufferData(GL_COPY_READ_BUFFER,
+                              static_cast<GLsizeiptr>(zeros.size() * sizeof(BlockFace)),
+                              zeros.data(),
+                              GL_STATIC_DRAW);
+        context->checkError();
+    }
+    _renderer.copyInstances<BlockFace>(copies, _zeroBuffer.get());
+}
+
+void BlockFaceArena::bind()
+{
+    _renderer.bind();
+    ++PerformanceCounters::instance().blockFaceVertexArrayBindCount;
+}
+
+void BlockFaceArena::draw(const GLsizei first, const GLsizei instanceCount)
+{
+    // This gives 2 triangles per quad: (0, 1, 2) and (0, 2, 3).
+    if (_renderer.drawRange(4, GL_TRIANGLE_FAN, first, instanceCount)) {
+        ++PerformanceCounters::instance().blockFaceAttributePointerUpdateCount;
+    }
+}
+
+void BlockFaceArena::releaseResources()
+{
+    _renderer.releaseResources();
+    _zeroBuffer.reset();
+    _zeroInstanceCount = 0;
+    _allocator.clear();
+    updateCounters();
+}
+
+void BlockFaceArena::reallocate(const GLsizei instanceCount)
+{
+    std::vector<InstanceRangeCopy> copies;
+    for (const auto &move : _allocator.pack(instanceCount)) {
+        copies.push_back({
+            .sourceFirst = move.sourceFirst,
+            .destinationFirst = move.destinationFirst,
+            .count = move.count,
+        });
+    }
+    _renderer.resizeInstances<BlockFace>(_allocator.capacity(), copies, GL_DYNAMIC_DRAW);
+
+    ++PerformanceCounters::instance().blockFaceArenaReallocationCount;
+}
+
+void BlockFaceArena::updateCounters() const
+{
+    auto &counters{PerformanceCounters::instance()};
+    counters.blockFaceArenaCapacity = _allocator.capacity();
+    counters.blockFaceArenaUsedCount = _allocator.usedCount();
+    counters.blockFaceArenaFreeRangeCount = static_cast<std::int64_t>(_allocator.freeRangeCount());
+    counters.blockFaceArenaLargestFreeRange = _allocator.largestFreeRange();
+}
+
+} // namespace minecraft
@@ -0,0 +1,98 @@
+#ifndef MINECRAFT_BLOCK_FACE_ARENA_H
+#define MINECRAFT_BLOCK_FACE_ARENA_H
+
+#include "instanced_renderer.h"
+#include "opengl_object.h"
+#include "range_allocator.h"
+#include "vertex_attribute.h"
+
+#include <QOpenGLFunctions_4_1_Core>
+
+#include <utility>
+#include <vector>
+
+namespace minecraft {
+
+// An instance buffer shared by the block faces of all chunks, so that all of them are drawn from
+// one vertex array. Chunks allocate ranges of instances from it, which are tracked by a
+// RangeAllocator. When no free range is large enough, the buffer is reallocated with the
+// allocations packed by the allocator.
+class BlockFaceArena
+{
+public:
+    static constexpr GLsizei InitialCapacity{1 << 20};
+
+    static BlockFaceArena &instance()
+    {
+        static BlockFaceArena arena;
+        return arena;
+    }
+
+    BlockFaceArena(const BlockFaceArena &) = delete;
+    BlockFaceArena(BlockFaceArena &&) = delete;
+
+    BlockFaceArena &operator=(const BlockFaceArena &) = delete;
+    BlockFaceArena &operator=(BlockFaceArena &&) = delete;
+
+    // Returns the ID of a new allocation of instanceCount instances, which must be positive. The
+    // first instances of all allocations may change on every call.
+    int allocate(const GLsizei instanceCount);
+
+    void free(const int allocation);
+
+    GLsizei first(const int allocation) const { return _allocator.first(allocation); }
+
+    // Overwrites the instances of an allocation starting at the given offset.
+    void updateInstances(const int allocation,
+                         const GLsizei offset,
+                         const std::vector<BlockFace> &instances);
+
+    // Copies ranges of instances between allocations, where the first instances of the copies are
+    // relative to the source and destination allocations.
+    void copyInstances(const int sourceAllocation,
+                       const int destinationAllocation,
+                       std::vector<InstanceRangeCopy> copies);
+
+    // Copies ranges of instances from another buffer into an allocation, where the destination
+    // first instances are relative to the allocation.
+    void copyInstancesFromBuffer(const GLuint sourceBuffer,
+                                 const int destinationAllocation,
+                                 std::vector<InstanceRangeCopy> copies);
+
+    // Zero-fills ranges of an allocation on the GPU, given as pairs of first instances relative to
+    // the allocation and instance counts.
+    void clearInstances(const int allocation,
+                        const std::vector<std::pair<GLsizei, GLsizei>> &ranges);
+
+    // Binds the vertex array, which must stay bound while drawing.
+    void bind();
+
+    // Draws the instances in [first, first + instanceCount) of the buffer.
+    void draw(const GLsizei first, const GLsizei instanceCount);
+
+    // All allocations must be freed before.
+    void releaseResources();
+
+private:
+    BlockFaceArena()
+        : _renderer{}
+        , _allocator{InitialCapacity}
+        , _zeroBuffer{}
+        , _zeroInstanceCount{0}
+    {}
+
+    // Packs the allocations into a buffer that fits another instanceCount instances.
+    void reallocate(const GLsizei instanceCount);
+    void updateCounters() const;
+
+    InstancedRenderer _renderer;
+    // Ranges of the instance buffer, in instances
+    RangeAllocator _allocator;
+    // Zero-filled buffer that clearInstances() copies from, grown on demand
+    OpenGLObject _zeroBuffer;
+    GLsizei _zeroInstanceCount;
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_BLOCK_FACE_ARENA_H
@@ -0,0 +1,291 @@
+#include "block_face_cache.h"
+
+#include "performance_counters.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <iterator>
+
+namespace minecraft {
+
+// Each file holds one entry in native byte order, since the cache is local to the machine:
+// - A header of FileHeader
+// - slotOffsets as 32-bit unsigned integers
+// - minPoints and maxPoints as 32-bit signed integers
+// - blockFaces as 8-byte BlockFace
+// Files are named after their keys. The key is also stored in the header, so that a file renamed
+// or left over from another format is never taken for the entry of its name.
+
+namespace {
+
+struct FileHeader
+{
+    std::uint32_t magic;
+    std::uint32_t formatVersion;
+    std::uint64_t key;
+    std::uint32_t blockFaceCount;
+    // Written as zero, so that the header has no uninitialized padding
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 24);
+
+constexpr std::uint32_t FileMagic{0x4642'4D4Du}; // "MMBF"
+
+constexpr std::size_t getFileSize(const std::size_t blockFaceCount)
+{
+    return sizeof(FileHeader) + sizeof(BlockFaceCacheEntry::slotOffsets)
+           + sizeof(BlockFaceCacheEntry::minPoints) + sizeof(BlockFaceCacheEntry::maxPoints)
+           + blockFaceCount * sizeof(BlockFace);
+}
+
+} // namespace
+
+void BlockFaceCache::setDirectory(const QString &directory)
+{
+    if (!QDir{}.mkpath(directory)) {
+        qWarning() << "Failed to create block face cache directory" << directory;
+        return;
+    }
+    // Files are listed from the most recently modified, and they are touched when read, so the
+    // least recently used files of the previous runs are the ones past the size limit.
+    const auto fileInfos{
+        QDir{directory}.entryInfoList({QStringLiteral("*.bin")}, QDir::Files, QDir::Time)};
+    std::vector<QString> removedFilePaths;
+    {
+        const std::lock_guard lock{_mutex};
+        _directory = directory;
+        auto isFull{false};
+        for (const auto &fileInfo : fileInfos) {
+            auto isKey{false};
+            const auto key{fileInfo.completeBaseName().toULongLong(&isKey, 16)};
+            const auto byteCount{static_cast<std::size_t>(fileInfo.size())};
+            isFull = isFull || _diskByteCount + byteCount > _maxDiskByteCount;
+            if (!isKey || isFull || _fileIterators.contains(key)) {
+                removedFilePaths.push_back(fileInfo.filePath());
+                continue;
+            }
+            _files.emplace_back(key, byteCount);
+            _fileIterators.emplace(key, std::prev(_files.end()));
+            _diskByteCount += byteCount;
+        }
+        PerformanceCounters::instance().blockFaceCacheDiskBytes = static_cast<std::int64_t>(
+            _diskByteCount);
+    }
+    _diskThreadPool.start([removedFilePaths = std::move(removedFilePaths)] {
+        for (const auto &filePath : removedFilePaths) {
+            QFile::remove(filePath);
+        }
+    });
+}
+
+std::shared_ptr<const BlockFaceCacheEntry> BlockFaceCache::find(const std::uint64_t key)
+{
+    QString filePath;
+    {
+        const std::lock_guard lock{_mutex};
+        if (const auto it{_entryIterators.find(key)}; it != _entryIterators.end()) {
+            _entries.splice(_entries.begin(), _entries, it->second);
+            return it->second->second;
+        }
+        const auto it{_fileIterators.find(key)};
+        if (it == _fileIterators.end()) {
+            return nullptr;
+        }
+        _files.splice(_files.begin(), _files, it->second);
+        filePath = getFilePath(key);
+    }
+
+    // Files are read without the lock, so that worker threads do not wait for each other's I/O.
+    // Reading a section is still much faster than meshing it.
+    auto entry{readFile(filePath, key)};
+    if (entry == nullptr) {
+        // The file is of another format version, damaged, or removed meanwhile. It is forgotten,
+        // so that the next insert writes it again.
+        {
+            const std::lock_guard lock{_mutex};
+            removeFile(key);
+        }
+        _diskThreadPool.start([filePath] { QFile::remove(filePath); });
+        return nullptr;
+    }
+    ++PerformanceCounters::instance().blockFaceCacheDiskHitCount;
+    // The modification time orders the files by recency on the next run.
+    _diskThreadPool.start([filePath] {
+        QFile file{filePath};
+        if (file.open(QFile::Append)) {
+            file.setFileTime(QDateTime::currentDateTime(), QFile::FileModificationTime);
+        }
+    });
+    const std::lock_guard lock{_mutex};
+    insertToMemory(key, entry);
+    return entry;
+}
+
+void BlockFaceCache::insert(const std::uint64_t key,
+                            std::shared_ptr<const BlockFaceCacheEntry> entry)
+{
+    QString filePath;
+    {
+        const std::lock_guard lock{_mutex};
+        insertToMemory(key, entry);
+        if (_directory.isEmpty() || _fileIterators.contains(key)) {
+            return;
+        }
+        filePath = getFilePath(key);
+    }
+    // The file is only added to the index once it is completely written. Entries with the same key
+    // have the same contents, so writing one twice is harmless.
+    _diskThreadPool.start([this, key, filePath, entry = std::move(entry)] {
+        const auto byteCount{writeFile(filePath, key, *entry)};
+        if (byteCount == 0) {
+            return;
+        }
+        std::vector<QString> removedFilePaths;
+        {
+            const std::lock_guard lock{_mutex};
+            removedFilePaths = addFile(key, byteCount);
+        }
+        for (const auto &removedFilePath : removedFilePaths) {
+            QFile::remove(removedFilePath);
+        }
+    });
+}
+
+void BlockFaceCache::insertToMemory(const std::uint64_t key,
+                                    std::shared_ptr<const BlockFaceCacheEntry> entry)
+{
+    if (_entryIterators.contains(key)) {
+        return;
+    }
+    _memoryByteCount += entry->byteCount();
+    _entries.emplace_front(key, std::move(entry));
+    _entryIterators.emplace(key, _entries.begin());
+    while (_memoryByteCount > _maxMemoryByteCount) {
+        const auto &[leastRecentKey, leastRecentEntry]{_entries.back()};
+        _memoryByteCount -= leastRecentEntry->byteCount();
+        _entryIterators.erase(leastRecentKey);
+        _entries.pop_back();
+    }
+    PerformanceCounters::instance().blockFaceCacheBytes = static_cast<std::int64_t>(
+        _memoryByteCount);
+}
+
+std::vector<QString> BlockFaceCache::addFile(const std::uint64_t key, const std::size_t byteCount)
+{
+    removeFile(key);
+    _diskByteCount += byteCount;
+    _files.emplace_front(key, byteCount);
+    _fileIterators.emplace(key, _files.begin());
+    std::vector<QString> removedFilePaths;
+    while (_diskByteCount > _maxDiskByteCount) {
+        const auto [leastRecentKey, leastRecentByteCount]{_files.back()};
+        removedFilePaths.push_back(getFilePath(leastRecentKey));
+        removeFile(leastRecentKey);
+    }
+    PerformanceCounters::instance().blockFaceCacheDiskBytes = static_cast<std::int64_t>(
+        _diskByteCount);
+    return removedFilePaths;
+}
+
+void BlockFaceCache::removeFile(const std::uint64_t key)
+{
+    const auto it{_fileIterators.find(key)};
+    if (it == _fileIterators.end()) {
+        return;
+    }
+    _diskByteCount -= it->second->second;
+    _files.erase(it->second);
+    _fileIterators.erase(it);
+    PerformanceCounters::instance().blockFaceCacheDiskBytes = static_cast<std::int64_t>(
+        _diskByteCount);
+}
+
+QString BlockFaceCache::getFilePath(const std::uint64_t key) const
+{
+    return QDir{_directory}.filePath(QString::number(key, 16).rightJustified(16, '0') + ".bin");
+}
+
+std::shared_ptr<const BlockFaceCacheEntry> BlockFaceCache::readFile(const QString &filePath,
+                                                                    const std::uint64_t key)
+{
+    // The file is mapped, so that the header is validated in place and the rest is copied straight
+    // into the entry. The mapping is released when the file is destroyed.
+    QFile file{filePath};
+    if (!file.open(QFile::ReadOnly)) {
+        return nullptr;
+    }
+    const auto fileSize{static_cast<std::size_t>(file.size())};
+    if (fileSize < getFileSize(0)) {
+        return nullptr;
+    }
+    const auto data{file.map(0, static_cast<qint64>(fileSize))};
+    if (data == nullptr) {
+        return nullptr;
+    }
+    std::size_t offset{0};
+    const auto read{[data, &offset](void *const destination, const std::size_t size) {
+        std::memcpy(destination, data + offset, size);
+        offset += size;
+    }};
+
+    FileHeader header;
+    read(&header, sizeof(header));
+    if (header.magic != FileMagic || header.formatVersion != FormatVersion || header.key != key
+        || fileSize != getFileSize(header.blockFaceCount)) {
+        return nullptr;
+    }
+    auto entry{std::make_shared<BlockFaceCacheEntry>()};
+    read(entry->slotOffsets.data(), sizeof(entry->slotOffsets));
+    read(entry->minPoints.data(), sizeof(entry->minPoints));
+    read(entry->maxPoints.data(), sizeof(entry->maxPoints));
+    // The offsets index the block faces when the entry is used.
+    if (entry->slotOffsets.front() != 0 || entry->slotOffsets.back() != header.blockFaceCount
+        || !std::ranges::is_sorted(entry->slotOffsets)) {
+        return nullptr;
+    }
+    if (header.blockFaceCount > 0) {
+        entry->blockFaces.resize(header.blockFaceCount);
+        read(entry->blockFaces.data(), entry->blockFaces.size() * sizeof(BlockFace));
+    }
+    return entry;
+}
+
+std::size_t BlockFaceCache::writeFile(const QString &filePath,
+                                      const std::uint64_t key,
+                                      const BlockFaceCacheEntry &entry)
+{
+    // The file is written to a temporary file and renamed, so that readers on other threads never
+    // see partial files. Failures are ignored, because the entry is only missed next time.
+    QSaveFile file{filePath};
+    if (!file.open(QFile::WriteOnly)) {
+        return 0;
+    }
+    const FileHeader header{
+        .magic = FileMagic,
+        .formatVersion = FormatVersion,
+        .key = key,
+        .blockFaceCount = static_cast<std::uint32_t>(entry.blockFaces.size()),
+        .reserved = 0,
+    };
+    const auto write{[&file](const void *const source, const std::size_t size) {
+        file.write(static_cast<const char *>(source), static_cast<qint64>(size));
+    }};
+    write(&header, sizeof(header));
+    write(entry.slotOffsets.data(), sizeof(entry.slotOffsets));
+    write(entry.minPoints.data(), sizeof(entry.minPoints));
+    write(entry.maxPoints.data(), sizeof(entry.maxPoints));
+    write(entry.blockFaces.data(), entry.blockFaces.size() * sizeof(BlockFace));
+    if (!file.commit()) {
+        return 0;
+    }
+    return getFileSize(entry.blockFaces.size());
+}
+
+} // namespace minecraft
@@ -0,0 +1,158 @@
+#ifndef MINECRAFT_BLOCK_FACE_CACHE_H
+#define MINECRAFT_BLOCK_FACE_CACHE_H
+
+#include "block_type.h"
+#include "terrain_chunk.h"
+#include "vertex_attribute.h"
+
+#include <glm/glm.hpp>
+
+#include <QString>
+#include <QThreadPool>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace minecraft {
+
+// Block faces of one chunk section, as generated by BlockFaceGenerationTask.
+struct BlockFaceCacheEntry
+{
+    // Slots of the section, ordered by face index and then group set
+    static constexpr int SlotCount{6 * TerrainChunk::BlockFaceGroupSetCount};
+
+    std::vector<BlockFace> blockFaces;
+    // Faces of slot i are in [slotOffsets[i], slotOffsets[i + 1]).
+    std::array<std::uint32_t, SlotCount + 1> slotOffsets;
+    // Bounding boxes of the BlockFaceGroups relative to the chunk origin. Empty boxes have their
+    // minimum points above their maximum points.
+    std::array<glm::ivec3, 4> minPoints;
+    std::array<glm::ivec3, 4> maxPoints;
+
+    std::size_t byteCount() const { return sizeof(*this) + blockFaces.size() * sizeof(BlockFace); }
+};
+
+// Hashes the inputs of block face generation into cache keys, 8 bytes at a time.
+class BlockFaceCacheKeyBuilder
+{
+public:
+    void add(const std::uint64_t value)
+    {
+        _hash = std::rotl(_hash ^ (value * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full;
+    }
+
+    void addBlocks(const std::span<const BlockType> blocks)
+    {
+        const auto bytes{std::as_bytes(blocks)};
+        std::size_t offset{0};
+        for (; offset + 8 <= bytes.size(); offset += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes.data() + offset, 8);
+            add(word);
+        }
+        std::uint64_t tail{0};
+        std::memcpy(&tail, bytes.data() + offset, bytes.size() - offset);
+        add(tail ^ (std::uint64_t{bytes.size()} << 56));
+    }
+
+    std::uint64_t key() const
+    {
+        // Finalizer of MurmurHash3, so that all input bits affect all key bits
+        auto hash{_hash};
+        hash = (hash ^ (hash >> 33)) * 0xFF51AFD7ED558CCDull;
+        hash = (hash ^ (hash >> 33)) * 0xC4CEB9FE1A85EC53ull;
+        return hash ^ (hash >> 33);
+    }
+
+private:
+    std::uint64_t _hash{0x9E3779B97F4A7C15ull};
+};
+
+// A thread-safe cache of section block faces keyed by hashes of their generation inputs. Recently
+// used entries are kept in memory. If a cache directory is set, entries are also written to files
+// there so that they survive restarts, and the least recently used files are removed once the
+// files exceed MaxDiskByteCount. Files are written and removed on a background thread, and only
+// files known to exist are read, so lookups that miss never touch the disk.
+class BlockFaceCache
+{
+public:
+    // Bump when the block faces generated from the same inputs or the file format change. Files of
+    // other versions are removed when they are looked up, and written again on the next insert.
+    static constexpr std::uint32_t FormatVersion{2};
+    static constexpr std::size_t MaxMemoryByteCount{std::size_t{64} << 20};
+    static constexpr std::size_t MaxDiskByteCount{std::size_t{256} << 20};
+
+    static BlockFaceCache &instance()
+    {
+        static BlockFaceCache cache;
+        return cache;
+    }
+
+    // Enables the cache on disk. The directory is created if it does not exist, and the least
+    // recently used files over the disk limit are removed. It must be called before any lookup.
+    void setDirectory(const QString &directory);
+
+    std::shared_ptr<const BlockFaceCacheEntry> find(const std::uint64_t key);
+    void insert(const std::uint64_t key, std::shared_ptr<const BlockFaceCacheEntry> entry);
+
+private:
+    using EntryList
+        = std::list<std::pair<std::uint64_t, std::shared_ptr<const BlockFaceCacheEntry>>>;
+    // Keys and byte counts of the files in the cache directory
+    using FileList = std::list<std::pair<std::uint64_t, std::size_t>>;
+
+    friend class BlockFaceCacheTest;
+
+    explicit BlockFaceCache(const std::size_t maxMemoryByteCount = MaxMemoryByteCount,
+                            const std::size_t maxDiskByteCount = MaxDiskByteCount)
+        : _maxMemoryByteCount{maxMemoryByteCount}
+        , _maxDiskByteCount{maxDiskByteCount}
+    {
+        // A single thread runs the file operations in the order they are started.
+        _diskThreadPool.setMaxThreadCount(1);
+    }
+
+    // The lock must be held.
+    void insertToMemory(const std::uint64_t key, std::shared_ptr<const BlockFaceCacheEntry> entry);
+    // The lock must be held. Returns the paths of the least recently used files to remove.
+    std::vector<QString> addFile(const std::uint64_t key, const std::size_t byteCount);
+    // The lock must be held.
+    void removeFile(const std::uint64_t key);
+    QString getFilePath(const std::uint64_t key) const;
+    static std::shared_ptr<const BlockFaceCacheEntry> readFile(const QString &filePath,
+                                                               const std::uint64_t key);
+    // Returns the size of the written file, or 0 on failure.
+    static std::size_t writeFile(const QString &filePath,
+                                 const std::uint64_t key,
+                                 const BlockFaceCacheEntry &entry);
+
+    std::size_t _maxMemoryByteCount;
+    std::size_t _maxDiskByteCount;
+    std::mutex _mutex;
+    // Ordered from the most to the least recently used
+    EntryList _entries;
+    std::unordered_map<std::uint64_t, EntryList::iterator> _entryIterators;
+    std::size_t _memoryByteCount{0};
+    // Empty if the cache on disk is disabled. It is set before any task runs.
+    QString _directory;
+    // Files that are completely written, ordered from the most to the least recently used
+    FileList _files;
+    std::unordered_map<std::uint64_t, FileList::iterator> _fileIterators;
+    std::size_t _diskByteCount{0};
+    // Destroyed first, so that pending file operations finish while the other members are alive
+    QThreadPool _diskThreadPool;
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_BLOCK_FACE_CACHE_H
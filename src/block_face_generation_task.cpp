@@ -1,212 +1,485 @@
 #include "block_face_generation_task.h"
 
 #include "aligned_box_3d.h"
+#include "block_face_cache.h"
+#include "block_face_mesher.h"
+#include "block_face_uploader.h"
 #include "block_type.h"
-#include "constants.h"
 #include "direction.h"
+#include "performance_counters.h"
 
+#include <QElapsedTimer>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <limits>
 #include <mutex>
 #include <ranges>
+#include <span>
 #include <utility>
 
 namespace minecraft {
 
-BlockFaceGenerationTask::BlockFaceGenerationTask(TerrainChunk *const chunk)
+namespace {
+
+std::size_t getMaxPooledObjectCount()
+{
+    // Tasks waiting in the thread pool also hold pooled objects, so keep a few more than the number
+    // of worker threads.
+    return static_cast<std::size_t>(QThreadPool::globalInstance()->maxThreadCount()) * 2;
+}
+
+} // namespace
+
+BlockFaceGenerationTask::BlockFaceGenerationTask(TerrainChunk *const chunk,
+                                                 const std::uint32_t sectionMask)
     : _chunk{chunk}
-    , _blocks{}
+    , _sectionMask{sectionMask}
+    , _lodScale{chunk->_lodScale}
+    , _neighborLodScales{}
+    , _gridSize{glm::ivec3{TerrainChunk::SizeX, TerrainChunk::SizeY, TerrainChunk::SizeZ}
+                / chunk->_lodScale}
+    , _blockSnapshot{chunk->_blockStorage.snapshot()}
+    , _neighborBlockSnapshots{}
+    , _emptyLayers{chunk->_blockStorage.emptyLayers()}
+    , _solidLayers{chunk->_blockStorage.solidLayers()}
+    , _previousInstanceCounts{}
+    , _meshedLayers{}
+    , _copiedLayers{}
+    , _minY{0}
+    , _maxY{0}
+    , _uncachedSectionMask{0}
+    , _sectionCacheKeys{}
+    , _mesher{}
     , _blockFaces{}
     , _blockFaceMinPoints{}
     , _blockFaceMaxPoints{}
+    , _neighborBorderFingerprints{}
 {
-    // Because we cannot access the block data safely from worker threads, we make a local copy of
-    // them in the task constructor.
-    for (const auto x : std::views::iota(0, TerrainChunk::SizeX)) {
-        for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
-            for (const auto z : std::views::iota(0, TerrainChunk::SizeZ)) {
-                _blocks[x + 1][y + 1][z + 1] = _chunk->_blocks[x][y][z];
-            }
+    // Because we cannot access the block data safely from worker threads, we take snapshots of them
+    // here. This is cheap, and the blocks are copied into the paddings on the worker thread.
+    for (const auto i : std::views::iota(0, 4)) {
+        if (const auto neighbor{_chunk->_neighbors[i]}; neighbor != nullptr) {
+            _neighborBlockSnapshots[i] = neighbor->_blockStorage.snapshot();
+            _neighborLodScales[i] = neighbor->_lodScale;
         }
     }
-    // Add paddings of 1 block on each side to store blocks from neighboring chunks.
-    // X axis
-    if (const auto neighbor{_chunk->getNeighbor(Direction::PositiveX)}; neighbor != nullptr) {
-        for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
-            for (const auto z : std::views::iota(0, TerrainChunk::SizeZ)) {
-                _blocks.back()[y + 1][z + 1] = neighbor->_blocks.front()[y][z];
-            }
-        }
+    for (const auto slot : std::views::iota(0, TerrainChunk::BlockFaceSlotCount)) {
+        _previousInstanceCounts[slot] = _chunk->_renderer.instanceCount(slot);
     }
-    if (const auto neighbor{_chunk->getNeighbor(Direction::NegativeX)}; neighbor != nullptr) {
-        for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
-            for (const auto z : std::views::iota(0, TerrainChunk::SizeZ)) {
-                _blocks.front()[y + 1][z + 1] = neighbor->_blocks.back()[y][z];
+    ++pendingCounter();
+}
+
+BlockFaceGenerationTask::~BlockFaceGenerationTask()
+{
+    mesherPool().release(std::move(_mesher));
+    // Block faces are still owned if the task is never run.
+    recycleBlockFaces(std::move(_blockFaces));
+    --pendingCounter();
+}
+
+void BlockFaceGenerationTask::recycleBlockFaces(std::unique_ptr<BlockFaceSlots> blockFaces)
+{
+    blockFacePool().release(std::move(blockFaces));
+}
+
+std::atomic<int> &BlockFaceGenerationTask::pendingCounter()
+{
+    static std::atomic<int> counter{0};
+    return counter;
+}
+
+ObjectPool<BlockFaceMesher> &BlockFaceGenerationTask::mesherPool()
+{
+    static ObjectPool<BlockFaceMesher> pool{getMaxPooledObjectCount()};
+    return pool;
+}
+
+ObjectPool<BlockFaceSlots> &BlockFaceGenerationTask::blockFacePool()
+{
+    static ObjectPool<BlockFaceSlots> pool{getMaxPooledObjectCount()};
+    return pool;
+}
+
+void BlockFaceGenerationTask::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    _mesher = mesherPool().acquire();
+    _blockFaces = blockFacePool().acquire();
+    // Reserve room for as many faces as the previous mesh of the chunk, so that the vectors rarely
+    // grow while generating.
+    _blockFaces->resize(TerrainChunk::BlockFaceSlotCount);
+    for (const auto slot : std::views::iota(0, TerrainChunk::BlockFaceSlotCount)) {
+        auto &blockFaces{(*_blockFaces)[slot]};
+        blockFaces.clear();
+        blockFaces.reserve(static_cast<std::size_t>(_previousInstanceCounts[slot]));
+    }
+
+    for (const auto i : std::views::iota(0, 4)) {
+        _blockFaceMinPoints[i].fill(glm::ivec3{std::numeric_limits<int>::max()});
+        _blockFaceMaxPoints[i].fill(glm::ivec3{std::numeric_limits<int>::min()});
+    }
+
+    selectLayers();
+    copyBlocks();
+    computeNeighborBorderFingerprints();
+    // Release the snapshots early, so that the chunks need not copy their blocks on the next write.
+    _blockSnapshot.reset();
+    for (auto &snapshot : _neighborBlockSnapshots) {
+        snapshot.reset();
+    }
+    loadCachedSections();
+
+    QElapsedTimer meshingTimer;
+    meshingTimer.start();
+    _mesher->generate(_lodScale,
+                      _meshedLayers,
+                      _chunk->_originXZ,
+                      *_blockFaces,
+                      _blockFaceMinPoints,
+                      _blockFaceMaxPoints);
+    auto &counters{PerformanceCounters::instance()};
+    counters.blockFaceCacheMissNanoseconds += meshingTimer.nsecsElapsed();
+    storeCachedSections();
+
+    const auto nanoseconds{timer.nsecsElapsed()};
+    ++counters.blockFaceGenerationCount;
+    counters.blockFaceGenerationNanoseconds += nanoseconds;
+    PerformanceCounters::updateMax(counters.maxBlockFaceGenerationNanoseconds, nanoseconds);
+    counters.meshedLayerCount += static_cast<std::int64_t>(_meshedLayers.count());
+    for (const auto &blockFaces : *_blockFaces) {
+        counters.generatedBlockFaceCount += static_cast<std::int64_t>(blockFaces.size());
+    }
+
+    {
+        const std::lock_guard lock{_chunk->_blockFaceMutex};
+        _chunk->_state = TerrainChunkState::Meshed;
+        // Only the slots of the sections are filled, and the others are empty.
+        recycleBlockFaces(std::move(_chunk->_blockFaces));
+        _chunk->_blockFaces = std::move(_blockFaces);
+        for (const auto section : std::views::iota(0, TerrainChunk::SectionCount)) {
+            if (((_sectionMask >> section) & 1u) == 0) {
+                continue;
+            }
+            for (const auto i : std::views::iota(0, 4)) {
+                _chunk->_blockFaceBoundingBoxes[i][section] = AlignedBox3D{
+                    glm::vec3{_blockFaceMinPoints[i][section]},
+                    glm::vec3{_blockFaceMaxPoints[i][section]},
+                };
+                _chunk->_neighborBorderFingerprints[i][section]
+                    = _neighborBorderFingerprints[i][section];
             }
         }
     }
-    // No neighbor chunks along the Y axis
-    // Z axis
-    if (const auto neighbor{_chunk->getNeighbor(Direction::PositiveZ)}; neighbor != nullptr) {
-        for (const auto x : std::views::iota(0, TerrainChunk::SizeX)) {
-            for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
-                _blocks[x + 1][y + 1].back() = neighbor->_blocks[x][y].front();
+    // Hand the block faces to the upload thread. Otherwise, the render thread uploads them.
+    if (auto &uploader{BlockFaceUploader::instance()}; uploader.isRunning()) {
+        uploader.stage(_chunk);
+    }
+}
+
+BlockType BlockFaceGenerationTask::getDownsampledBlock(const BlockStorage::BlockArray &blocks,
+                                                       const glm::ivec3 &cell,
+                                                       const int scale)
+{
+    if (scale == 1) {
+        return blocks[cell.x][cell.y][cell.z];
+    }
+    // Block types fit in 3 bits. See BlockFace.
+    std::array<int, 8> counts{};
+    const auto minPosition{cell * scale};
+    for (const auto x : std::views::iota(minPosition.x, minPosition.x + scale)) {
+        for (const auto y : std::views::iota(minPosition.y, minPosition.y + scale)) {
+            for (const auto z : std::views::iota(minPosition.z, minPosition.z + scale)) {
+                ++counts[static_cast<std::size_t>(blocks[x][y][z])];
             }
         }
     }
-    if (const auto neighbor{_chunk->getNeighbor(Direction::NegativeZ)}; neighbor != nullptr) {
-        for (const auto x : std::views::iota(0, TerrainChunk::SizeX)) {
-            for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
-                _blocks[x + 1][y + 1].front() = neighbor->_blocks[x][y].back();
-            }
+    std::size_t majority{0};
+    for (const auto type : std::views::iota(std::size_t{1}, counts.size())) {
+        if (counts[type] > counts[majority] || (majority == 0 && counts[type] == counts[0])) {
+            majority = type;
         }
     }
+    return static_cast<BlockType>(majority);
 }
 
-void BlockFaceGenerationTask::run()
+void BlockFaceGenerationTask::selectLayers()
 {
-    _blockFaceMinPoints.fill(glm::ivec3{std::numeric_limits<int>::max()});
-    _blockFaceMaxPoints.fill(glm::ivec3{std::numeric_limits<int>::min()});
+    if (_sectionMask == 0) {
+        return;
+    }
+    const auto sectionSizeY{TerrainChunk::SectionSizeY / _lodScale};
+    const auto sectionMinY{std::countr_zero(_sectionMask) * sectionSizeY};
+    const auto sectionMaxY{(32 - std::countl_zero(_sectionMask)) * sectionSizeY};
+    const auto isInSections{[this, sectionSizeY](const int y) {
+        return ((_sectionMask >> (y / sectionSizeY)) & 1u) != 0;
+    }};
 
-    for (const auto x : std::views::iota(0, TerrainChunk::SizeX)) {
-        for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
-            for (const auto z : std::views::iota(0, TerrainChunk::SizeZ)) {
-                generateBlock(glm::ivec3{x, y, z});
+    if (_lodScale > 1) {
+        // Cells of the LOD grid are only known after downsampling, so all layers of the sections
+        // are meshed. Coarse layers are cheap to mesh anyway.
+        for (const auto y : std::views::iota(sectionMinY, sectionMaxY)) {
+            if (isInSections(y)) {
+                _meshedLayers.set(static_cast<std::size_t>(y));
             }
         }
-    }
+    } else {
+        // Only the layers of the sections that can have block faces are meshed. Layers of air have
+        // no faces, and neither do solid layers enclosed by solid layers and solid neighbor
+        // borders. The layers are classified from the block counts of the storage, and only the
+        // borders of solid layers are read.
+        const auto isLayerSolid{[this](const int y) {
+            return y >= 0 && y < TerrainChunk::SizeY
+                   && _solidLayers.test(static_cast<std::size_t>(y));
+        }};
+        const auto isLayerEnclosed{[&](const int y) {
+            if (!isLayerSolid(y - 1) || !isLayerSolid(y) || !isLayerSolid(y + 1)) {
+                return false;
+            }
+            for (const auto neighborIndex : std::views::iota(0, 4)) {
+                for (const auto i : std::views::iota(0, TerrainChunk::SizeX)) {
+                    if (!isSolid(getNeighborBorderBlock(neighborIndex, y, i))) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }};
 
-    const std::lock_guard lock{_chunk->_blockFaceMutex};
-    _chunk->_isBlockFaceReady = true;
-    for (const auto i : std::views::iota(0, 4)) {
-        _chunk->_blockFaces[i] = std::move(_blockFaces[i]);
-        _chunk->_blockFaceBoundingBoxes[i] = AlignedBox3D{
-            glm::vec3{_blockFaceMinPoints[i]},
-            glm::vec3{_blockFaceMaxPoints[i]},
-        };
-    }
-}
-
-void BlockFaceGenerationTask::generateBlock(const glm::ivec3 &position)
-{
-    constexpr auto FaceDirections{std::to_array<glm::ivec3>({
-        {1, 0, 0},
-        {-1, 0, 0},
-        {0, 1, 0},
-        {0, -1, 0},
-        {0, 0, 1},
-        {0, 0, -1},
-    })};
-
-    constexpr auto FaceOrigins{std::to_array<glm::ivec3>({
-        {1, 0, 1},
-        {0, 0, 0},
-        {0, 1, 1},
-        {0, 0, 0},
-        {0, 0, 1},
-        {1, 0, 0},
-    })};
-
-    const auto block{_blocks[position.x + 1][position.y + 1][position.z + 1]};
-    if (block == BlockType::Air) {
-        return;
+        for (const auto y : std::views::iota(sectionMinY, sectionMaxY)) {
+            if (isInSections(y) && !_emptyLayers.test(static_cast<std::size_t>(y))
+                && !isLayerEnclosed(y)) {
+                _meshedLayers.set(static_cast<std::size_t>(y));
+            }
+        }
     }
+    updateLayerRange();
+}
 
-    // Use integer coordinates to avoid floating-point rounding errors, e.g.,
-    // float(i) + 1.0f != float(i + 1).
-    const glm::ivec3 blockMinPoint{
-        _chunk->_originXZ[0] + position.x,
-        position.y,
-        _chunk->_originXZ[1] + position.z,
-    };
-    const auto blockMaxPoint{blockMinPoint + 1};
+void BlockFaceGenerationTask::updateLayerRange()
+{
+    _copiedLayers.reset();
+    _minY = 0;
+    _maxY = 0;
+    for (const auto y : std::views::iota(0, _gridSize.y)) {
+        if (isLayerMeshed(y)) {
+            if (_minY == _maxY) {
+                _minY = y;
+            }
+            _maxY = y + 1;
+        }
+        // Blocks right next to the meshed layers are needed as neighbors.
+        if (isLayerMeshed(y - 1) || isLayerMeshed(y) || isLayerMeshed(y + 1)) {
+            _copiedLayers.set(static_cast<std::size_t>(y));
+        }
+    }
+}
 
-    for (const auto faceIndex : std::views::iota(0, 6)) {
-        const auto neighborPosition{position + FaceDirections[faceIndex]};
-        const auto neighborBlock{
-            _blocks[neighborPosition.x + 1][neighborPosition.y + 1][neighborPosition.z + 1]};
+BlockType BlockFaceGenerationTask::getNeighborBorderBlock(const int neighborIndex,
+                                                          const int y,
+                                                          const int i) const
+{
+    // Missing neighbors are treated as solid, so that no walls are generated at the frontier of the
+    // terrain.
+    const auto &snapshot{_neighborBlockSnapshots[neighborIndex]};
+    if (snapshot == nullptr) {
+        return TerrainChunk::MissingNeighborBlock;
+    }
+    // The cells of a finer neighbor do not line up with the cells of this chunk. Treating the
+    // neighbor as air generates all the faces on this side of the border, which are hidden behind
+    // the neighbor where it is solid, so that no holes appear at the seam. The finer neighbor
+    // matches the cells of this chunk exactly.
+    const auto neighborLodScale{_neighborLodScales[neighborIndex]};
+    if (neighborLodScale < _lodScale) {
+        return BlockType::Air;
+    }
+    // Position of the neighbor block right next to the cell
+    const auto blockY{y * _lodScale};
+    const auto blockI{i * _lodScale};
+    glm::ivec3 position;
+    switch (TerrainChunk::NeighborDirections[neighborIndex]) {
+    case Direction::PositiveX:
+        position = {0, blockY, blockI};
+        break;
+    case Direction::NegativeX:
+        position = {TerrainChunk::SizeX - 1, blockY, blockI};
+        break;
+    case Direction::PositiveZ:
+        position = {blockI, blockY, 0};
+        break;
+    case Direction::NegativeZ:
+    default:
+        position = {blockI, blockY, TerrainChunk::SizeZ - 1};
+        break;
+    }
+    if (neighborLodScale == 1) {
+        return (*snapshot)[position.x][position.y][position.z];
+    }
+    return getDownsampledBlock(*snapshot, position / neighborLodScale, neighborLodScale);
+}
 
-        std::array<bool, 4> blockFaceGroups{false, false, false, false};
-        if (block == BlockType::Water) {
-            if (neighborBlock != BlockType::Air) {
+void BlockFaceGenerationTask::computeNeighborBorderFingerprints()
+{
+    for (const auto i : std::views::iota(0, 4)) {
+        const auto &snapshot{_neighborBlockSnapshots[i]};
+        for (const auto section : std::views::iota(0, TerrainChunk::SectionCount)) {
+            if (((_sectionMask >> section) & 1u) == 0) {
                 continue;
             }
-            if (Direction{faceIndex} != Direction::PositiveY) {
-                // Because the water wave algorithm in the shader only works for the positive Y
-                // face, we skip the other faces to avoid rendering artifacts.
+            // Directions come in pairs of opposite directions.
+            _neighborBorderFingerprints[i][section]
+                = snapshot != nullptr
+                      ? TerrainChunk::getBorderFingerprint(*snapshot, i ^ 1, section)
+                      : TerrainChunk::MissingBorderFingerprint;
+        }
+    }
+}
+
+void BlockFaceGenerationTask::copyBlocks()
+{
+    // Only the layers needed for meshing are copied. The mesher may hold stale blocks elsewhere.
+    auto &paddedBlocks{_mesher->blocks()};
+    auto copyYs{std::views::iota(std::max(_minY - 1, 0), std::min(_maxY + 1, _gridSize.y))
+                | std::views::filter([this](const int y) { return isLayerCopied(y); })};
+    const auto &blocks{*_blockSnapshot};
+    for (const auto x : std::views::iota(0, _gridSize.x)) {
+        for (const auto y : copyYs) {
+            if (_lodScale == 1) {
+                std::ranges::copy(blocks[x][y], paddedBlocks[x + 1][y + 1].begin() + 1);
                 continue;
             }
-            blockFaceGroups[static_cast<int>(BlockFaceGroup::Translucent)] = true;
-        } else {
-            if (block == BlockType::Lava) {
-                if (neighborBlock != BlockType::Air && neighborBlock != BlockType::Water) {
-                    continue;
-                }
-                blockFaceGroups[static_cast<int>(BlockFaceGroup::Opaque)] = true;
-            } else {
-                if (neighborBlock != BlockType::Air && neighborBlock != BlockType::Water
-                    && neighborBlock != BlockType::Lava) {
-                    continue;
-                }
-                blockFaceGroups[static_cast<int>(BlockFaceGroup::Opaque)] = true;
-            }
-            if (blockMinPoint.y < WaterLevel && neighborBlock == BlockType::Water) {
-                blockFaceGroups[static_cast<int>(BlockFaceGroup::UnderWater)] = true;
-            }
-            if (blockMinPoint.y >= WaterLevel - 1) {
-                blockFaceGroups[static_cast<int>(BlockFaceGroup::AboveWater)] = true;
+            for (const auto z : std::views::iota(0, _gridSize.z)) {
+                paddedBlocks[x + 1][y + 1][z + 1]
+                    = getDownsampledBlock(blocks, {x, y, z}, _lodScale);
             }
         }
+    }
+    // Add paddings of 1 block on each side to store blocks from neighboring chunks. Keep the order
+    // in sync with TerrainChunk::NeighborDirections.
+    for (const auto y : copyYs) {
+        for (const auto i : std::views::iota(0, _gridSize.x)) {
+            paddedBlocks[_gridSize.x + 1][y + 1][i + 1] = getNeighborBorderBlock(0, y, i);
+            paddedBlocks.front()[y + 1][i + 1] = getNeighborBorderBlock(1, y, i);
+            paddedBlocks[i + 1][y + 1][_gridSize.z + 1] = getNeighborBorderBlock(2, y, i);
+            paddedBlocks[i + 1][y + 1].front() = getNeighborBorderBlock(3, y, i);
+        }
+    }
+    // There are no neighbor chunks along the Y axis, and the paddings are air. The bottom padding
+    // is never written, but the top padding of a LOD grid is inside the workspace and may be stale.
+    if (_lodScale > 1) {
+        for (auto &layers : paddedBlocks | std::views::take(_gridSize.x + 2)) {
+            std::ranges::fill(layers[_gridSize.y + 1], BlockType::Air);
+        }
+    }
+}
 
-        glm::ivec2 textureRowColumn;
-        switch (block) {
-        case BlockType::Dirt:
-            textureRowColumn = {0, 2};
-            break;
-        case BlockType::Bedrock:
-            textureRowColumn = {1, 1};
-            break;
-        case BlockType::Grass:
-            if (Direction{faceIndex} == Direction::PositiveY) {
-                textureRowColumn = {2, 8};
-            } else if (Direction{faceIndex} == Direction::NegativeY) {
-                textureRowColumn = {0, 2};
-            } else {
-                textureRowColumn = {0, 3};
-            }
-            break;
-        case BlockType::Lava:
-            textureRowColumn = {14, 13};
-            break;
-        case BlockType::Snow:
-            textureRowColumn = {4, 2};
-            break;
-        case BlockType::Stone:
-            textureRowColumn = {0, 1};
-            break;
-        case BlockType::Water:
-            textureRowColumn = {12, 13};
-            break;
-        default:
-            textureRowColumn = {10, 8};
-        }
-
-        const BlockFace blockFace{
-            .faceOrigin{blockMinPoint + FaceOrigins[faceIndex]},
-            .faceIndex = static_cast<GLubyte>(faceIndex),
-            .textureIndex = static_cast<GLubyte>(textureRowColumn[0] * 16 + textureRowColumn[1]),
-            .blockType = static_cast<std::underlying_type_t<BlockType>>(block),
-            .mediumType = static_cast<std::underlying_type_t<BlockType>>(neighborBlock),
-        };
+std::uint64_t BlockFaceGenerationTask::getSectionCacheKey(const int section) const
+{
+    // The block faces of a section only depend on which of its layers are meshed, and on the blocks
+    // of the copied layers around them, including the paddings. Positions of block faces are
+    // relative to the chunk, so equal sections of different chunks share cache entries.
+    const auto sectionSizeY{TerrainChunk::SectionSizeY / _lodScale};
+    const auto minY{section * sectionSizeY};
+    const auto maxY{minY + sectionSizeY};
+    const auto &paddedBlocks{_mesher->blocks()};
+    BlockFaceCacheKeyBuilder builder;
+    builder.add(static_cast<std::uint64_t>(_lodScale));
+    builder.add(static_cast<std::uint64_t>(section));
+    for (const auto y : std::views::iota(minY - 1, maxY + 1)) {
+        const auto isMeshed{y >= minY && y < maxY && isLayerMeshed(y)};
+        builder.add(std::uint64_t{isMeshed} | std::uint64_t{isLayerCopied(y)} << 1);
+        if (!isLayerCopied(y)) {
+            continue;
+        }
+        // Corners of the paddings are never read.
+        for (const auto x : std::views::iota(0, _gridSize.x + 2)) {
+            builder.addBlocks(std::span{paddedBlocks[x][y + 1]}.subspan(1, _gridSize.z));
+        }
+        for (const auto x : std::views::iota(1, _gridSize.x + 1)) {
+            const auto &row{paddedBlocks[x][y + 1]};
+            builder.add(static_cast<std::uint64_t>(row.front())
+                        | static_cast<std::uint64_t>(row[_gridSize.z + 1]) << 8);
+        }
+    }
+    return builder.key();
+}
+
+void BlockFaceGenerationTask::loadCachedSections()
+{
+    auto &cache{BlockFaceCache::instance()};
+    auto &counters{PerformanceCounters::instance()};
+    const auto sectionSizeY{TerrainChunk::SectionSizeY / _lodScale};
+    const glm::ivec3 origin{_chunk->_originXZ[0], 0, _chunk->_originXZ[1]};
+    for (const auto section : std::views::iota(0, TerrainChunk::SectionCount)) {
+        if (((_sectionMask >> section) & 1u) == 0) {
+            continue;
+        }
+        // Sections without meshed layers are cheaper to mesh than to look up.
+        const auto sectionMinY{section * sectionSizeY};
+        const auto sectionYs{std::views::iota(sectionMinY, sectionMinY + sectionSizeY)};
+        if (std::ranges::none_of(sectionYs, [this](const int y) { return isLayerMeshed(y); })) {
+            continue;
+        }
+        const auto key{getSectionCacheKey(section)};
+        const auto entry{cache.find(key)};
+        if (entry == nullptr) {
+            ++counters.blockFaceCacheMissCount;
+            _uncachedSectionMask |= 1u << section;
+            _sectionCacheKeys[section] = key;
+            continue;
+        }
+        ++counters.blockFaceCacheHitCount;
+
+        for (const auto slot : std::views::iota(0, BlockFaceCacheEntry::SlotCount)) {
+            const auto faceIndex{slot / TerrainChunk::BlockFaceGroupSetCount};
+            const auto groupSet{slot % TerrainChunk::BlockFaceGroupSetCount};
+            (*_blockFaces)[TerrainChunk::getBlockFaceSlot(faceIndex, groupSet, section)].assign(
+                entry->blockFaces.begin() + entry->slotOffsets[slot],
+                entry->blockFaces.begin() + entry->slotOffsets[slot + 1]);
+        }
         for (const auto i : std::views::iota(0, 4)) {
-            if (!blockFaceGroups[i]) {
-                continue;
+            if (entry->minPoints[i].x <= entry->maxPoints[i].x) {
+                _blockFaceMinPoints[i][section] = origin + entry->minPoints[i];
+                _blockFaceMaxPoints[i][section] = origin + entry->maxPoints[i];
             }
-            _blockFaces[i].push_back(blockFace);
-            // This is the simplified logic. We can constrain the bounding box to include only the
-            // face instead of the whole block, but this is not necessary for now.
-            _blockFaceMinPoints[i] = glm::min(_blockFaceMinPoints[i], blockMinPoint);
-            _blockFaceMaxPoints[i] = glm::max(_blockFaceMaxPoints[i], blockMaxPoint);
         }
+        for (const auto y : sectionYs) {
+            _meshedLayers.reset(static_cast<std::size_t>(y));
+        }
+    }
+    updateLayerRange();
+}
+
+void BlockFaceGenerationTask::storeCachedSections() const
+{
+    auto &cache{BlockFaceCache::instance()};
+    const glm::ivec3 origin{_chunk->_originXZ[0], 0, _chunk->_originXZ[1]};
+    for (const auto section : std::views::iota(0, TerrainChunk::SectionCount)) {
+        if (((_uncachedSectionMask >> section) & 1u) == 0) {
+            continue;
+        }
+        auto entry{std::make_shared<BlockFaceCacheEntry>()};
+        entry->slotOffsets.front() = 0;
+        for (const auto slot : std::views::iota(0, BlockFaceCacheEntry::SlotCount)) {
+            const auto faceIndex{slot / TerrainChunk::BlockFaceGroupSetCount};
+            const auto groupSet{slot % TerrainChunk::BlockFaceGroupSetCount};
+            const auto &blockFaces{
+                (*_blockFaces)[TerrainChunk::getBlockFaceSlot(faceIndex, groupSet, section)]};
+            entry->blockFaces.insert(entry->blockFaces.end(), blockFaces.begin(), blockFaces.end());
+            entry->slotOffsets[slot + 1] = static_cast<std::uint32_t>(entry->blockFaces.size());
+        }
+        for (const auto i : std::views::iota(0, 4)) {
+            const auto &minPoint{_blockFaceMinPoints[i][section]};
+            const auto &maxPoint{_blockFaceMaxPoints[i][section]};
+            const auto isEmpty{minPoint.x > maxPoint.x};
+            entry->minPoints[i] = isEmpty ? glm::ivec3{1} : minPoint - origin;
+            entry->maxPoints[i] = isEmpty ? glm::ivec3{0} : maxPoint - origin;
+        }
+        cache.insert(_sectionCacheKeys[section], std::move(entry));
     }
 }
 
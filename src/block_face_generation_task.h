@@ -1,36 +1,121 @@
 #ifndef MINECRAFT_BLOCK_FACE_GENERATION_TASK_H
 #define MINECRAFT_BLOCK_FACE_GENERATION_TASK_H
 
+#include "block_face_mesher.h"
+#include "block_face_renderer.h"
 #include "block_type.h"
+#include "object_pool.h"
 #include "terrain_chunk.h"
-#include "vertex_attribute.h"
 
 #include <glm/glm.hpp>
 
 #include <QRunnable>
 
 #include <array>
-#include <vector>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <memory>
 
 namespace minecraft {
 
 class BlockFaceGenerationTask : public QRunnable
 {
 public:
-    BlockFaceGenerationTask(TerrainChunk *const chunk);
+    // Generates the block faces of the sections whose bits are set in sectionMask, from the LOD
+    // grid of the chunk.
+    BlockFaceGenerationTask(TerrainChunk *const chunk, const std::uint32_t sectionMask);
+
+    BlockFaceGenerationTask(const BlockFaceGenerationTask &) = delete;
+    BlockFaceGenerationTask(BlockFaceGenerationTask &&) = delete;
+
+    ~BlockFaceGenerationTask() override;
+
+    BlockFaceGenerationTask &operator=(const BlockFaceGenerationTask &) = delete;
+    BlockFaceGenerationTask &operator=(BlockFaceGenerationTask &&) = delete;
 
     void run() override;
 
+    // Returns the block faces handed to a chunk, once they are uploaded, for reuse by later tasks.
+    static void recycleBlockFaces(std::unique_ptr<BlockFaceSlots> blockFaces);
+
+    // Number of tasks created and not yet finished, including those waiting in the thread pool
+    static int pendingCount() { return pendingCounter().load(); }
+
 private:
-    void generateBlock(const glm::ivec3 &position);
+    friend class BlockFaceGenerationTaskTest;
+
+    bool isLayerMeshed(const int y) const
+    {
+        return y >= 0 && y < TerrainChunk::SizeY && _meshedLayers.test(static_cast<std::size_t>(y));
+    }
+
+    bool isLayerCopied(const int y) const
+    {
+        return y >= 0 && y < TerrainChunk::SizeY && _copiedLayers.test(static_cast<std::size_t>(y));
+    }
+
+    // Returns the block of a cell of scale^3 blocks in the LOD grid, which is the most common block
+    // in the cell. Ties with air are broken in favor of the other block, so that thin features are
+    // kept.
+    static BlockType getDownsampledBlock(const BlockStorage::BlockArray &blocks,
+                                         const glm::ivec3 &cell,
+                                         const int scale);
+
+    // Selects the layers to mesh and to copy from the snapshots.
+    void selectLayers();
+    // Returns the cell of a neighbor border at the given Y and position i along the border, in the
+    // LOD grid of this chunk.
+    BlockType getNeighborBorderBlock(const int neighborIndex, const int y, const int i) const;
+    // Sets the layers to copy and the range of Y coordinates from the meshed layers.
+    void updateLayerRange();
+    void copyBlocks();
+    // Records the neighbor borders that the block faces are generated with, from the snapshots, so
+    // that the sections are only regenerated when these borders change.
+    void computeNeighborBorderFingerprints();
+    // Returns the key of a section in BlockFaceCache, from the copied blocks.
+    std::uint64_t getSectionCacheKey(const int section) const;
+    // Takes the block faces of the cached sections and stops meshing their layers.
+    void loadCachedSections();
+    void storeCachedSections() const;
+
+    static std::atomic<int> &pendingCounter();
+    // Meshers are acquired on the worker thread.
+    static ObjectPool<BlockFaceMesher> &mesherPool();
+    static ObjectPool<BlockFaceSlots> &blockFacePool();
 
     TerrainChunk *_chunk;
-    std::array<std::array<std::array<BlockType, TerrainChunk::SizeZ + 2>, TerrainChunk::SizeY + 2>,
-               TerrainChunk::SizeX + 2>
-        _blocks;
-    std::array<std::vector<BlockFace>, 4> _blockFaces;
-    std::array<glm::ivec3, 4> _blockFaceMinPoints;
-    std::array<glm::ivec3, 4> _blockFaceMaxPoints;
+    std::uint32_t _sectionMask;
+    int _lodScale;
+    std::array<int, 4> _neighborLodScales;
+    // Size of the LOD grid. Coordinates of blocks, rows, and layers below are all in this grid.
+    glm::ivec3 _gridSize;
+    // Snapshots of the blocks of the chunk and its neighbors, which are released once copied
+    std::shared_ptr<const BlockStorage::BlockArray> _blockSnapshot;
+    std::array<std::shared_ptr<const BlockStorage::BlockArray>, 4> _neighborBlockSnapshots;
+    // Layers of the chunk that are all air or all solid in the snapshot
+    std::bitset<TerrainChunk::SizeY> _emptyLayers;
+    std::bitset<TerrainChunk::SizeY> _solidLayers;
+    std::array<GLsizei, TerrainChunk::BlockFaceSlotCount> _previousInstanceCounts;
+    // Layers of the sections that may have block faces
+    std::bitset<TerrainChunk::SizeY> _meshedLayers;
+    // Layers whose blocks are copied, including those right next to the meshed layers
+    std::bitset<TerrainChunk::SizeY> _copiedLayers;
+    // Range of Y coordinates covering all the meshed layers
+    int _minY;
+    int _maxY;
+    // Sections that are meshed because they are missing from the cache, and their cache keys
+    std::uint32_t _uncachedSectionMask;
+    std::array<std::uint64_t, TerrainChunk::SectionCount> _sectionCacheKeys;
+    std::unique_ptr<BlockFaceMesher> _mesher;
+    // Indexed by TerrainChunk::getBlockFaceSlot(). The vectors keep their capacities across tasks.
+    std::unique_ptr<BlockFaceSlots> _blockFaces;
+    // Indexed by [group][section]
+    BlockFaceMesher::SectionPoints _blockFaceMinPoints;
+    BlockFaceMesher::SectionPoints _blockFaceMaxPoints;
+    // Indexed by [neighbor][section]. Handed to the chunk along with the block faces.
+    std::array<std::array<std::uint64_t, TerrainChunk::SectionCount>, 4>
+        _neighborBorderFingerprints;
 };
 
 } // namespace minecraft
@@ -0,0 +1,454 @@
+#include "block_face_mesher.h"
+
+#include "constants.h"
+#include "direction.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <ranges>
+#include <type_traits>
+
+namespace minecraft {
+
+namespace {
+
+constexpr auto FaceDirections{std::to_array<glm::ivec3>({
+    {1, 0, 0},
+    {-1, 0, 0},
+    {0, 1, 0},
+    {0, -1, 0},
+    {0, 0, 1},
+    {0, 0, -1},
+})};
+
+// Corners of unit faces where the face texture coordinates are (0, 0). See block_face.glsl.
+constexpr auto FaceOrigins{std::to_array<glm::ivec3>({
+    {1, 0, 1},
+    {0, 0, 0},
+    {0, 1, 1},
+    {0, 0, 0},
+    {0, 0, 1},
+    {1, 0, 0},
+})};
+
+// Axes of the face tangents and bitangents. See block_face.glsl.
+constexpr auto FaceTangentAxes{std::to_array<int>({2, 2, 0, 0, 0, 0})};
+constexpr auto FaceBitangentAxes{std::to_array<int>({1, 1, 2, 2, 1, 1})};
+
+// Faces of each direction are generated slice by slice. Within a slice, visible faces are stored as
+// rows of bitmasks. These are the axes of the slices, rows, and bits.
+constexpr auto FaceSliceAxes{std::to_array<int>({0, 0, 1, 1, 2, 2})};
+constexpr auto FaceRowAxes{std::to_array<int>({1, 1, 0, 0, 1, 1})};
+constexpr auto FaceBitAxes{std::to_array<int>({2, 2, 2, 2, 0, 0})};
+
+// The height of block faces is stored in 8 bits. The width never exceeds the chunk size.
+constexpr auto MaxFaceExtent{255};
+
+// Returns the group set of a face that belongs to the groups in groupMask.
+int getGroupSet(const GLubyte groupMask)
+{
+    const auto isInGroup{[groupMask](const BlockFaceGroup group) {
+        return (groupMask & (1 << static_cast<int>(group))) != 0;
+    }};
+    BlockFaceGroupSet groupSet;
+    if (isInGroup(BlockFaceGroup::Translucent)) {
+        groupSet = BlockFaceGroupSet::Translucent;
+    } else if (isInGroup(BlockFaceGroup::AboveWater)) {
+        groupSet = isInGroup(BlockFaceGroup::UnderWater)
+                       ? BlockFaceGroupSet::OpaqueAboveAndUnderWater
+                       : BlockFaceGroupSet::OpaqueAboveWater;
+    } else {
+        groupSet = isInGroup(BlockFaceGroup::UnderWater) ? BlockFaceGroupSet::OpaqueUnderWater
+                                                         : BlockFaceGroupSet::Opaque;
+    }
+    return static_cast<int>(groupSet);
+}
+
+static_assert(TerrainChunk::SizeX == 64 && TerrainChunk::SizeZ == 64,
+              "Block rows and their transposes must fit in 64-bit integers.");
+
+// Transposes a 64x64 bit matrix, where bit j of rows[i] is the element at (i, j), by recursively
+// swapping the off-diagonal blocks.
+void transposeBitMatrix(std::array<std::uint64_t, 64> &rows)
+{
+    auto mask{0x00000000FFFFFFFFull};
+    for (auto j{32}; j != 0; j >>= 1, mask ^= mask << j) {
+        for (auto k{0}; k < 64; k = ((k | j) + 1) & ~j) {
+            const auto t{((rows[k] >> j) ^ rows[k | j]) & mask};
+            rows[k] ^= t << j;
+            rows[k | j] ^= t;
+        }
+    }
+}
+
+} // namespace
+
+void BlockFaceMesher::generate(const int lodScale,
+                               const std::bitset<TerrainChunk::SizeY> &meshedLayers,
+                               const glm::ivec2 &originXZ,
+                               BlockFaceSlots &blockFaces,
+                               SectionPoints &minPoints,
+                               SectionPoints &maxPoints)
+{
+    _lodScale = lodScale;
+    _gridSize
+        = glm::ivec3{TerrainChunk::SizeX, TerrainChunk::SizeY, TerrainChunk::SizeZ} / lodScale;
+    _meshedLayers = meshedLayers;
+    _originXZ = originXZ;
+    _minY = 0;
+    _maxY = 0;
+    for (const auto y : std::views::iota(0, _gridSize.y)) {
+        if (isLayerMeshed(y)) {
+            if (_minY == _maxY) {
+                _minY = y;
+            }
+            _maxY = y + 1;
+        }
+    }
+    _blockFaces = &blockFaces;
+    _minPoints = &minPoints;
+    _maxPoints = &maxPoints;
+
+    generateBlockRows();
+    for (const auto faceIndex : std::views::iota(0, 6)) {
+        generateFaces(faceIndex);
+    }
+
+    _blockFaces = nullptr;
+    _minPoints = nullptr;
+    _maxPoints = nullptr;
+}
+
+void BlockFaceMesher::generateBlockRows()
+{
+    // Rows are indexed with the paddings, and the rows right next to the meshed layers are needed.
+    // Paddings along the Y axis are always air.
+    auto paddedYs{std::views::iota(_minY, _maxY + 2) | std::views::filter([this](const int y) {
+                      return y == 0 || y == _gridSize.y + 1 || isLayerCopied(y - 1);
+                  })};
+    for (const auto x : std::views::iota(0, _gridSize.x + 2)) {
+        for (const auto y : paddedYs) {
+            BlockRow row{};
+            for (const auto z : std::views::iota(0, _gridSize.z)) {
+                const auto bit{std::uint64_t{1} << z};
+                switch (_blocks[x][y][z + 1]) {
+                case BlockType::Air:
+                    row.air |= bit;
+                    break;
+                case BlockType::Water:
+                    row.water |= bit;
+                    break;
+                case BlockType::Lava:
+                    row.lava |= bit;
+                    break;
+                default:
+                    break;
+                }
+            }
+            _blockRows[x][y] = row;
+        }
+    }
+}
+
+std::uint64_t BlockFaceMesher::getVisibleFaceRow(const int faceIndex,
+                                                 const int x,
+                                                 const int y) const
+{
+    const auto &row{_blockRows[x + 1][y + 1]};
+
+    // Rows of the neighboring blocks in the face direction. Along the Z axis, the rows are shifted
+    // and the bits shifted in are filled from the paddings. Rows of LOD grids are shorter than 64
+    // bits, and the bits past their ends are masked out at the end.
+    const auto lastBit{_gridSize.z - 1};
+    const auto shiftRow{[&row, lastBit](const BlockType borderBlock, const bool isPositive) {
+        const auto shift{[isPositive, lastBit](const std::uint64_t bits, const bool borderBit) {
+            return isPositive ? (bits >> 1) | (std::uint64_t{borderBit} << lastBit)
+                              : (bits << 1) | std::uint64_t{borderBit};
+        }};
+        return BlockRow{
+            .air = shift(row.air, borderBlock == BlockType::Air),
+            .water = shift(row.water, borderBlock == BlockType::Water),
+            .lava = shift(row.lava, borderBlock == BlockType::Lava),
+        };
+    }};
+    BlockRow neighborRow{};
+    switch (Direction{faceIndex}) {
+    case Direction::PositiveX:
+        neighborRow = _blockRows[x + 2][y + 1];
+        break;
+    case Direction::NegativeX:
+        neighborRow = _blockRows[x][y + 1];
+        break;
+    case Direction::PositiveY:
+        neighborRow = _blockRows[x + 1][y + 2];
+        break;
+    case Direction::NegativeY:
+        neighborRow = _blockRows[x + 1][y];
+        break;
+    case Direction::PositiveZ:
+        neighborRow = shiftRow(_blocks[x + 1][y + 1][_gridSize.z + 1], true);
+        break;
+    case Direction::NegativeZ:
+        neighborRow = shiftRow(_blocks[x + 1][y + 1].front(), false);
+        break;
+    }
+
+    // - Solid blocks are visible through air, water, and lava.
+    // - Lava is visible through air and water.
+    // - Water is visible through air, but only its positive Y face is rendered because the water
+    //   wave algorithm in the shader only works for that face.
+    const auto solid{~(row.air | row.water | row.lava)};
+    auto visible{(solid & (neighborRow.air | neighborRow.water | neighborRow.lava))
+                 | (row.lava & (neighborRow.air | neighborRow.water))};
+    if (Direction{faceIndex} == Direction::PositiveY) {
+        visible |= row.water & neighborRow.air;
+    }
+    return _gridSize.z == 64 ? visible : visible & ((std::uint64_t{1} << _gridSize.z) - 1);
+}
+
+BlockFaceMesher::FaceKey BlockFaceMesher::getFaceKey(const glm::ivec3 &position,
+                                                     const int faceIndex) const
+{
+    // The face is known to be visible.
+    const auto &blocks{_blocks};
+    const auto block{blocks[position.x + 1][position.y + 1][position.z + 1]};
+    const auto neighborPosition{position + FaceDirections[faceIndex]};
+    const auto neighborBlock{
+        blocks[neighborPosition.x + 1][neighborPosition.y + 1][neighborPosition.z + 1]};
+
+    GLubyte groupMask{0};
+    const auto addToGroup{[&groupMask](const BlockFaceGroup group) {
+        groupMask |= static_cast<GLubyte>(1 << static_cast<int>(group));
+    }};
+    // A cell of the LOD grid spans several block heights.
+    const auto minY{position.y * _lodScale};
+    const auto maxY{minY + _lodScale - 1};
+    if (block == BlockType::Water) {
+        addToGroup(BlockFaceGroup::Translucent);
+    } else {
+        addToGroup(BlockFaceGroup::Opaque);
+        if (minY < WaterLevel && neighborBlock == BlockType::Water) {
+            addToGroup(BlockFaceGroup::UnderWater);
+        }
+        if (maxY >= WaterLevel - 1) {
+            addToGroup(BlockFaceGroup::AboveWater);
+        }
+    }
+
+    glm::ivec2 textureRowColumn;
+    switch (block) {
+    case BlockType::Dirt:
+        textureRowColumn = {0, 2};
+        break;
+    case BlockType::Bedrock:
+        textureRowColumn = {1, 1};
+        break;
+    case BlockType::Grass:
+        if (Direction{faceIndex} == Direction::PositiveY) {
+            textureRowColumn = {2, 8};
+        } else if (Direction{faceIndex} == Direction::NegativeY) {
+            textureRowColumn = {0, 2};
+        } else {
+            textureRowColumn = {0, 3};
+        }
+        break;
+    case BlockType::Lava:
+        textureRowColumn = {14, 13};
+        break;
+    case BlockType::Snow:
+        textureRowColumn = {4, 2};
+        break;
+    case BlockType::Stone:
+        textureRowColumn = {0, 1};
+        break;
+    case BlockType::Water:
+        textureRowColumn = {12, 13};
+        break;
+    default:
+        textureRowColumn = {10, 8};
+    }
+
+    const auto faceOriginY{(position.y + FaceOrigins[faceIndex].y) * _lodScale};
+    return {
+        .textureIndex = static_cast<GLubyte>(textureRowColumn[0] * 16 + textureRowColumn[1]),
+        .blockType = static_cast<std::underlying_type_t<BlockType>>(block),
+        .mediumType = static_cast<std::underlying_type_t<BlockType>>(neighborBlock),
+        .groupMask = groupMask,
+        // - Water surfaces are displaced per vertex by the wave algorithm, so they must keep their
+        //   full tessellation.
+        // - Faces starting near the water level need the precise water level per vertex (see
+        //   geometry.vert.glsl), which cannot be interpolated across a large face.
+        .isMergeable = block != BlockType::Water
+                       && (faceOriginY < WaterLevel - 1 || faceOriginY > WaterLevel),
+    };
+}
+
+void BlockFaceMesher::generateFaces(const int faceIndex)
+{
+    const auto sliceAxis{FaceSliceAxes[faceIndex]};
+    const auto rowAxis{FaceRowAxes[faceIndex]};
+    const auto bitAxis{FaceBitAxes[faceIndex]};
+    const auto sliceCount{_gridSize[sliceAxis]};
+    const auto rowCount{_gridSize[rowAxis]};
+    const auto sectionSizeY{TerrainChunk::SectionSizeY / _lodScale};
+
+    // Find visible faces 64 at a time, and arrange them as [slice][row] bitmasks.
+    const auto visibleRowAt{[this, rowCount](const int slice, const int row) -> std::uint64_t & {
+        return _visibleFaceRows[static_cast<std::size_t>(slice * rowCount + row)];
+    }};
+    // Faces outside the sections are left empty.
+    std::ranges::fill(_visibleFaceRows, std::uint64_t{0});
+    auto sectionYs{std::views::iota(_minY, _maxY)
+                   | std::views::filter([this](const int y) { return isLayerMeshed(y); })};
+    switch (Direction{faceIndex}) {
+    case Direction::PositiveX:
+    case Direction::NegativeX:
+        for (const auto x : std::views::iota(0, _gridSize.x)) {
+            for (const auto y : sectionYs) {
+                visibleRowAt(x, y) = getVisibleFaceRow(faceIndex, x, y);
+            }
+        }
+        break;
+    case Direction::PositiveY:
+    case Direction::NegativeY:
+        for (const auto x : std::views::iota(0, _gridSize.x)) {
+            for (const auto y : sectionYs) {
+                visibleRowAt(y, x) = getVisibleFaceRow(faceIndex, x, y);
+            }
+        }
+        break;
+    case Direction::PositiveZ:
+    case Direction::NegativeZ:
+        // Rows are along the Z axis, so each XZ layer is transposed to get rows along the X axis.
+        // Rows past the end of a LOD grid are empty.
+        for (const auto y : sectionYs) {
+            std::array<std::uint64_t, 64> rows{};
+            for (const auto x : std::views::iota(0, _gridSize.x)) {
+                rows[x] = getVisibleFaceRow(faceIndex, x, y);
+            }
+            transposeBitMatrix(rows);
+            for (const auto z : std::views::iota(0, _gridSize.z)) {
+                visibleRowAt(z, y) = rows[z];
+            }
+        }
+        break;
+    }
+
+    // Merge faces greedily within each slice, first along the bits, and then along the rows as long
+    // as the same run is visible with the same attributes. Only set bits are enumerated. Faces are
+    // not merged across sections.
+    for (const auto slice : std::views::iota(0, sliceCount)) {
+        if (sliceAxis == 1 && !isLayerMeshed(slice)) {
+            continue;
+        }
+        glm::ivec3 position{0};
+        position[sliceAxis] = slice;
+        const auto positionAt{[&position, rowAxis, bitAxis](const int row, const int bit) {
+            position[rowAxis] = row;
+            position[bitAxis] = bit;
+            return position;
+        }};
+
+        for (const auto row : std::views::iota(0, rowCount)) {
+            const auto rowEnd{rowAxis == 1 ? (row / sectionSizeY + 1) * sectionSizeY : rowCount};
+            auto &bits{visibleRowAt(slice, row)};
+            while (bits != 0) {
+                const auto bit{std::countr_zero(bits)};
+                const auto key{getFaceKey(positionAt(row, bit), faceIndex)};
+
+                auto runLength{1};
+                auto runRowCount{1};
+                if (key.isMergeable) {
+                    const auto maxRunLength{std::countr_one(bits >> bit)};
+                    while (runLength < maxRunLength
+                           && getFaceKey(positionAt(row, bit + runLength), faceIndex) == key) {
+                        ++runLength;
+                    }
+                }
+                const auto runMask{(runLength == 64 ? ~std::uint64_t{0}
+                                                    : (std::uint64_t{1} << runLength) - 1)
+                                   << bit};
+                if (key.isMergeable) {
+                    while (row + runRowCount < rowEnd
+                           && runRowCount < MaxFaceExtent / _lodScale) {
+                        const auto nextRow{row + runRowCount};
+                        const auto isRunMatched{
+                            (visibleRowAt(slice, nextRow) & runMask) == runMask
+                            && std::ranges::all_of(std::views::iota(bit, bit + runLength),
+                                                   [&](const int i) {
+                                                       return getFaceKey(positionAt(nextRow, i),
+                                                                         faceIndex)
+                                                              == key;
+                                                   })};
+                        if (!isRunMatched) {
+                            break;
+                        }
+                        ++runRowCount;
+                    }
+                }
+                for (const auto i : std::views::iota(row, row + runRowCount)) {
+                    visibleRowAt(slice, i) &= ~runMask;
+                }
+
+                glm::ivec3 extent{1};
+                extent[rowAxis] = runRowCount;
+                extent[bitAxis] = runLength;
+                addBlockFace(key, faceIndex, positionAt(row, bit), extent);
+            }
+        }
+    }
+}
+
+void BlockFaceMesher::addBlockFace(const FaceKey &key,
+                                   const int faceIndex,
+                                   const glm::ivec3 &position,
+                                   const glm::ivec3 &extent)
+{
+    // Faces of LOD grids are scaled to blocks. Along the face normal, faces are one block thick,
+    // and faces pointing to the positive direction are in the last block of their cells.
+    const auto normalAxis{FaceSliceAxes[faceIndex]};
+    auto blockPosition{position * _lodScale};
+    auto blockExtent{extent * _lodScale};
+    blockExtent[normalAxis] = 1;
+    if (faceIndex % 2 == 0) {
+        blockPosition[normalAxis] += _lodScale - 1;
+    }
+    // Water surfaces of LOD grids are moved to the water level, so that they line up with the
+    // reflections and with the water of full-resolution chunks.
+    if (_lodScale > 1 && key.blockType == static_cast<GLubyte>(BlockType::Water)
+        && Direction{faceIndex} == Direction::PositiveY
+        && std::abs(blockPosition.y + 1 - WaterLevel) < _lodScale) {
+        blockPosition.y = WaterLevel - 1;
+    }
+
+    // Use integer coordinates to avoid floating-point rounding errors, e.g.,
+    // float(i) + 1.0f != float(i + 1).
+    const glm::ivec3 minPoint{
+        _originXZ[0] + blockPosition.x,
+        blockPosition.y,
+        _originXZ[1] + blockPosition.z,
+    };
+    const auto maxPoint{minPoint + blockExtent};
+
+    const auto blockFace{BlockFace::pack(blockPosition,
+                                         faceIndex,
+                                         blockExtent[FaceTangentAxes[faceIndex]],
+                                         blockExtent[FaceBitangentAxes[faceIndex]],
+                                         key.textureIndex,
+                                         key.blockType,
+                                         key.mediumType)};
+    // Merged faces never cross sections, so the section is determined by the minimum cell.
+    const auto section{position.y * _lodScale / TerrainChunk::SectionSizeY};
+    (*_blockFaces)[TerrainChunk::getBlockFaceSlot(faceIndex, getGroupSet(key.groupMask), section)]
+        .push_back(blockFace);
+    for (const auto i : std::views::iota(0, 4)) {
+        if ((key.groupMask & (1 << i)) == 0) {
+            continue;
+        }
+        (*_minPoints)[i][section] = glm::min((*_minPoints)[i][section], minPoint);
+        (*_maxPoints)[i][section] = glm::max((*_maxPoints)[i][section], maxPoint);
+    }
+}
+
+} // namespace minecraft
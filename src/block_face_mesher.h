@@ -0,0 +1,117 @@
+#ifndef MINECRAFT_BLOCK_FACE_MESHER_H
+#define MINECRAFT_BLOCK_FACE_MESHER_H
+
+#include "block_face_renderer.h"
+#include "block_type.h"
+#include "terrain_chunk.h"
+#include "vertex_attribute.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+
+namespace minecraft {
+
+// Generates the block faces of a chunk from a copy of its blocks in the LOD grid, padded with the
+// borders of its neighbors. It holds no reference to the chunk, so it can run on any thread. The
+// working memory is too large to allocate per task, so meshers are pooled and reused, and their
+// contents are stale until overwritten.
+class BlockFaceMesher
+{
+public:
+    // Blocks of the LOD grid at [x + 1][y + 1][z + 1], with paddings of 1 block on each side
+    using PaddedBlockArray = std::array<
+        std::array<std::array<BlockType, TerrainChunk::SizeZ + 2>, TerrainChunk::SizeY + 2>,
+        TerrainChunk::SizeX + 2>;
+    // Indexed by [group][section]
+    using SectionPoints = std::array<std::array<glm::ivec3, TerrainChunk::SectionCount>, 4>;
+
+    BlockFaceMesher() = default;
+
+    BlockFaceMesher(const BlockFaceMesher &) = delete;
+    BlockFaceMesher(BlockFaceMesher &&) = delete;
+
+    BlockFaceMesher &operator=(const BlockFaceMesher &) = delete;
+    BlockFaceMesher &operator=(BlockFaceMesher &&) = delete;
+
+    PaddedBlockArray &blocks() { return _blocks; }
+
+    const PaddedBlockArray &blocks() const { return _blocks; }
+
+    // Appends the block faces of the meshed layers to blockFaces, which is indexed by
+    // TerrainChunk::getBlockFaceSlot(), and grows the bounding boxes of their sections. The blocks
+    // and X/Z paddings of the meshed layers and the layers right next to them must be copied, and
+    // the Y paddings must be air. Nothing is allocated if blockFaces has enough capacity.
+    void generate(const int lodScale,
+                  const std::bitset<TerrainChunk::SizeY> &meshedLayers,
+                  const glm::ivec2 &originXZ,
+                  BlockFaceSlots &blockFaces,
+                  SectionPoints &minPoints,
+                  SectionPoints &maxPoints);
+
+private:
+    // Bitmasks of blocks in a row along the Z axis. Bit z corresponds to the block at z.
+    struct BlockRow
+    {
+        std::uint64_t air;
+        std::uint64_t water;
+        std::uint64_t lava;
+    };
+
+    // Attributes shared by all unit faces merged into one BlockFace.
+    struct FaceKey
+    {
+        GLubyte textureIndex;
+        GLubyte blockType;
+        GLubyte mediumType;
+        // Bit i is set if the face belongs to BlockFaceGroup i.
+        GLubyte groupMask;
+        bool isMergeable;
+
+        bool operator==(const FaceKey &) const = default;
+    };
+
+    bool isLayerMeshed(const int y) const
+    {
+        return y >= 0 && y < TerrainChunk::SizeY && _meshedLayers.test(static_cast<std::size_t>(y));
+    }
+
+    // Blocks right next to the meshed layers are needed as neighbors.
+    bool isLayerCopied(const int y) const
+    {
+        return isLayerMeshed(y - 1) || isLayerMeshed(y) || isLayerMeshed(y + 1);
+    }
+
+    void generateBlockRows();
+    std::uint64_t getVisibleFaceRow(const int faceIndex, const int x, const int y) const;
+    FaceKey getFaceKey(const glm::ivec3 &position, const int faceIndex) const;
+    void generateFaces(const int faceIndex);
+    void addBlockFace(const FaceKey &key,
+                      const int faceIndex,
+                      const glm::ivec3 &position,
+                      const glm::ivec3 &extent);
+
+    PaddedBlockArray _blocks{};
+    std::array<std::array<BlockRow, TerrainChunk::SizeY + 2>, TerrainChunk::SizeX + 2> _blockRows{};
+    // Visible faces of a direction as [slice][row] bitmasks
+    std::array<std::uint64_t, TerrainChunk::SizeX * TerrainChunk::SizeY> _visibleFaceRows{};
+
+    // Arguments of the current call to generate()
+    int _lodScale{1};
+    // Size of the LOD grid. Coordinates of blocks, rows, and layers are all in this grid.
+    glm::ivec3 _gridSize{TerrainChunk::SizeX, TerrainChunk::SizeY, TerrainChunk::SizeZ};
+    std::bitset<TerrainChunk::SizeY> _meshedLayers{};
+    glm::ivec2 _originXZ{0};
+    // Range of Y coordinates covering all the meshed layers
+    int _minY{0};
+    int _maxY{0};
+    BlockFaceSlots *_blockFaces{nullptr};
+    SectionPoints *_minPoints{nullptr};
+    SectionPoints *_maxPoints{nullptr};
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_BLOCK_FACE_MESHER_H
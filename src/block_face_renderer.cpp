@@ -0,0 +1,274 @@
+#include "block_face_renderer.h"
+
+#include "block_face_arena.h"
+#include "block_face_uploader.h"
+#include "instanced_renderer.h"
+#include "performance_counters.h"
+
+#include <algorithm>
+#include <ranges>
+#include <utility>
+
+namespace minecraft {
+
+namespace {
+
+GLsizei getSlotCapacity(const GLsizei instanceCount)
+{
+    // Leave some room so that small edits do not change the buffer layout. Empty slots get no room
+    // because most of them stay empty, and the spare instances are still processed when drawn.
+    return instanceCount == 0 ? 0 : instanceCount + instanceCount / 4 + 16;
+}
+
+bool isSlotUpdated(const int slot, const int sectionCount, const std::uint32_t sectionMask)
+{
+    return ((sectionMask >> (slot % sectionCount)) & 1u) != 0;
+}
+
+} // namespace
+
+bool StagedBlockFaces::isReady() const
+{
+    if (_fence == nullptr) {
+        return true;
+    }
+    // The uploader flushes the fence, so it is not flushed again here, which would only apply to
+    // the render context.
+    const auto context{OpenGLContext::instance()};
+    const auto result{context->glClientWaitSync(_fence, 0, 0)};
+    context->checkError();
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+void StagedBlockFaces::releaseResources()
+{
+    if (_fence != nullptr) {
+        const auto context{OpenGLContext::instance()};
+        context->glDeleteSync(_fence);
+        context->checkError();
+        _fence = nullptr;
+    }
+    if (_buffer) {
+        BlockFaceUploader::instance().recycleBuffer(std::move(_buffer), _byteCount);
+    }
+}
+
+std::int64_t BlockFaceRenderer::upload(const BlockFaceSlots &slotBlockFaces,
+                                       const int sectionCount,
+                                       const std::uint32_t sectionMask)
+{
+    const auto slotCount{static_cast<int>(slotBlockFaces.size())};
+    std::vector<GLsizei> instanceCounts(static_cast<std::size_t>(slotCount));
+    for (const auto i : std::views::iota(0, slotCount)) {
+        instanceCounts[i] = static_cast<GLsizei>(slotBlockFaces[i].size());
+    }
+
+    auto &arena{BlockFaceArena::instance()};
+    auto &counters{PerformanceCounters::instance()};
+    if (!needsLayout(instanceCounts, sectionCount, sectionMask)) {
+        // Overwrite the updated slots in place. Faces beyond the new instance count are cleared.
+        std::vector<BlockFace> instances;
+        std::int64_t uploadedInstanceCount{0};
+        for (const auto i : std::views::iota(0, slotCount)) {
+            if (!isSlotUpdated(i, sectionCount, sectionMask)) {
+                continue;
+            }
+            auto &slot{_slots[i]};
+            const auto &blockFaces{slotBlockFaces[i]};
+            instances.assign(blockFaces.begin(), blockFaces.end());
+            instances.resize(static_cast<std::size_t>(
+                                 std::max(slot.instanceCount, instanceCounts[i])),
+                             BlockFace{});
+            arena.updateInstances(_allocation, slot.first, instances);
+            slot.instanceCount = instanceCounts[i];
+            uploadedInstanceCount += std::ssize(instances);
+        }
+        updateTotalInstanceCount();
+        counters.uploadedInstanceCount += uploadedInstanceCount;
+        return uploadedInstanceCount;
+    }
+
+    // The updated slots are uploaded from the CPU, and the others are copied from the previous
+    // allocation on the GPU.
+    const auto [previousAllocation, copies]{layOut(instanceCounts, sectionCount, sectionMask)};
+    std::vector<BlockFace> instances;
+    if (!_slots.empty()) {
+        instances.resize(static_cast<std::size_t>(_slots.back().first + _slots.back().capacity),
+                         BlockFace{});
+    }
+    for (const auto i : std::views::iota(0, slotCount)) {
+        if (isSlotUpdated(i, sectionCount, sectionMask)) {
+            std::ranges::copy(slotBlockFaces[i], instances.begin() + _slots[i].first);
+        }
+    }
+    if (_allocation >= 0) {
+        arena.updateInstances(_allocation, 0, instances);
+        if (previousAllocation >= 0) {
+            arena.copyInstances(previousAllocation, _allocation, copies);
+        }
+    }
+    if (previousAllocation >= 0) {
+        arena.free(previousAllocation);
+    }
+    updateTotalInstanceCount();
+    counters.uploadedInstanceCount += std::ssize(instances);
+    return std::ssize(instances);
+}
+
+std::int64_t BlockFaceRenderer::upload(const StagedBlockFaces &stagedBlockFaces,
+                                       const int sectionCount,
+                                       const std::uint32_t sectionMask)
+{
+    const auto &slotFirsts{stagedBlockFaces.slotFirsts()};
+    const auto slotCount{static_cast<int>(slotFirsts.size()) - 1};
+    std::vector<GLsizei> instanceCounts(static_cast<std::size_t>(slotCount));
+    for (const auto i : std::views::iota(0, slotCount)) {
+        instanceCounts[i] = slotFirsts[i + 1] - slotFirsts[i];
+    }
+
+    auto &arena{BlockFaceArena::instance()};
+    std::vector<InstanceRangeCopy> stagedCopies;
+    std::vector<std::pair<GLsizei, GLsizei>> clearedRanges;
+    std::int64_t uploadedInstanceCount{0};
+    if (!needsLayout(instanceCounts, sectionCount, sectionMask)) {
+        // Overwrite the updated slots in place. Faces beyond the new instance count are cleared.
+        for (const auto i : std::views::iota(0, slotCount)) {
+            if (!isSlotUpdated(i, sectionCount, sectionMask)) {
+                continue;
+            }
+            auto &slot{_slots[i]};
+            if (instanceCounts[i] > 0) {
+                stagedCopies.push_back({
+                    .sourceFirst = slotFirsts[i],
+                    .destinationFirst = slot.first,
+                    .count = instanceCounts[i],
+                });
+            }
+            clearedRanges.emplace_back(slot.first + instanceCounts[i],
+                                       slot.instanceCount - instanceCounts[i]);
+            uploadedInstanceCount += std::max(slot.instanceCount, instanceCounts[i]);
+            slot.instanceCount = instanceCounts[i];
+        }
+        arena.copyInstancesFromBuffer(stagedBlockFaces.buffer(), _allocation, stagedCopies);
+        arena.clearInstances(_allocation, clearedRanges);
+    } else {
+        // The updated slots are copied from the staging buffer, the others from the previous
+        // allocation, and the spare instances of all slots are cleared.
+        const auto [previousAllocation, copies]{layOut(instanceCounts, sectionCount, sectionMask)};
+        for (const auto i : std::views::iota(0, slotCount)) {
+            const auto &slot{_slots[i]};
+            if (isSlotUpdated(i, sectionCount, sectionMask) && slot.instanceCount > 0) {
+                stagedCopies.push_back({
+                    .sourceFirst = slotFirsts[i],
+                    .destinationFirst = slot.first,
+                    .count = slot.instanceCount,
+                });
+            }
+            clearedRanges.emplace_back(slot.first + slot.instanceCount,
+                                       slot.capacity - slot.instanceCount);
+            uploadedInstanceCount += slot.capacity;
+        }
+        if (_allocation >= 0) {
+            arena.copyInstancesFromBuffer(stagedBlockFaces.buffer(), _allocation, stagedCopies);
+            arena.clearInstances(_allocation, clearedRanges);
+            if (previousAllocation >= 0) {
+                arena.copyInstances(previousAllocation, _allocation, copies);
+            }
+        }
+        if (previousAllocation >= 0) {
+            arena.free(previousAllocation);
+        }
+    }
+    updateTotalInstanceCount();
+    PerformanceCounters::instance().uploadedInstanceCount += uploadedInstanceCount;
+    return uploadedInstanceCount;
+}
+
+bool BlockFaceRenderer::needsLayout(const std::vector<GLsizei> &instanceCounts,
+                                    const int sectionCount,
+                                    const std::uint32_t sectionMask)
+{
+    const auto slotCount{static_cast<int>(instanceCounts.size())};
+    if (std::ssize(_slots) != slotCount) {
+        // Nothing is uploaded yet, or the resources have been released.
+        releaseResources();
+        _slots.assign(instanceCounts.size(), Slot{});
+    }
+    // The buffer layout changes if an updated slot no longer fits into its range.
+    return _allocation < 0
+           || std::ranges::any_of(std::views::iota(0, slotCount), [&](const int i) {
+                  return isSlotUpdated(i, sectionCount, sectionMask)
+                         && instanceCounts[i] > _slots[i].capacity;
+              });
+}
+
+std::pair<int, std::vector<InstanceRangeCopy>> BlockFaceRenderer::layOut(
+    const std::vector<GLsizei> &instanceCounts,
+    const int sectionCount,
+    const std::uint32_t sectionMask)
+{
+    std::vector<InstanceRangeCopy> copies;
+    GLsizei first{0};
+    for (const auto i : std::views::iota(0, static_cast<int>(_slots.size()))) {
+        auto &slot{_slots[i]};
+        const auto isUpdated{isSlotUpdated(i, sectionCount, sectionMask)};
+        const auto instanceCount{isUpdated ? instanceCounts[i] : slot.instanceCount};
+        const Slot newSlot{
+            .first = first,
+            .capacity = getSlotCapacity(instanceCount),
+            .instanceCount = instanceCount,
+        };
+        if (!isUpdated && instanceCount > 0) {
+            copies.push_back({
+                .sourceFirst = slot.first,
+                .destinationFirst = first,
+                .count = instanceCount,
+            });
+        }
+        slot = newSlot;
+        first += newSlot.capacity;
+    }
+    const auto previousAllocation{_allocation};
+    _allocation = first > 0 ? BlockFaceArena::instance().allocate(first) : -1;
+    return {previousAllocation, std::move(copies)};
+}
+
+void BlockFaceRenderer::updateTotalInstanceCount()
+{
+    _totalInstanceCount = 0;
+    for (const auto &slot : _slots) {
+        _totalInstanceCount += slot.instanceCount;
+    }
+}
+
+void BlockFaceRenderer::draw(const int firstSlot, const int lastSlot)
+{
+    if (_allocation < 0 || firstSlot >= lastSlot || lastSlot > std::ssize(_slots)) {
+        return;
+    }
+    // Trailing spare instances of the last slot are skipped.
+    const auto first{_slots[firstSlot].first};
+    const auto &last{_slots[lastSlot - 1]};
+    const auto instanceCount{last.first + last.instanceCount - first};
+    if (instanceCount <= 0) {
+        return;
+    }
+    auto &arena{BlockFaceArena::instance()};
+    arena.draw(arena.first(_allocation) + first, instanceCount);
+
+    auto &counters{PerformanceCounters::instance()};
+    ++counters.blockFaceDrawCount;
+    counters.drawnInstanceCount += instanceCount;
+}
+
+void BlockFaceRenderer::releaseResources()
+{
+    if (_allocation >= 0) {
+        BlockFaceArena::instance().free(_allocation);
+        _allocation = -1;
+    }
+    _slots.clear();
+    _totalInstanceCount = 0;
+}
+
+} // namespace minecraft
@@ -0,0 +1,138 @@
+#ifndef MINECRAFT_BLOCK_FACE_RENDERER_H
+#define MINECRAFT_BLOCK_FACE_RENDERER_H
+
+#include "instanced_renderer.h"
+#include "opengl_object.h"
+#include "vertex_attribute.h"
+
+#include <QOpenGLFunctions_4_1_Core>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace minecraft {
+
+// Block faces of a chunk, indexed by slot
+using BlockFaceSlots = std::vector<std::vector<BlockFace>>;
+
+// Block faces of a chunk in a staging buffer, written by BlockFaceUploader in its own context. Slot
+// i holds the faces in [slotFirsts()[i], slotFirsts()[i + 1]) of the buffer. The buffer may only be
+// read by the render thread once the fence is signaled. The render thread deletes the fence and
+// gives the buffer back to the uploader.
+class StagedBlockFaces
+{
+public:
+    StagedBlockFaces(OpenGLObject buffer,
+                     const GLsizeiptr byteCount,
+                     const GLsync fence,
+                     std::vector<GLsizei> slotFirsts)
+        : _buffer{std::move(buffer)}
+        , _byteCount{byteCount}
+        , _fence{fence}
+        , _slotFirsts{std::move(slotFirsts)}
+    {}
+
+    StagedBlockFaces(const StagedBlockFaces &) = delete;
+    StagedBlockFaces(StagedBlockFaces &&) = delete;
+
+    ~StagedBlockFaces() { releaseResources(); }
+
+    StagedBlockFaces &operator=(const StagedBlockFaces &) = delete;
+    StagedBlockFaces &operator=(StagedBlockFaces &&) = delete;
+
+    GLuint buffer() const { return _buffer.get(); }
+
+    const std::vector<GLsizei> &slotFirsts() const { return _slotFirsts; }
+
+    // Returns true if the uploader has finished writing the buffer. It does not wait.
+    bool isReady() const;
+
+    void releaseResources();
+
+private:
+    OpenGLObject _buffer;
+    // Size of the buffer, which may be larger than the faces
+    GLsizeiptr _byteCount;
+    GLsync _fence;
+    std::vector<GLsizei> _slotFirsts;
+};
+
+// Renders the block faces of a chunk from a single allocation of BlockFaceArena. The faces are
+// divided into slots, and slot i holds faces of section i % sectionCount. Each slot occupies a
+// contiguous range of the allocation with some spare capacity, so that a section can be updated in
+// place without re-uploading the others. Unused instances are zero-filled, which gives empty faces
+// that produce no fragments.
+class BlockFaceRenderer
+{
+public:
+    BlockFaceRenderer()
+        : _allocation{-1}
+        , _slots{}
+        , _totalInstanceCount{0}
+    {}
+
+    BlockFaceRenderer(const BlockFaceRenderer &) = delete;
+    BlockFaceRenderer(BlockFaceRenderer &&) = delete;
+
+    ~BlockFaceRenderer() { releaseResources(); }
+
+    BlockFaceRenderer &operator=(const BlockFaceRenderer &) = delete;
+    BlockFaceRenderer &operator=(BlockFaceRenderer &&) = delete;
+
+    // Replaces the faces of the slots whose sections are set in sectionMask. The faces of other
+    // slots are kept. Returns the number of uploaded instances.
+    std::int64_t upload(const BlockFaceSlots &slotBlockFaces,
+                        const int sectionCount,
+                        const std::uint32_t sectionMask);
+
+    // Same as above, but copies the faces of the updated slots from a staging buffer on the GPU.
+    std::int64_t upload(const StagedBlockFaces &stagedBlockFaces,
+                        const int sectionCount,
+                        const std::uint32_t sectionMask);
+
+    // Draws the faces of the slots in [firstSlot, lastSlot). The vertex array of BlockFaceArena
+    // must be bound.
+    void draw(const int firstSlot, const int lastSlot);
+
+    GLsizei instanceCount(const int slot) const
+    {
+        return slot < std::ssize(_slots) ? _slots[slot].instanceCount : 0;
+    }
+
+    // Sum of the instance counts of all slots
+    GLsizei totalInstanceCount() const { return _totalInstanceCount; }
+
+    void releaseResources();
+
+private:
+    struct Slot
+    {
+        GLsizei first;
+        GLsizei capacity;
+        GLsizei instanceCount;
+    };
+
+    // Prepares the slots for the new instance counts of the updated slots, and returns true if some
+    // of them no longer fit into their ranges.
+    bool needsLayout(const std::vector<GLsizei> &instanceCounts,
+                     const int sectionCount,
+                     const std::uint32_t sectionMask);
+    // Lays out all slots again in a new allocation, and returns the previous allocation along with
+    // the copies that keep the faces of the slots that are not updated.
+    std::pair<int, std::vector<InstanceRangeCopy>> layOut(
+        const std::vector<GLsizei> &instanceCounts,
+        const int sectionCount,
+        const std::uint32_t sectionMask);
+    void updateTotalInstanceCount();
+
+    // ID of the allocation in BlockFaceArena, or -1 if there are no instances
+    int _allocation;
+    // Instances of the slots are relative to the allocation.
+    std::vector<Slot> _slots;
+    GLsizei _totalInstanceCount;
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_BLOCK_FACE_RENDERER_H
@@ -0,0 +1,261 @@
+#include "block_face_uploader.h"
+
+#include "block_face_generation_task.h"
+#include "performance_counters.h"
+#include "terrain_chunk.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <ranges>
+#include <utility>
+#include <vector>
+
+namespace minecraft {
+
+namespace {
+
+// Staging buffers are deleted by the render thread, in the render context, unless they are given
+// back to the uploader.
+OpenGLObject toStagingBuffer(const GLuint buffer)
+{
+    return OpenGLObject{
+        buffer,
+        [](OpenGLContext *const context, const GLuint buffer) {
+            context->glDeleteBuffers(1, &buffer);
+        },
+    };
+}
+
+} // namespace
+
+void BlockFaceUploader::start(QOpenGLContext *const shareContext)
+{
+    if (_thread != nullptr) {
+        return;
+    }
+
+    _context = std::make_unique<QOpenGLContext>();
+    _context->setFormat(shareContext->format());
+    _context->setShareContext(shareContext);
+    if (!_context->create() || !QOpenGLContext::areSharing(_context.get(), shareContext)) {
+        qWarning() << "Failed to create a shared OpenGL context, block faces are uploaded on the "
+                      "render thread";
+        _context.reset();
+        return;
+    }
+    _surface = std::make_unique<QOffscreenSurface>();
+    _surface->setFormat(_context->format());
+    _surface->create();
+    if (!_surface->isValid()) {
+        qWarning() << "Failed to create an offscreen surface, block faces are uploaded on the "
+                      "render thread";
+        _surface.reset();
+        _context.reset();
+        return;
+    }
+
+    _isStopping = false;
+    _thread.reset(QThread::create([this] { run(); }));
+    _context->moveToThread(_thread.get());
+    _isRunning = true;
+    _thread->start();
+}
+
+void BlockFaceUploader::stop()
+{
+    if (_thread == nullptr) {
+        return;
+    }
+    {
+        // Chunks left in the queue keep their block faces on the CPU.
+        const std::lock_guard lock{_mutex};
+        _isStopping = true;
+        _chunks.clear();
+    }
+    _condition.notify_one();
+    _thread->wait();
+    _thread.reset();
+    _surface.reset();
+    _isRunning = false;
+}
+
+void BlockFaceUploader::stage(TerrainChunk *const chunk)
+{
+    {
+        const std::lock_guard lock{_mutex};
+        _chunks.push_back(chunk);
+    }
+    _condition.notify_one();
+}
+
+void BlockFaceUploader::recycleBuffer(OpenGLObject buffer, const GLsizeiptr byteCount)
+{
+    const std::lock_guard lock{_mutex};
+    // Buffers that are not kept are deleted when the function returns.
+    if (!_isRunning || _isStopping || _freeByteCount + byteCount > MaxFreeBufferByteCount) {
+        return;
+    }
+    // The fence follows the copies from the buffer. It is flushed with the rest of the frame.
+    const auto context{OpenGLContext::instance()};
+    const auto fence{context->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+    context->checkError();
+    _freeBuffers.push_back({
+        .buffer = buffer.release(),
+        .byteCount = byteCount,
+        .fence = fence,
+    });
+    _freeByteCount += byteCount;
+}
+
+void BlockFaceUploader::run()
+{
+    if (!_context->makeCurrent(_surface.get())) {
+        qWarning() << "Failed to make the upload context current, block faces are uploaded on the "
+                      "render thread";
+        _isRunning = false;
+        _context.reset();
+        return;
+    }
+    _functions.initializeOpenGLFunctions();
+
+    while (true) {
+        TerrainChunk *chunk;
+        {
+            std::unique_lock lock{_mutex};
+            _condition.wait(lock, [this] { return _isStopping || !_chunks.empty(); });
+            if (_isStopping) {
+                break;
+            }
+            chunk = _chunks.front();
+            _chunks.pop_front();
+        }
+        stageChunk(chunk);
+    }
+
+    deleteFreeBuffers();
+    _context->doneCurrent();
+    _context.reset();
+}
+
+void BlockFaceUploader::stageChunk(TerrainChunk *const chunk)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const BlockFaceSlots *blockFaces;
+    {
+        const std::lock_guard lock{chunk->_blockFaceMutex};
+        if (chunk->_state != TerrainChunkState::Meshed) {
+            return;
+        }
+        blockFaces = chunk->_blockFaces.get();
+    }
+    // While the uploader runs, it is the only consumer of meshed block faces, and no task generates
+    // new ones until they are uploaded, so they are read without the lock.
+    std::vector<GLsizei> slotFirsts;
+    slotFirsts.reserve(blockFaces->size() + 1);
+    GLsizei instanceCount{0};
+    for (const auto &slotBlockFaces : *blockFaces) {
+        slotFirsts.push_back(instanceCount);
+        instanceCount += static_cast<GLsizei>(slotBlockFaces.size());
+    }
+    slotFirsts.push_back(instanceCount);
+
+    auto [stagingBuffer, bufferByteCount]{
+        acquireBuffer(static_cast<GLsizeiptr>(instanceCount * sizeof(BlockFace)))};
+    _functions.glBindBuffer(GL_COPY_WRITE_BUFFER, stagingBuffer.get());
+    _functions.checkError();
+    for (const auto slot : std::views::iota(0, static_cast<int>(blockFaces->size()))) {
+        const auto &slotBlockFaces{(*blockFaces)[slot]};
+        if (slotBlockFaces.empty()) {
+            continue;
+        }
+        _functions.glBufferSubData(GL_COPY_WRITE_BUFFER,
+                                   static_cast<GLintptr>(slotFirsts[slot] * sizeof(BlockFace)),
+                                   static_cast<GLsizeiptr>(slotBlockFaces.size()
+                                                           * sizeof(BlockFace)),
+                                   slotBlockFaces.data());
+        _functions.checkError();
+    }
+    _functions.glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+    _functions.checkError();
+    // The fence must be flushed, so that it is signaled without waiting for this context.
+    const auto fence{_functions.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+    _functions.checkError();
+    _functions.glFlush();
+    _functions.checkError();
+    auto stagedBlockFaces{std::make_unique<StagedBlockFaces>(std::move(stagingBuffer),
+                                                             bufferByteCount,
+                                                             fence,
+                                                             std::move(slotFirsts))};
+
+    {
+        const std::lock_guard lock{chunk->_blockFaceMutex};
+        chunk->_stagedBlockFaces = std::move(stagedBlockFaces);
+        chunk->_state = TerrainChunkState::Staged;
+        BlockFaceGenerationTask::recycleBlockFaces(std::move(chunk->_blockFaces));
+    }
+
+    auto &counters{PerformanceCounters::instance()};
+    ++counters.stagedChunkCount;
+    counters.stagedBytes += static_cast<std::int64_t>(instanceCount * sizeof(BlockFace));
+    counters.stagingNanoseconds += timer.nsecsElapsed();
+}
+
+std::pair<OpenGLObject, GLsizeiptr> BlockFaceUploader::acquireBuffer(const GLsizeiptr byteCount)
+{
+    {
+        const std::lock_guard lock{_mutex};
+        // Take the smallest free buffer that fits, among those that the render thread is done with.
+        auto bestIt{_freeBuffers.end()};
+        for (auto it{_freeBuffers.begin()}; it != _freeBuffers.end(); ++it) {
+            if (it->byteCount < byteCount
+                || (bestIt != _freeBuffers.end() && it->byteCount >= bestIt->byteCount)) {
+                continue;
+            }
+            const auto result{_functions.glClientWaitSync(it->fence, 0, 0)};
+            _functions.checkError();
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+                bestIt = it;
+            }
+        }
+        if (bestIt != _freeBuffers.end()) {
+            const auto [buffer, bufferByteCount, fence]{*bestIt};
+            _freeBuffers.erase(bestIt);
+            _freeByteCount -= bufferByteCount;
+            _functions.glDeleteSync(fence);
+            _functions.checkError();
+            ++PerformanceCounters::instance().recycledStagingBufferCount;
+            return {toStagingBuffer(buffer), bufferByteCount};
+        }
+    }
+
+    auto bufferByteCount{MinBufferByteCount};
+    while (bufferByteCount < byteCount) {
+        bufferByteCount *= 2;
+    }
+    GLuint buffer{0u};
+    _functions.glGenBuffers(1, &buffer);
+    _functions.checkError();
+    _functions.glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    _functions.checkError();
+    _functions.glBufferData(GL_COPY_WRITE_BUFFER, bufferByteCount, nullptr, GL_STREAM_DRAW);
+    _functions.checkError();
+    return {toStagingBuffer(buffer), bufferByteCount};
+}
+
+void BlockFaceUploader::deleteFreeBuffers()
+{
+    const std::lock_guard lock{_mutex};
+    for (const auto &freeBuffer : _freeBuffers) {
+        _functions.glDeleteSync(freeBuffer.fence);
+        _functions.checkError();
+        _functions.glDeleteBuffers(1, &freeBuffer.buffer);
+        _functions.checkError();
+    }
+    _freeBuffers.clear();
+    _freeByteCount = 0;
+}
+
+} // namespace minecraft
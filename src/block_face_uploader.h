@@ -0,0 +1,109 @@
+#ifndef MINECRAFT_BLOCK_FACE_UPLOADER_H
+#define MINECRAFT_BLOCK_FACE_UPLOADER_H
+
+#include "opengl_context.h"
+#include "opengl_object.h"
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QThread>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace minecraft {
+
+class TerrainChunk;
+
+// Uploads the block faces generated by worker threads to staging buffers on a thread of its own,
+// through an OpenGL context shared with the render context. Each staging buffer is followed by a
+// fence, and the render thread only copies the buffer into BlockFaceArena on the GPU once the fence
+// is signaled, so that the CPU cost of uploads is taken off the frame. If no shared context can be
+// created, the uploader does not run, and the render thread uploads the block faces itself.
+//
+// Copied staging buffers are given back by the render thread with a fence after its copies, and
+// reused for later chunks once that fence is signaled, so that buffers are not created and
+// destroyed for every chunk.
+class BlockFaceUploader
+{
+public:
+    // Free staging buffers are kept up to this many bytes, which is the byte budget of block face
+    // uploads per frame, so that the buffers copied in a frame are enough for the next ones.
+    static constexpr GLsizeiptr MaxFreeBufferByteCount{GLsizeiptr{4} << 20};
+    // Staging buffers are created with power of two sizes of at least this many bytes, so that they
+    // fit chunks of similar sizes.
+    static constexpr GLsizeiptr MinBufferByteCount{GLsizeiptr{64} << 10};
+
+    static BlockFaceUploader &instance()
+    {
+        static BlockFaceUploader uploader;
+        return uploader;
+    }
+
+    BlockFaceUploader(const BlockFaceUploader &) = delete;
+    BlockFaceUploader(BlockFaceUploader &&) = delete;
+
+    BlockFaceUploader &operator=(const BlockFaceUploader &) = delete;
+    BlockFaceUploader &operator=(BlockFaceUploader &&) = delete;
+
+    // Starts the upload thread with a context shared with shareContext. It must be called on the
+    // GUI thread.
+    void start(QOpenGLContext *const shareContext);
+
+    // Stops the upload thread, after which the remaining chunks are uploaded by the render thread.
+    // It must be called on the GUI thread once no worker thread can stage chunks.
+    void stop();
+
+    bool isRunning() const { return _isRunning.load(); }
+
+    // Queues a chunk whose block faces have just been generated. It may be called from any thread.
+    void stage(TerrainChunk *const chunk);
+
+    // Gives back a staging buffer of byteCount bytes once the render thread has issued its copies
+    // from it. It must be called on the render thread. The buffer is deleted if it is not kept.
+    void recycleBuffer(OpenGLObject buffer, const GLsizeiptr byteCount);
+
+private:
+    // A free staging buffer, which may be written once the fence is signaled
+    struct FreeBuffer
+    {
+        GLuint buffer;
+        GLsizeiptr byteCount;
+        GLsync fence;
+    };
+
+    BlockFaceUploader() = default;
+
+    void run();
+    void stageChunk(TerrainChunk *const chunk);
+    // Returns a staging buffer of at least byteCount bytes and its size, which is either a free
+    // buffer whose fence is signaled or a new one.
+    std::pair<OpenGLObject, GLsizeiptr> acquireBuffer(const GLsizeiptr byteCount);
+    // Deletes the free buffers on the upload thread.
+    void deleteFreeBuffers();
+
+    std::unique_ptr<QOffscreenSurface> _surface;
+    // Created on the GUI thread, then moved to and destroyed on the upload thread
+    std::unique_ptr<QOpenGLContext> _context;
+    std::unique_ptr<QThread> _thread;
+    // Functions of _context, which are only called on the upload thread
+    OpenGLContext _functions;
+    std::atomic<bool> _isRunning{false};
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<TerrainChunk *> _chunks;
+    bool _isStopping{false};
+    // Ordered from the least to the most recently given back
+    std::vector<FreeBuffer> _freeBuffers;
+    GLsizeiptr _freeByteCount{0};
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_BLOCK_FACE_UPLOADER_H
@@ -0,0 +1,147 @@
+#include "block_storage.h"
+
+#include "performance_counters.h"
+
+#include <QElapsedTimer>
+
+#include <ranges>
+#include <type_traits>
+#include <utility>
+
+namespace minecraft {
+
+// The compressed format is a sequence of runs. Blocks are visited column by column, i.e., the Y
+// axis is the innermost one, because terrain columns consist of only a few horizontal layers.
+// Each run is stored as one byte of the block type followed by (length - 1) as an LEB128 varint.
+
+void BlockStorage::compress()
+{
+    if (_blocks == nullptr) {
+        return;
+    }
+
+    std::vector<std::uint8_t> data;
+    const auto appendRun{[&data](const BlockType block, const int length) {
+        data.push_back(static_cast<std::underlying_type_t<BlockType>>(block));
+        auto value{static_cast<std::uint32_t>(length - 1)};
+        while (value >= 0x80u) {
+            data.push_back(static_cast<std::uint8_t>(value | 0x80u));
+            value >>= 7;
+        }
+        data.push_back(static_cast<std::uint8_t>(value));
+    }};
+
+    const auto &blocks{_blocks->blocks};
+    auto runBlock{blocks[0][0][0]};
+    auto runLength{0};
+    for (const auto x : std::views::iota(0, SizeX)) {
+        for (const auto z : std::views::iota(0, SizeZ)) {
+            for (const auto y : std::views::iota(0, SizeY)) {
+                const auto block{blocks[x][y][z]};
+                if (block == runBlock) {
+                    ++runLength;
+                    continue;
+                }
+                appendRun(runBlock, runLength);
+                runBlock = block;
+                runLength = 1;
+            }
+        }
+    }
+    appendRun(runBlock, runLength);
+
+    data.shrink_to_fit();
+    _compressedBlocks = std::move(data);
+    // Snapshots still being read keep their own references to the array.
+    _blocks.reset();
+
+    ++PerformanceCounters::instance().chunkCompressionCount;
+}
+
+std::bitset<BlockStorage::SizeY> BlockStorage::emptyLayers() const
+{
+    std::bitset<SizeY> layers;
+    for (const auto y : std::views::iota(0, SizeY)) {
+        layers.set(static_cast<std::size_t>(y), _nonAirBlockCounts[y] == 0);
+    }
+    return layers;
+}
+
+std::bitset<BlockStorage::SizeY> BlockStorage::solidLayers() const
+{
+    std::bitset<SizeY> layers;
+    for (const auto y : std::views::iota(0, SizeY)) {
+        layers.set(static_cast<std::size_t>(y), _solidBlockCounts[y] == SizeX * SizeZ);
+    }
+    return layers;
+}
+
+std::shared_ptr<const BlockStorage::BlockArray> BlockStorage::snapshot() const
+{
+    blocks();
+    // Snapshots are only taken on the owning thread, which is also the only one that writes, so the
+    // count cannot be seen as zero by a write while a snapshot is being taken.
+    _blocks->snapshotCount.fetch_add(1, std::memory_order_relaxed);
+    // The deleter keeps the shared array alive, even if the storage drops it on compression or on a
+    // later copy.
+    return std::shared_ptr<const BlockArray>{
+        &_blocks->blocks,
+        [sharedBlocks = _blocks](const BlockArray *) {
+            sharedBlocks->snapshotCount.fetch_sub(1, std::memory_order_release);
+        }};
+}
+
+void BlockStorage::copyOnWrite()
+{
+    // The count may be decreased by other threads releasing their snapshots, but never increased,
+    // so a shared array is at worst copied needlessly.
+    auto blocks{std::make_shared_for_overwrite<SharedBlockArray>()};
+    blocks->blocks = _blocks->blocks;
+    _blocks = std::move(blocks);
+    ++PerformanceCounters::instance().blockCopyOnWriteCount;
+}
+
+void BlockStorage::decompress() const
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Every block is overwritten below, so there is no need to zero-initialize the array.
+    auto blocks{std::make_shared_for_overwrite<SharedBlockArray>()};
+
+    std::size_t offset{0};
+    auto runBlock{BlockType::Air};
+    std::uint32_t remainingLength{0};
+    for (const auto x : std::views::iota(0, SizeX)) {
+        for (const auto z : std::views::iota(0, SizeZ)) {
+            for (const auto y : std::views::iota(0, SizeY)) {
+                if (remainingLength == 0) {
+                    runBlock = BlockType{_compressedBlocks[offset++]};
+                    std::uint32_t value{0};
+                    for (auto shift{0};; shift += 7) {
+                        const auto byte{_compressedBlocks[offset++]};
+                        value |= static_cast<std::uint32_t>(byte & 0x7Fu) << shift;
+                        if ((byte & 0x80u) == 0) {
+                            break;
+                        }
+                    }
+                    remainingLength = value + 1;
+                }
+                blocks->blocks[x][y][z] = runBlock;
+                --remainingLength;
+            }
+        }
+    }
+
+    _blocks = std::move(blocks);
+    // Release the memory instead of only clearing the vector.
+    _compressedBlocks = {};
+
+    auto &counters{PerformanceCounters::instance()};
+    const auto nanoseconds{timer.nsecsElapsed()};
+    ++counters.chunkDecompressionCount;
+    counters.chunkDecompressionNanoseconds += nanoseconds;
+    PerformanceCounters::updateMax(counters.maxChunkDecompressionNanoseconds, nanoseconds);
+}
+
+} // namespace minecraft
@@ -0,0 +1,128 @@
+#ifndef MINECRAFT_BLOCK_STORAGE_H
+#define MINECRAFT_BLOCK_STORAGE_H
+
+#include "block_type.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace minecraft {
+
+// Block data of a terrain chunk. Chunks that are not accessed for a while can be compressed in
+// memory, and they are transparently decompressed on the next access. Snapshots of the block data
+// can be taken in constant time for worker threads. The data are copied on the next write while a
+// snapshot is still alive. The numbers of non-air and solid blocks of each layer are kept up to
+// date on every write, so that meshing can skip layers without scanning them.
+class BlockStorage
+{
+public:
+    static constexpr int SizeX{64};
+    static constexpr int SizeY{256};
+    static constexpr int SizeZ{64};
+
+    using BlockArray = std::array<std::array<std::array<BlockType, SizeZ>, SizeY>, SizeX>;
+
+    BlockStorage()
+        : _blocks{std::make_shared<SharedBlockArray>()}
+        , _compressedBlocks{}
+        , _idleFrameCount{0}
+        , _nonAirBlockCounts{}
+        , _solidBlockCounts{}
+    {}
+
+    BlockStorage(const BlockStorage &) = delete;
+    BlockStorage(BlockStorage &&) = delete;
+
+    BlockStorage &operator=(const BlockStorage &) = delete;
+    BlockStorage &operator=(BlockStorage &&) = delete;
+
+    BlockType get(const glm::ivec3 &position) const
+    {
+        return blocks()[position.x][position.y][position.z];
+    }
+
+    void set(const glm::ivec3 &position, const BlockType block)
+    {
+        auto &target{blocks()[position.x][position.y][position.z]};
+        auto &nonAirCount{_nonAirBlockCounts[position.y]};
+        auto &solidCount{_solidBlockCounts[position.y]};
+        nonAirCount = static_cast<std::uint16_t>(nonAirCount + (block != BlockType::Air)
+                                                 - (target != BlockType::Air));
+        solidCount = static_cast<std::uint16_t>(solidCount + isSolid(block) - isSolid(target));
+        target = block;
+    }
+
+    const BlockArray &blocks() const
+    {
+        _idleFrameCount = 0;
+        if (_blocks == nullptr) {
+            decompress();
+        }
+        return _blocks->blocks;
+    }
+
+    // Returns the block data at the moment, which stay unchanged by later modifications and can be
+    // read from any thread.
+    std::shared_ptr<const BlockArray> snapshot() const;
+
+    // Layers whose blocks are all air
+    std::bitset<SizeY> emptyLayers() const;
+
+    // Layers whose blocks are all solid
+    std::bitset<SizeY> solidLayers() const;
+
+    bool isCompressed() const { return _blocks == nullptr; }
+
+    // Returns the number of frames since the last access, including the current one.
+    int incrementIdleFrameCount() { return ++_idleFrameCount; }
+
+    std::size_t memoryUsage() const
+    {
+        return _blocks != nullptr ? sizeof(BlockArray) : _compressedBlocks.capacity();
+    }
+
+    void compress();
+
+private:
+    // Block data with the number of live snapshots of them. Snapshots decrement the count with
+    // release ordering when they are released, and writers read it with acquire ordering, so that
+    // all reads of a released snapshot happen before the data are modified in place.
+    struct SharedBlockArray
+    {
+        BlockArray blocks;
+        std::atomic<int> snapshotCount{0};
+    };
+
+    // Writes must go through set(), which keeps the block counts. The returned reference must not
+    // be used after taking a snapshot.
+    BlockArray &blocks()
+    {
+        static_cast<const BlockStorage &>(*this).blocks();
+        if (_blocks->snapshotCount.load(std::memory_order_acquire) > 0) {
+            copyOnWrite();
+        }
+        return _blocks->blocks;
+    }
+
+    void decompress() const;
+    void copyOnWrite();
+
+    // Exactly one of these two members holds the block data. The array may be shared with
+    // snapshots, in which case it must not be modified.
+    mutable std::shared_ptr<SharedBlockArray> _blocks;
+    mutable std::vector<std::uint8_t> _compressedBlocks;
+    mutable int _idleFrameCount;
+    // Indexed by Y. A layer has SizeX * SizeZ blocks.
+    std::array<std::uint16_t, SizeY> _nonAirBlockCounts;
+    std::array<std::uint16_t, SizeY> _solidBlockCounts;
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_BLOCK_STORAGE_H
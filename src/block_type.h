@@ -16,6 +16,12 @@ enum class BlockType : std::uint8_t {
     Water = 7,
 };
 
+// Solid blocks hide the faces of the blocks next to them. Air, water, and lava do not.
+constexpr bool isSolid(const BlockType block)
+{
+    return block != BlockType::Air && block != BlockType::Water && block != BlockType::Lava;
+}
+
 } // namespace minecraft
 
 #endif // MINECRAFT_BLOCK_TYPE_H
@@ -22,6 +22,7 @@ public:
         : _pose{pose}
         , _fieldOfViewY{fieldOfViewY}
         , _aspect{}
+        , _viewportHeight{}
         , _near{near}
         , _far{far}
     {
@@ -48,9 +49,13 @@ public:
 
     float far() const { return _far; }
 
+    // Height of the viewport in pixels
+    int viewportHeight() const { return _viewportHeight; }
+
     void resizeViewport(const int width, const int height)
     {
         _aspect = static_cast<float>(width) / static_cast<float>(height);
+        _viewportHeight = height;
         updateProjectionMatrix();
     }
 
@@ -78,6 +83,7 @@ private:
     Pose _pose;
     float _fieldOfViewY;
     float _aspect;
+    int _viewportHeight;
     float _near;
     float _far;
     glm::mat4 _projectionMatrix;
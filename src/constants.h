@@ -3,7 +3,17 @@
 
 namespace minecraft {
 
+// These constants are also defined in every shader by ShaderProgram.
 constexpr auto ShadowMapCascadeCount{6};
+// The near cascades cover the smallest areas, and get a higher resolution than the far ones.
+constexpr auto ShadowMapNearCascadeCount{2};
+constexpr auto ShadowMapNearSize{4096};
+constexpr auto ShadowMapFarSize{2048};
+
+constexpr int getShadowMapSize(const int cascadeIndex)
+{
+    return cascadeIndex < ShadowMapNearCascadeCount ? ShadowMapNearSize : ShadowMapFarSize;
+}
 
 constexpr auto WaterLevel{138};
 
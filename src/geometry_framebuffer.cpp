@@ -35,15 +35,17 @@ void GeometryFramebuffer::resize(const int width, const int height)
         const auto textureDeleter{[](OpenGLContext *const context, const GLuint texture) {
             context->glDeleteTextures(1, &texture);
         }};
-        // Use higher precisions for the depth and normal textures.
-        // Use float32 for the depth texture because we may need to recover accurate world-space
-        // positions from the depth values. This saves the need for a separate position texture.
+        // Use float32 for the linear depth texture because we may need to recover accurate
+        // world-space positions from the depth values. This saves the need for a separate position
+        // texture.
         _depthTexture = OpenGLObject{
             generateAndAttachTexture(GL_R32F, GL_RED, GL_FLOAT, GL_COLOR_ATTACHMENT0),
             textureDeleter,
         };
+        // Octahedral-encoded normals keep better than 0.01 degrees of precision in 16 bits per
+        // channel.
         _normalTexture = OpenGLObject{
-            generateAndAttachTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, GL_COLOR_ATTACHMENT1),
+            generateAndAttachTexture(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, GL_COLOR_ATTACHMENT1),
             textureDeleter,
         };
         _albedoTexture = OpenGLObject{
@@ -93,6 +95,21 @@ void GeometryFramebuffer::resize(const int width, const int height)
     // Users are responsible for recovering the framebuffer if needed.
 }
 
+void GeometryFramebuffer::clear()
+{
+    const auto context{OpenGLContext::instance()};
+    const GLfloat skyDepth[4]{1e5f, 0.0f, 0.0f, 0.0f};
+    context->glClearBufferfv(GL_COLOR, 0, skyDepth);
+    context->checkError();
+    const GLfloat zeros[4]{0.0f, 0.0f, 0.0f, 0.0f};
+    context->glClearBufferfv(GL_COLOR, 1, zeros);
+    context->checkError();
+    context->glClearBufferfv(GL_COLOR, 2, zeros);
+    context->checkError();
+    context->glClear(GL_DEPTH_BUFFER_BIT);
+    context->checkError();
+}
+
 GLuint GeometryFramebuffer::generateAndAttachTexture(const GLint internalFormat,
                                                      const GLenum format,
                                                      const GLenum type,
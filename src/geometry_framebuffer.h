@@ -6,9 +6,15 @@
 
 namespace minecraft {
 
+// Holds the linear depths, the octahedral-encoded normals, and the albedo with the packed surface
+// flags of a geometry pass. The linear depths are kept in a float target rather than reconstructed
+// from the depth buffer, which would be off by about 0.2 blocks at the view distance.
 class GeometryFramebuffer
 {
 public:
+    // R32F linear depth, RG16 normal, RGBA8 albedo, and the 32-bit depth buffer
+    static constexpr int BytesPerPixel{16};
+
     GeometryFramebuffer()
         : _width{0}
         , _height{0}
@@ -31,6 +37,10 @@ public:
 
     void resize(const int width, const int height);
 
+    // Clears the linear depths to 1e5, which the lighting pass treats as the sky, and the other
+    // targets to zero. The framebuffer must be bound.
+    void clear();
+
     GLuint depthTexture() const { return _depthTexture.get(); }
 
     GLuint normalTexture() const { return _normalTexture.get(); }
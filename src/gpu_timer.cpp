@@ -0,0 +1,56 @@
+#include "gpu_timer.h"
+
+namespace minecraft {
+
+std::int64_t GpuTimer::begin()
+{
+    const auto context{OpenGLContext::instance()};
+
+    auto &query{_queries[_queryIndex]};
+    if (!query) {
+        GLuint id{0u};
+        context->glGenQueries(1, &id);
+        context->checkError();
+        query = OpenGLObject{
+            id,
+            [](OpenGLContext *const context, const GLuint query) {
+                context->glDeleteQueries(1, &query);
+            },
+        };
+    }
+
+    std::int64_t nanoseconds{-1};
+    if (_isPending[_queryIndex]) {
+        GLint isAvailable{GL_FALSE};
+        context->glGetQueryObjectiv(query.get(), GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        context->checkError();
+        if (isAvailable == GL_FALSE) {
+            _isActive = false;
+            return -1;
+        }
+        GLuint64 elapsedNanoseconds{0u};
+        context->glGetQueryObjectui64v(query.get(), GL_QUERY_RESULT, &elapsedNanoseconds);
+        context->checkError();
+        nanoseconds = static_cast<std::int64_t>(elapsedNanoseconds);
+    }
+
+    context->glBeginQuery(GL_TIME_ELAPSED, query.get());
+    context->checkError();
+    _isPending[_queryIndex] = true;
+    _isActive = true;
+    return nanoseconds;
+}
+
+void GpuTimer::end()
+{
+    if (!_isActive) {
+        return;
+    }
+    const auto context{OpenGLContext::instance()};
+    context->glEndQuery(GL_TIME_ELAPSED);
+    context->checkError();
+    _queryIndex = (_queryIndex + 1) % QueryCount;
+    _isActive = false;
+}
+
+} // namespace minecraft
@@ -0,0 +1,47 @@
+#ifndef MINECRAFT_GPU_TIMER_H
+#define MINECRAFT_GPU_TIMER_H
+
+#include "opengl_context.h"
+#include "opengl_object.h"
+
+#include <array>
+#include <cstdint>
+
+namespace minecraft {
+
+// Measures the GPU time of the commands between begin() and end() with timer queries. The results
+// are read a few frames later, so that the CPU never waits for the GPU.
+class GpuTimer
+{
+public:
+    GpuTimer()
+        : _queries{}
+        , _isPending{}
+        , _queryIndex{0}
+        , _isActive{false}
+    {}
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer(GpuTimer &&) = delete;
+
+    GpuTimer &operator=(const GpuTimer &) = delete;
+    GpuTimer &operator=(GpuTimer &&) = delete;
+
+    // Starts a measurement, and returns the time of an earlier one in nanoseconds if it has become
+    // available, or -1 otherwise. No measurement is started while the oldest one is still pending.
+    std::int64_t begin();
+
+    void end();
+
+private:
+    static constexpr int QueryCount{4};
+
+    std::array<OpenGLObject, QueryCount> _queries;
+    std::array<bool, QueryCount> _isPending;
+    int _queryIndex;
+    bool _isActive;
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_GPU_TIMER_H
@@ -6,17 +6,28 @@
 #include "vertex_attribute.h"
 
 #include <cstddef>
+#include <span>
 #include <vector>
 
 namespace minecraft {
 
+// A range of instances to be kept when reallocating the instance buffer.
+struct InstanceRangeCopy
+{
+    GLsizei sourceFirst;
+    GLsizei destinationFirst;
+    GLsizei count;
+};
+
 class InstancedRenderer
 {
 public:
     InstancedRenderer()
         : _vao{}
         , _instanceVBO{}
-        , _instanceCount{0}
+        , _attributes{}
+        , _instanceStride{0}
+        , _attributeFirstInstance{0}
     {}
 
     InstancedRenderer(const InstancedRenderer &) = delete;
@@ -27,16 +38,164 @@ public:
     InstancedRenderer &operator=(const InstancedRenderer &) = delete;
     InstancedRenderer &operator=(InstancedRenderer &&) = delete;
 
-    GLsizei instanceCount() const { return _instanceCount; }
-
+    // Overwrites a sub-range of the uploaded instances without reallocating the buffer.
     template<typename T>
-    void uploadInstances(const std::vector<T> &instances, const GLenum usage = GL_STATIC_DRAW)
+    void updateInstances(const GLsizei firstInstance, const std::vector<T> &instances)
     {
         if (instances.empty()) {
-            _instanceCount = 0;
             return;
         }
 
+        const auto context{OpenGLContext::instance()};
+        context->glBindBuffer(GL_ARRAY_BUFFER, _instanceVBO.get());
+        context->checkError();
+        context->glBufferSubData(GL_ARRAY_BUFFER,
+                                 static_cast<GLintptr>(firstInstance * sizeof(T)),
+                                 static_cast<GLsizeiptr>(instances.size() * sizeof(T)),
+                                 instances.data());
+        context->checkError();
+    }
+
+    // Copies ranges of instances into the buffer from sourceBuffer, or from the buffer itself if it
+    // is zero. The source and destination ranges must not overlap.
+    template<typename T>
+    void copyInstances(const std::vector<InstanceRangeCopy> &copies, const GLuint sourceBuffer = 0u)
+    {
+        if (copies.empty()) {
+            return;
+        }
+
+        const auto context{OpenGLContext::instance()};
+        context->glBindBuffer(GL_COPY_READ_BUFFER,
+                              sourceBuffer != 0u ? sourceBuffer : _instanceVBO.get());
+        context->checkError();
+        context->glBindBuffer(GL_COPY_WRITE_BUFFER, _instanceVBO.get());
+        context->checkError();
+        for (const auto &copy : copies) {
+            context->glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                         GL_COPY_WRITE_BUFFER,
+                                         static_cast<GLintptr>(copy.sourceFirst * sizeof(T)),
+                                         static_cast<GLintptr>(copy.destinationFirst * sizeof(T)),
+                                         static_cast<GLsizeiptr>(copy.count * sizeof(T)));
+            context->checkError();
+        }
+    }
+
+    // Reallocates the buffer for instanceCount instances, where the given ranges of the previous
+    // instances are copied into the new buffer on the GPU. Other instances are undefined.
+    template<typename T>
+    void resizeInstances(const GLsizei instanceCount,
+                         const std::vector<InstanceRangeCopy> &copies,
+                         const GLenum usage = GL_STATIC_DRAW)
+    {
+        const auto context{OpenGLContext::instance()};
+
+        // glBufferData() discards the previous contents, so the ranges to keep are first copied to
+        // a temporary buffer. Reusing the same buffer object keeps the vertex array valid.
+        OpenGLObject temporaryBuffer;
+        if (_instanceVBO && !copies.empty()) {
+            GLsizei totalCount{0};
+            for (const auto &copy : copies) {
+                totalCount += copy.count;
+            }
+
+            GLuint buffer{0u};
+            context->glGenBuffers(1, &buffer);
+            context->checkError();
+            temporaryBuffer = OpenGLObject{
+                buffer,
+                [](OpenGLContext *const context, const GLuint buffer) {
+                    context->glDeleteBuffers(1, &buffer);
+                },
+            };
+            context->glBindBuffer(GL_COPY_WRITE_BUFFER, temporaryBuffer.get());
+            context->checkError();
+            context->glBufferData(GL_COPY_WRITE_BUFFER,
+                                  static_cast<GLsizeiptr>(totalCount * sizeof(T)),
+                                  nullptr,
+                                  GL_STREAM_COPY);
+            context->checkError();
+            context->glBindBuffer(GL_COPY_READ_BUFFER, _instanceVBO.get());
+            context->checkError();
+
+            GLsizei temporaryFirst{0};
+            for (const auto &copy : copies) {
+                context->glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                             GL_COPY_WRITE_BUFFER,
+                                             static_cast<GLintptr>(copy.sourceFirst * sizeof(T)),
+                                             static_cast<GLintptr>(temporaryFirst * sizeof(T)),
+                                             static_cast<GLsizeiptr>(copy.count * sizeof(T)));
+                context->checkError();
+                temporaryFirst += copy.count;
+            }
+        }
+
+        allocateInstances<T>(instanceCount, usage);
+
+        if (temporaryBuffer) {
+            context->glBindBuffer(GL_COPY_READ_BUFFER, temporaryBuffer.get());
+            context->checkError();
+            context->glBindBuffer(GL_COPY_WRITE_BUFFER, _instanceVBO.get());
+            context->checkError();
+
+            GLsizei temporaryFirst{0};
+            for (const auto &copy : copies) {
+                context->glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                             GL_COPY_WRITE_BUFFER,
+                                             static_cast<GLintptr>(temporaryFirst * sizeof(T)),
+                                             static_cast<GLintptr>(copy.destinationFirst
+                                                                   * sizeof(T)),
+                                             static_cast<GLsizeiptr>(copy.count * sizeof(T)));
+                context->checkError();
+                temporaryFirst += copy.count;
+            }
+        }
+    }
+
+    void bind()
+    {
+        const auto context{OpenGLContext::instance()};
+        context->glBindVertexArray(_vao.get());
+        context->checkError();
+    }
+
+    // Draws the instances in [firstInstance, firstInstance + instanceCount). The vertex array must
+    // be bound with bind(). Returns whether the attribute pointers were moved for the draw.
+    bool drawRange(const GLsizei elementCount,
+                   const GLenum mode,
+                   const GLsizei firstInstance,
+                   const GLsizei instanceCount)
+    {
+        if (instanceCount <= 0) {
+            return false;
+        }
+
+        const auto context{OpenGLContext::instance()};
+        // OpenGL 4.1 does not support base instances, so the attribute pointers are moved to the
+        // first instance instead. They are only changed when the first instance differs.
+        const auto isMoved{firstInstance != _attributeFirstInstance};
+        if (isMoved) {
+            context->glBindBuffer(GL_ARRAY_BUFFER, _instanceVBO.get());
+            context->checkError();
+            setAttributePointers(firstInstance);
+        }
+        context->glDrawArraysInstanced(mode, 0, elementCount, instanceCount);
+        context->checkError();
+        return isMoved;
+    }
+
+    void releaseResources()
+    {
+        _vao.reset();
+        _instanceVBO.reset();
+        _attributeFirstInstance = 0;
+    }
+
+private:
+    // Allocates the buffer for instanceCount undefined instances.
+    template<typename T>
+    void allocateInstances(const GLsizei instanceCount, const GLenum usage)
+    {
         const auto context{OpenGLContext::instance()};
 
         if (!_instanceVBO) {
@@ -53,17 +212,15 @@ public:
         context->glBindBuffer(GL_ARRAY_BUFFER, _instanceVBO.get());
         context->checkError();
 
-        // Upload the instance attributes to the GPU.
+        // Allocate the instance attributes on the GPU.
         context->glBufferData(GL_ARRAY_BUFFER,
-                              static_cast<GLsizeiptr>(instances.size() * sizeof(T)),
-                              instances.data(),
+                              static_cast<GLsizeiptr>(instanceCount * sizeof(T)),
+                              nullptr,
                               usage);
         context->checkError();
 
-        _instanceCount = static_cast<GLsizei>(instances.size());
-
-        // Assuming that the attribute type does not change across function calls, we only need to set
-        // the vertex attribute pointers once.
+        // Assuming that the attribute type does not change across function calls, we only need to
+        // set the vertex attribute pointers once.
         if (_vao) {
             return;
         }
@@ -84,54 +241,51 @@ public:
         context->glBindVertexArray(_vao.get());
         context->checkError();
 
-        for (const auto &attribute : VertexAttributeTrait<T>::Attributes) {
+        _attributes = VertexAttributeTrait<T>::Attributes;
+        _instanceStride = sizeof(T);
+        setAttributePointers(0);
+        for (const auto &attribute : _attributes) {
+            context->glEnableVertexAttribArray(attribute.index);
+            context->checkError();
+            // The attribute advances once per instance.
+            context->glVertexAttribDivisor(attribute.index, 1);
+            context->checkError();
+        }
+    }
+
+    // Points the attributes of the bound vertex array at the given instance of the bound buffer.
+    void setAttributePointers(const GLsizei firstInstance)
+    {
+        const auto context{OpenGLContext::instance()};
+        const auto baseOffset{static_cast<std::size_t>(firstInstance)
+                              * static_cast<std::size_t>(_instanceStride)};
+        for (const auto &attribute : _attributes) {
+            const auto pointer{reinterpret_cast<const GLvoid *>(baseOffset + attribute.offset)};
             if (attribute.isInteger) {
                 context->glVertexAttribIPointer(attribute.index,
                                                 attribute.size,
                                                 attribute.type,
-                                                sizeof(T),
-                                                reinterpret_cast<const GLvoid *>(attribute.offset));
+                                                _instanceStride,
+                                                pointer);
             } else {
                 context->glVertexAttribPointer(attribute.index,
                                                attribute.size,
                                                attribute.type,
                                                GL_FALSE,
-                                               sizeof(T),
-                                               reinterpret_cast<const GLvoid *>(attribute.offset));
+                                               _instanceStride,
+                                               pointer);
             }
             context->checkError();
-            context->glEnableVertexAttribArray(attribute.index);
-            context->checkError();
-            // The attribute advances once per instance.
-            context->glVertexAttribDivisor(attribute.index, 1);
-            context->checkError();
         }
+        _attributeFirstInstance = firstInstance;
     }
 
-    void draw(const GLsizei elementCount, const GLenum mode) const
-    {
-        if (_instanceCount <= 0) {
-            return;
-        }
-
-        const auto context{OpenGLContext::instance()};
-        context->glBindVertexArray(_vao.get());
-        context->checkError();
-        context->glDrawArraysInstanced(mode, 0, elementCount, _instanceCount);
-        context->checkError();
-    }
-
-    void releaseResources()
-    {
-        _vao.reset();
-        _instanceVBO.reset();
-        _instanceCount = 0;
-    }
-
-private:
     OpenGLObject _vao;
     OpenGLObject _instanceVBO;
-    GLsizei _instanceCount;
+    std::span<const VertexAttribute> _attributes;
+    GLsizei _instanceStride;
+    // Instance that the attribute pointers currently start at
+    GLsizei _attributeFirstInstance;
 };
 
 } // namespace minecraft
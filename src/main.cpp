@@ -1,10 +1,14 @@
+#include "block_face_cache.h"
 #include "main_window.h"
 
 #include <QApplication>
+#include <QDir>
+#include <QStandardPaths>
 #include <QSurfaceFormat>
 
 int main(int argc, char **const argv)
 {
+    using minecraft::BlockFaceCache;
     using minecraft::MainWindow;
 
     const QApplication app{argc, argv};
@@ -19,6 +23,11 @@ int main(int argc, char **const argv)
         QSurfaceFormat::setDefaultFormat(format);
     }
 
+    // Block faces are cached on disk across runs.
+    BlockFaceCache::instance().setDirectory(
+        QDir{QStandardPaths::writableLocation(QStandardPaths::CacheLocation)}.filePath(
+            "block_faces"));
+
     MainWindow window;
     window.setVisible(true);
 
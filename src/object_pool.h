@@ -0,0 +1,66 @@
+#ifndef MINECRAFT_OBJECT_POOL_H
+#define MINECRAFT_OBJECT_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace minecraft {
+
+// A thread-safe pool of objects that are expensive to allocate. Released objects are handed out
+// again as they are, so users must reset their contents. At most maxSize objects are kept, and the
+// others are freed on release.
+template<typename T>
+class ObjectPool
+{
+public:
+    explicit ObjectPool(const std::size_t maxSize)
+        : _mutex{}
+        , _objects{}
+        , _maxSize{maxSize}
+    {
+        // Releasing objects does not allocate.
+        _objects.reserve(maxSize);
+    }
+
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool(ObjectPool &&) = delete;
+
+    ObjectPool &operator=(const ObjectPool &) = delete;
+    ObjectPool &operator=(ObjectPool &&) = delete;
+
+    std::unique_ptr<T> acquire()
+    {
+        {
+            const std::lock_guard lock{_mutex};
+            if (!_objects.empty()) {
+                auto object{std::move(_objects.back())};
+                _objects.pop_back();
+                return object;
+            }
+        }
+        return std::make_unique<T>();
+    }
+
+    void release(std::unique_ptr<T> object)
+    {
+        if (!object) {
+            return;
+        }
+        const std::lock_guard lock{_mutex};
+        if (_objects.size() < _maxSize) {
+            _objects.push_back(std::move(object));
+        }
+        // Otherwise, the object is freed when it goes out of scope.
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<T>> _objects;
+    std::size_t _maxSize;
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_OBJECT_POOL_H
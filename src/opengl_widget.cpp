@@ -1,7 +1,9 @@
 #include "opengl_widget.h"
 
+#include "block_face_arena.h"
+#include "block_face_uploader.h"
 #include "constants.h"
-#include "shadow_map_camera.h"
+#include "performance_counters.h"
 #include "terrain_chunk.h"
 #include "uniform_buffer_data.h"
 #include "water_wave.h"
@@ -9,8 +11,11 @@
 #include <glm/glm.hpp>
 
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QThreadPool>
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <initializer_list>
 #include <mutex>
@@ -19,23 +24,66 @@
 
 namespace minecraft {
 
+namespace {
+
+[[maybe_unused]] constexpr qint64 PerformanceLogIntervalMSecs{10000};
+
+// Which side of the water level the fragments of a geometry pass are kept on. The values match the
+// constants in geometry.frag.glsl.
+enum class WaterClipMode
+{
+    None,
+    AboveWaterOnly,
+    UnderWaterOnly,
+};
+
+ShaderDefinitions getGeometryDefinitions(const int cameraIndex, const WaterClipMode waterClipMode)
+{
+    return {
+        {"CameraIndex", cameraIndex},
+        {"WaterClipMode", static_cast<int>(waterClipMode)},
+    };
+}
+
+ShaderDefinitions getLightingDefinitions(const ShaderQuality quality)
+{
+    switch (quality) {
+    case ShaderQuality::Low:
+        return {{"ShadowFilterGridSize", 1}, {"RayMarchStepCount", 50}};
+    case ShaderQuality::Medium:
+        return {{"ShadowFilterGridSize", 2}, {"RayMarchStepCount", 100}};
+    case ShaderQuality::High:
+        return {{"ShadowFilterGridSize", 3}, {"RayMarchStepCount", 200}};
+    }
+    return {};
+}
+
+} // namespace
+
 OpenGLWidget::OpenGLWidget(QWidget *const parent)
     : QOpenGLWidget{parent}
     , _timer{}
     , _startingMSecs{QDateTime::currentMSecsSinceEpoch()}
     , _lastTickMSecs{-1}
+    , _lastPerformanceLogMSecs{_startingMSecs}
     , _scene{}
     , _terrainStreamer{&_scene.terrain()}
     , _playerController{&_scene.player()}
     , _sceneSettings{}
     , _sceneSettingsVersion{-1}
     , _shadowDepthProgram{}
+    , _shadowDepthLayeredProgram{}
     , _geometryProgram{}
-    , _lightingProgram{}
+    , _reflectionGeometryPrograms{}
+    , _refractionGeometryPrograms{}
+    , _lightingPrograms{}
     , _ubo{}
     , _colorTexture{}
     , _normalTexture{}
+    , _shadowMapCamera{}
     , _shadowMapFramebuffer{}
+    , _shadowGpuTimer{}
+    , _lightingGpuTimer{}
     , _opaqueGeometryFramebuffer{}
     , _translucentGeometryFramebuffer{}
     , _reflectionGeometryFramebuffer{}
@@ -56,12 +104,22 @@ OpenGLWidget::~OpenGLWidget()
     const auto threadPool{QThreadPool::globalInstance()};
     threadPool->clear();
     threadPool->waitForDone();
+    BlockFaceUploader::instance().stop();
+
+    // The block face arena outlives this widget, so its buffer is released while the context is
+    // still alive, after the chunks return their allocations.
+    makeCurrent();
+    _scene.terrain().forEachChunk(
+        [](TerrainChunk *const chunk) { chunk->releaseRendererResources(); });
+    BlockFaceArena::instance().releaseResources();
+    doneCurrent();
 }
 
 void OpenGLWidget::initializeGL()
 {
     initializeOpenGLFunctions();
     OpenGLContext::_instance = this;
+    BlockFaceUploader::instance().start(context());
 
     glEnable(GL_DEPTH_TEST);
     checkError();
@@ -70,15 +128,37 @@ void OpenGLWidget::initializeGL()
     // Blending is disabled by default. We do not need it because we will composite the opaque and
     // translucent contents manually.
 
-    // The clear color is only relevant for the depth textures used in the shadow map and geometry
-    // passes, with the R channel encoding the linear depth and the G channel encoding its square.
-    glClearColor(1e5f, 1e10f, 0.0f, 0.0f);
+    // The geometry and shadow map framebuffers clear their targets themselves, so the clear color
+    // is not read.
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     checkError();
 
     _shadowDepthProgram.create(":/shaders/shadow_depth.vert.glsl",
                                ":/shaders/shadow_depth.frag.glsl");
-    _geometryProgram.create(":/shaders/geometry.vert.glsl", ":/shaders/geometry.frag.glsl");
-    _lightingProgram.create(":/shaders/quad.vert.glsl", ":/shaders/lighting.frag.glsl");
+    _shadowDepthLayeredProgram.create(":/shaders/shadow_depth_layered.vert.glsl",
+                                      ":/shaders/shadow_depth_layered.geom.glsl",
+                                      ":/shaders/shadow_depth.frag.glsl");
+    {
+        const auto createGeometryProgram{[](ShaderProgram &program,
+                                            const int cameraIndex,
+                                            const WaterClipMode waterClipMode) {
+            program.create(":/shaders/geometry.vert.glsl",
+                           ":/shaders/geometry.frag.glsl",
+                           getGeometryDefinitions(cameraIndex, waterClipMode));
+        }};
+        createGeometryProgram(_geometryProgram, 0, WaterClipMode::None);
+        createGeometryProgram(_reflectionGeometryPrograms[0], 1, WaterClipMode::AboveWaterOnly);
+        createGeometryProgram(_reflectionGeometryPrograms[1], 1, WaterClipMode::UnderWaterOnly);
+        createGeometryProgram(_refractionGeometryPrograms[0], 2, WaterClipMode::AboveWaterOnly);
+        createGeometryProgram(_refractionGeometryPrograms[1], 2, WaterClipMode::UnderWaterOnly);
+    }
+    // All quality tiers are compiled up front, so that switching between them does not stall.
+    for (const auto qualityIndex : std::views::iota(0, ShaderQualityCount)) {
+        _lightingPrograms[qualityIndex].create(
+            ":/shaders/quad.vert.glsl",
+            ":/shaders/lighting.frag.glsl",
+            getLightingDefinitions(static_cast<ShaderQuality>(qualityIndex)));
+    }
 
     // Generate and bind the uniform buffer object. As it is globally unique, we only need to do it
     // once.
@@ -100,21 +180,23 @@ void OpenGLWidget::initializeGL()
                  nullptr,
                  GL_STREAM_DRAW);
     checkError();
-    for (const auto program : {
-             &_shadowDepthProgram,
-             &_geometryProgram,
-             &_lightingProgram,
-         }) {
+    for (const auto program : {&_shadowDepthProgram, &_shadowDepthLayeredProgram}) {
         program->bindUniformBlock("UniformBufferData", 0);
     }
+    for (const auto program : geometryPrograms()) {
+        program->bindUniformBlock("UniformBufferData", 0);
+    }
+    for (auto &program : _lightingPrograms) {
+        program.bindUniformBlock("UniformBufferData", 0);
+    }
     glBindBufferBase(GL_UNIFORM_BUFFER, 0, _ubo.get());
     checkError();
 
     _colorTexture.generate(":/textures/minecraft_textures_all.png", 16, 16);
     _normalTexture.generate(":/textures/minecraft_normals_all.png", 16, 16);
 
-    // The shadow map framebuffer has a fixed size and does not resize with the viewport.
-    _shadowMapFramebuffer.resize(4096, 4096);
+    // The shadow map framebuffer has fixed sizes and does not resize with the viewport.
+    _shadowMapFramebuffer.create();
 
     glActiveTexture(GL_TEXTURE0);
     checkError();
@@ -125,24 +207,29 @@ void OpenGLWidget::initializeGL()
     glBindTexture(GL_TEXTURE_2D_ARRAY, _normalTexture.texture());
     checkError();
 
-    _geometryProgram.use();
-    _geometryProgram.setUniform("u_colorTexture", 0);
-    _geometryProgram.setUniform("u_normalTexture", 1);
-
-    _lightingProgram.use();
-    _lightingProgram.setUniform("u_shadowDepthTexture", 2);
-    _lightingProgram.setUniform("u_opaqueDepthTexture", 3);
-    _lightingProgram.setUniform("u_opaqueNormalTexture", 4);
-    _lightingProgram.setUniform("u_opaqueAlbedoTexture", 5);
-    _lightingProgram.setUniform("u_translucentDepthTexture", 6);
-    _lightingProgram.setUniform("u_translucentNormalTexture", 7);
-    _lightingProgram.setUniform("u_translucentAlbedoTexture", 8);
-    _lightingProgram.setUniform("u_reflectionDepthTexture", 9);
-    _lightingProgram.setUniform("u_reflectionNormalTexture", 10);
-    _lightingProgram.setUniform("u_reflectionAlbedoTexture", 11);
-    _lightingProgram.setUniform("u_refractionDepthTexture", 12);
-    _lightingProgram.setUniform("u_refractionNormalTexture", 13);
-    _lightingProgram.setUniform("u_refractionAlbedoTexture", 14);
+    for (const auto program : geometryPrograms()) {
+        program->use();
+        program->setUniform("u_colorTexture", 0);
+        program->setUniform("u_normalTexture", 1);
+    }
+
+    for (auto &program : _lightingPrograms) {
+        program.use();
+        program.setUniform("u_nearShadowDepthTexture", 2);
+        program.setUniform("u_opaqueDepthTexture", 3);
+        program.setUniform("u_opaqueNormalTexture", 4);
+        program.setUniform("u_opaqueAlbedoTexture", 5);
+        program.setUniform("u_translucentDepthTexture", 6);
+        program.setUniform("u_translucentNormalTexture", 7);
+        program.setUniform("u_translucentAlbedoTexture", 8);
+        program.setUniform("u_reflectionDepthTexture", 9);
+        program.setUniform("u_reflectionNormalTexture", 10);
+        program.setUniform("u_reflectionAlbedoTexture", 11);
+        program.setUniform("u_refractionDepthTexture", 12);
+        program.setUniform("u_refractionNormalTexture", 13);
+        program.setUniform("u_refractionAlbedoTexture", 14);
+        program.setUniform("u_farShadowDepthTexture", 15);
+    }
 
     // The lighting pass does not need any vertex, index, or instance data, but we need a dummy VAO
     // for it.
@@ -161,6 +248,10 @@ void OpenGLWidget::initializeGL()
 
 void OpenGLWidget::paintGL()
 {
+    ++PerformanceCounters::instance().frameCount;
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
     const auto time{static_cast<float>(QDateTime::currentMSecsSinceEpoch() - _startingMSecs)
                     / 1000.0f};
 
@@ -189,8 +280,7 @@ void OpenGLWidget::paintGL()
         const std::lock_guard lock{_scene.playerMutex()};
         camera = _scene.player().getSyncedCamera();
     }
-    ShadowMapCamera shadowMapCamera;
-    shadowMapCamera.update(sunDirection, *camera);
+    _shadowMapCamera.update(sunDirection, *camera);
     const auto reflectionCamera{camera->createReflectionCamera(averageWaterLevel)};
     const auto refractionCamera{
         camera->createRefractionCamera(averageWaterLevel, sceneSettingsData.waterRefractiveIndex)};
@@ -214,6 +304,8 @@ void OpenGLWidget::paintGL()
             .mainToShadowViewMatrices{},
             .mainToShadowViewProjectionMatrices{},
             .shadowMapDepthBlurScales{},
+            .shadowMapTextureOffsets{},
+            .shadowMapMomentScales{},
             .viewMatrixInverse{viewMatrixInverse},
             .projectionMatrixInverse{glm::inverse(camera->projectionMatrix())},
             .reflectionProjectionMatrix{reflectionCamera.projectionMatrix()},
@@ -224,9 +316,9 @@ void OpenGLWidget::paintGL()
             .refractionToMainViewMatrix{viewMatrix * glm::inverse(refractionCamera.viewMatrix())},
         };
         for (const auto cascadeIndex : std::views::iota(0, ShadowMapCascadeCount)) {
-            const auto &shadowViewMatrix{shadowMapCamera.viewMatrix(cascadeIndex)};
+            const auto &shadowViewMatrix{_shadowMapCamera.viewMatrix(cascadeIndex)};
             const auto shadowViewProjectionMatrix{
-                shadowMapCamera.projectionMatrix(cascadeIndex) * shadowViewMatrix,
+                _shadowMapCamera.projectionMatrix(cascadeIndex) * shadowViewMatrix,
             };
             uboData.shadowViewMatrices[cascadeIndex] = shadowViewMatrix;
             uboData.shadowViewProjectionMatrices[cascadeIndex] = shadowViewProjectionMatrix;
@@ -234,7 +326,16 @@ void OpenGLWidget::paintGL()
             uboData.mainToShadowViewProjectionMatrices[cascadeIndex] = shadowViewProjectionMatrix
                                                                        * viewMatrixInverse;
             uboData.shadowMapDepthBlurScales[cascadeIndex]
-                = glm::vec4{shadowMapCamera.getDepthBlurScale(cascadeIndex), 0.0f, 0.0f};
+                = glm::vec4{_shadowMapCamera.getDepthBlurScale(cascadeIndex), 0.0f, 0.0f};
+            uboData.shadowMapTextureOffsets[cascadeIndex]
+                = glm::vec4{_shadowMapCamera.getTextureOffset(cascadeIndex), 0.0f, 0.0f};
+            const auto depthRange{_shadowMapCamera.getDepthRange(cascadeIndex)};
+            const auto minDepthVariance{
+                std::max(ShadowMapFramebuffer::getMomentPrecision() * depthRange * depthRange,
+                         2e-5f),
+            };
+            uboData.shadowMapMomentScales[cascadeIndex]
+                = glm::vec4{depthRange, minDepthVariance, 0.0f, 0.0f};
         }
         glBindBuffer(GL_UNIFORM_BUFFER, _ubo.get());
         checkError();
@@ -246,49 +347,77 @@ void OpenGLWidget::paintGL()
         const auto &cameraPosition{camera->pose().position()};
 
         const std::lock_guard lock{_scene.terrainMutex()};
-        const auto visibleChunks{_terrainStreamer.update(cameraPosition)};
+        const auto visibleChunks{_terrainStreamer.update(*camera)};
+        for (const auto &boundingBox : _terrainStreamer.changedBoundingBoxes()) {
+            _shadowMapCamera.invalidate(boundingBox);
+        }
+        // All chunks are drawn from the vertex array of the arena, which stays bound until the
+        // lighting pass.
+        BlockFaceArena::instance().bind();
 
-        _shadowDepthProgram.use();
-        for (const auto cascadeIndex : std::views::iota(0, ShadowMapCascadeCount)) {
-            _shadowDepthProgram.setUniform("u_cascadeIndex", cascadeIndex);
+        // Only faces facing the sun can be the nearest to it.
+        const auto sunFacingDirectionMask{TerrainChunk::getLightFacingDirectionMask(sunDirection)};
 
-            _shadowMapFramebuffer.bind(cascadeIndex);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            checkError();
-            for (const auto chunk : visibleChunks) {
-                chunk->draw(BlockFaceGroup::Opaque);
+        // The cascades keep their texels across frames, and only the stale regions are rendered.
+        {
+            QElapsedTimer shadowTimer;
+            shadowTimer.start();
+            const auto gpuNanoseconds{_shadowGpuTimer.begin()};
+            if (sceneSettingsData.isLayeredShadowRenderingEnabled) {
+                drawShadowMapsLayered(visibleChunks, sunFacingDirectionMask);
+            } else {
+                drawShadowMapsPerCascade(visibleChunks, sunFacingDirectionMask);
+            }
+            // Prefiltering the moments is part of the shadow map update.
+            _shadowMapFramebuffer.updateMipmaps();
+            _shadowGpuTimer.end();
+
+            auto &counters{PerformanceCounters::instance()};
+            counters.shadowSubmissionNanoseconds += shadowTimer.nsecsElapsed();
+            if (gpuNanoseconds >= 0) {
+                counters.shadowGpuNanoseconds += gpuNanoseconds;
+                ++counters.shadowGpuSampleCount;
             }
         }
 
         const auto drawBlockFaceGroup{
-            [&visibleChunks](const BlockFaceGroup group, const Camera &camera) {
+            [&visibleChunks](ShaderProgram &program,
+                             const BlockFaceGroup group,
+                             const Camera &camera) {
+                program.use();
                 for (const auto chunk : visibleChunks) {
                     const auto boundingBox{chunk->rendererBoundingBox(group)};
-                    if (!boundingBox.isEmpty() && camera.isInViewFrustum(boundingBox)) {
-                        chunk->draw(group);
+                    if (boundingBox.isEmpty() || !camera.isInViewFrustum(boundingBox)) {
+                        continue;
                     }
+                    // Water surfaces are not closed and can be seen from below, so translucent
+                    // faces are always drawn.
+                    const auto directionMask{
+                        group == BlockFaceGroup::Translucent
+                            ? TerrainChunk::AllDirectionsMask
+                            : TerrainChunk::getFrontFacingDirectionMask(boundingBox,
+                                                                        camera.pose().position()),
+                    };
+                    program.setUniform("u_chunkOriginXZ", chunk->originXZ());
+                    chunk->draw(group, directionMask);
                 }
             }};
 
-        _geometryProgram.use();
         if (isSceneSettingsChanged) {
-            _geometryProgram.setUniform("u_waterWaveAmplitudeScale",
-                                        sceneSettingsData.waterWaveAmplitudeScale);
+            for (const auto program : geometryPrograms()) {
+                program->use();
+                program->setUniform("u_waterWaveAmplitudeScale",
+                                    sceneSettingsData.waterWaveAmplitudeScale);
+            }
         }
 
-        _geometryProgram.setUniform("u_cameraIndex", 0);
-        _geometryProgram.setUniform("u_isAboveWaterOnly", 0);
-        _geometryProgram.setUniform("u_isUnderWaterOnly", 0);
-
         _opaqueGeometryFramebuffer.bind();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        checkError();
-        drawBlockFaceGroup(BlockFaceGroup::Opaque, *camera);
+        _opaqueGeometryFramebuffer.clear();
+        drawBlockFaceGroup(_geometryProgram, BlockFaceGroup::Opaque, *camera);
 
         _translucentGeometryFramebuffer.bind();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        checkError();
-        drawBlockFaceGroup(BlockFaceGroup::Translucent, *camera);
+        _translucentGeometryFramebuffer.clear();
+        drawBlockFaceGroup(_geometryProgram, BlockFaceGroup::Translucent, *camera);
 
         const auto waterLevel{
             static_cast<float>(WaterLevel)
@@ -298,24 +427,18 @@ void OpenGLWidget::paintGL()
         };
         const auto isAboveWater{cameraPosition.y >= waterLevel};
 
-        _geometryProgram.setUniform("u_cameraIndex", 1);
-        _geometryProgram.setUniform("u_isAboveWaterOnly", isAboveWater ? 1 : 0);
-        _geometryProgram.setUniform("u_isUnderWaterOnly", isAboveWater ? 0 : 1);
-
+        // The reflection keeps the camera's side of the water level, and the refraction keeps the
+        // other side. Index 0 of the programs keeps the fragments above the water level.
         _reflectionGeometryFramebuffer.bind();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        checkError();
-        drawBlockFaceGroup(isAboveWater ? BlockFaceGroup::AboveWater : BlockFaceGroup::UnderWater,
+        _reflectionGeometryFramebuffer.clear();
+        drawBlockFaceGroup(_reflectionGeometryPrograms[isAboveWater ? 0 : 1],
+                           isAboveWater ? BlockFaceGroup::AboveWater : BlockFaceGroup::UnderWater,
                            reflectionCamera);
 
-        _geometryProgram.setUniform("u_cameraIndex", 2);
-        _geometryProgram.setUniform("u_isAboveWaterOnly", isAboveWater ? 0 : 1);
-        _geometryProgram.setUniform("u_isUnderWaterOnly", isAboveWater ? 1 : 0);
-
         _refractionGeometryFramebuffer.bind();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        checkError();
-        drawBlockFaceGroup(isAboveWater ? BlockFaceGroup::UnderWater : BlockFaceGroup::AboveWater,
+        _refractionGeometryFramebuffer.clear();
+        drawBlockFaceGroup(_refractionGeometryPrograms[isAboveWater ? 1 : 0],
+                           isAboveWater ? BlockFaceGroup::UnderWater : BlockFaceGroup::AboveWater,
                            refractionCamera);
     }
 
@@ -324,7 +447,11 @@ void OpenGLWidget::paintGL()
 
     glActiveTexture(GL_TEXTURE2);
     checkError();
-    glBindTexture(GL_TEXTURE_2D_ARRAY, _shadowMapFramebuffer.depthTexture());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _shadowMapFramebuffer.momentTexture(0));
+    checkError();
+    glActiveTexture(GL_TEXTURE15);
+    checkError();
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _shadowMapFramebuffer.momentTexture(1));
     checkError();
 
     bindTextures({
@@ -342,11 +469,14 @@ void OpenGLWidget::paintGL()
         {GL_TEXTURE14, _refractionGeometryFramebuffer.albedoTexture()},
     });
 
-    _lightingProgram.use();
+    // Switching the quality tier changes the scene settings, so the uniforms of the newly selected
+    // program are set before it is first used.
+    auto &lightingProgram{_lightingPrograms[static_cast<int>(sceneSettingsData.shaderQuality)]};
+    lightingProgram.use();
     if (isSceneSettingsChanged) {
-        _lightingProgram.setUniform("u_sunDirection", sunDirection);
-        _lightingProgram.setUniform("u_waterRefractiveIndex",
-                                    sceneSettingsData.waterRefractiveIndex);
+        lightingProgram.setUniform("u_sunDirection", sunDirection);
+        lightingProgram.setUniform("u_waterRefractiveIndex",
+                                   sceneSettingsData.waterRefractiveIndex);
     }
 
     glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
@@ -356,15 +486,27 @@ void OpenGLWidget::paintGL()
     checkError();
     glBindVertexArray(_quadVAO.get());
     checkError();
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    checkError();
+    {
+        const auto gpuNanoseconds{_lightingGpuTimer.begin()};
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        checkError();
+        _lightingGpuTimer.end();
+
+        if (gpuNanoseconds >= 0) {
+            auto &counters{PerformanceCounters::instance()};
+            counters.lightingGpuNanoseconds += gpuNanoseconds;
+            ++counters.lightingGpuSampleCount;
+        }
+    }
 
     // These textures are written to in the shadow depth and geometry passes, so they should be
     // unbound after the lighting pass to avoid potential conflicts.
-    glActiveTexture(GL_TEXTURE2);
-    checkError();
-    glBindTexture(GL_TEXTURE_2D_ARRAY, 0u);
-    checkError();
+    for (const auto textureUnit : {GL_TEXTURE2, GL_TEXTURE15}) {
+        glActiveTexture(textureUnit);
+        checkError();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0u);
+        checkError();
+    }
 
     bindTextures({
         {GL_TEXTURE3, 0u},
@@ -383,12 +525,15 @@ void OpenGLWidget::paintGL()
 
     glEnable(GL_DEPTH_TEST);
     checkError();
+
+    PerformanceCounters::instance().recordFrameTime(frameTimer.nsecsElapsed());
 }
 
 void OpenGLWidget::resizeGL([[maybe_unused]] const int width, [[maybe_unused]] const int height)
 {
     // This is how QOpenGLWidget::recreateFbos() computes the frame buffer size in its source code.
     const auto deviceSize{size() * devicePixelRatio()};
+    std::int64_t geometryBufferBytes{0};
     for (const auto framebuffer : {
              &_opaqueGeometryFramebuffer,
              &_translucentGeometryFramebuffer,
@@ -396,7 +541,10 @@ void OpenGLWidget::resizeGL([[maybe_unused]] const int width, [[maybe_unused]] c
              &_refractionGeometryFramebuffer,
          }) {
         framebuffer->resize(deviceSize.width(), deviceSize.height());
+        geometryBufferBytes += std::int64_t{framebuffer->width()} * framebuffer->height()
+                               * GeometryFramebuffer::BytesPerPixel;
     }
+    PerformanceCounters::instance().geometryBufferBytes = geometryBufferBytes;
     const std::lock_guard lock{_scene.playerMutex()};
     _scene.player().resizeCameraViewport(deviceSize.width(), deviceSize.height());
 }
@@ -437,9 +585,179 @@ void OpenGLWidget::tick()
         }
     }
 
+#ifdef MINECRAFT_LOG_PERFORMANCE_COUNTERS
+    if (currentMSecs - _lastPerformanceLogMSecs >= PerformanceLogIntervalMSecs) {
+        _lastPerformanceLogMSecs = currentMSecs;
+        PerformanceCounters::instance().log();
+    }
+#endif
+
     update();
 }
 
+void OpenGLWidget::drawShadowMapsPerCascade(const std::vector<TerrainChunk *> &chunks,
+                                            const std::uint32_t directionMask)
+{
+    _shadowDepthProgram.use();
+    for (const auto cascadeIndex : std::views::iota(0, ShadowMapCascadeCount)) {
+        const auto regions{_shadowMapCamera.takeRegionsToRender(cascadeIndex)};
+        if (regions.empty()) {
+            continue;
+        }
+        _shadowDepthProgram.setUniform("u_cascadeIndex", cascadeIndex);
+
+        _shadowMapFramebuffer.bind(cascadeIndex);
+        glEnable(GL_SCISSOR_TEST);
+        checkError();
+        for (const auto &region : regions) {
+            const auto viewport{_shadowMapCamera.getRegionViewport(cascadeIndex, region)};
+            glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+            checkError();
+            glScissor(viewport.x, viewport.y, viewport.z, viewport.w);
+            checkError();
+            _shadowMapFramebuffer.clear();
+            _shadowDepthProgram.setUniform(
+                "u_shadowViewProjectionMatrix",
+                _shadowMapCamera.getRegionViewProjectionMatrix(cascadeIndex, region));
+            for (const auto chunk : chunks) {
+                const auto &boundingBox{chunk->rendererBoundingBox(BlockFaceGroup::Opaque)};
+                if (boundingBox.isEmpty()
+                    || !_shadowMapCamera.isShadowCasterInRegion(cascadeIndex,
+                                                                region,
+                                                                boundingBox)) {
+                    continue;
+                }
+                _shadowDepthProgram.setUniform("u_chunkOriginXZ", chunk->originXZ());
+                chunk->draw(BlockFaceGroup::Opaque, directionMask);
+                ++PerformanceCounters::instance().shadowChunkDrawCount;
+            }
+            ++PerformanceCounters::instance().shadowPassCount;
+            recordShadowRegion(viewport);
+        }
+        glDisable(GL_SCISSOR_TEST);
+        checkError();
+    }
+}
+
+void OpenGLWidget::drawShadowMapsLayered(const std::vector<TerrainChunk *> &chunks,
+                                         const std::uint32_t directionMask)
+{
+    std::array<std::vector<ShadowMapRegion>, ShadowMapCascadeCount> regions;
+    for (const auto cascadeIndex : std::views::iota(0, ShadowMapCascadeCount)) {
+        regions[cascadeIndex] = _shadowMapCamera.takeRegionsToRender(cascadeIndex);
+    }
+
+    // Each pass renders up to one region of every cascade in a tier, so the chunks are submitted
+    // once per pass instead of once per region.
+    _shadowDepthLayeredProgram.use();
+    for (const auto tierIndex : std::views::iota(0, ShadowMapFramebuffer::TierCount)) {
+        const auto firstCascadeIndex{ShadowMapFramebuffer::getFirstCascadeIndex(tierIndex)};
+        const auto tierCascadeIndices{std::views::iota(
+            firstCascadeIndex,
+            firstCascadeIndex + ShadowMapFramebuffer::getCascadeCount(tierIndex))};
+        std::size_t passCount{0};
+        for (const auto cascadeIndex : tierCascadeIndices) {
+            passCount = std::max(passCount, regions[cascadeIndex].size());
+        }
+        if (passCount == 0) {
+            continue;
+        }
+        _shadowDepthLayeredProgram.setUniform("u_firstCascadeIndex", firstCascadeIndex);
+
+        for (const auto passIndex : std::views::iota(std::size_t{0}, passCount)) {
+            const auto isInPass{[&regions, passIndex](const int cascadeIndex) {
+                return passIndex < regions[cascadeIndex].size();
+            }};
+
+            // Clears apply to all attached layers, so each region is cleared in its own layer
+            // first.
+            glEnable(GL_SCISSOR_TEST);
+            checkError();
+            for (const auto cascadeIndex : tierCascadeIndices) {
+                if (!isInPass(cascadeIndex)) {
+                    continue;
+                }
+                const auto viewport{
+                    _shadowMapCamera.getRegionViewport(cascadeIndex,
+                                                       regions[cascadeIndex][passIndex])};
+                _shadowMapFramebuffer.bind(cascadeIndex);
+                glScissor(viewport.x, viewport.y, viewport.z, viewport.w);
+                checkError();
+                _shadowMapFramebuffer.clear();
+            }
+            // The viewports clip the primitives to the regions.
+            glDisable(GL_SCISSOR_TEST);
+            checkError();
+
+            _shadowMapFramebuffer.bindLayered(tierIndex);
+            std::array<glm::mat4, ShadowMapCascadeCount> viewProjectionMatrices;
+            viewProjectionMatrices.fill(glm::mat4{1.0f});
+            for (const auto cascadeIndex : tierCascadeIndices) {
+                if (!isInPass(cascadeIndex)) {
+                    continue;
+                }
+                const auto &region{regions[cascadeIndex][passIndex]};
+                const auto viewport{_shadowMapCamera.getRegionViewport(cascadeIndex, region)};
+                glViewportIndexedf(static_cast<GLuint>(cascadeIndex),
+                                   static_cast<GLfloat>(viewport.x),
+                                   static_cast<GLfloat>(viewport.y),
+                                   static_cast<GLfloat>(viewport.z),
+                                   static_cast<GLfloat>(viewport.w));
+                checkError();
+                viewProjectionMatrices[cascadeIndex]
+                    = _shadowMapCamera.getRegionViewProjectionMatrix(cascadeIndex, region);
+                recordShadowRegion(viewport);
+            }
+            _shadowDepthLayeredProgram.setUniforms("u_regionViewProjectionMatrices",
+                                                   ShadowMapCascadeCount,
+                                                   viewProjectionMatrices.data());
+
+            for (const auto chunk : chunks) {
+                const auto &boundingBox{chunk->rendererBoundingBox(BlockFaceGroup::Opaque)};
+                if (boundingBox.isEmpty()) {
+                    continue;
+                }
+                // The geometry shader only emits faces to the cascades that the chunk may shadow.
+                auto cascadeMask{0};
+                for (const auto cascadeIndex : tierCascadeIndices) {
+                    if (isInPass(cascadeIndex)
+                        && _shadowMapCamera.isShadowCasterInRegion(cascadeIndex,
+                                                                   regions[cascadeIndex][passIndex],
+                                                                   boundingBox)) {
+                        cascadeMask |= 1 << cascadeIndex;
+                    }
+                }
+                if (cascadeMask == 0) {
+                    continue;
+                }
+                _shadowDepthLayeredProgram.setUniform("u_cascadeMask", cascadeMask);
+                _shadowDepthLayeredProgram.setUniform("u_chunkOriginXZ", chunk->originXZ());
+                chunk->draw(BlockFaceGroup::Opaque, directionMask);
+                ++PerformanceCounters::instance().shadowChunkDrawCount;
+            }
+            ++PerformanceCounters::instance().shadowPassCount;
+        }
+    }
+}
+
+void OpenGLWidget::recordShadowRegion(const glm::ivec4 &viewport)
+{
+    auto &counters{PerformanceCounters::instance()};
+    ++counters.shadowRegionCount;
+    counters.shadowTexelCount += static_cast<std::int64_t>(viewport.z) * viewport.w;
+}
+
+std::array<ShaderProgram *, 5> OpenGLWidget::geometryPrograms()
+{
+    return {
+        &_geometryProgram,
+        &_reflectionGeometryPrograms[0],
+        &_reflectionGeometryPrograms[1],
+        &_refractionGeometryPrograms[0],
+        &_refractionGeometryPrograms[1],
+    };
+}
+
 void OpenGLWidget::bindTextures(const std::vector<std::pair<GLenum, GLuint>> &textures)
 {
     for (const auto &[textureUnit, textureID] : textures) {
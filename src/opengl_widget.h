@@ -3,6 +3,7 @@
 
 #include "array_texture_2d.h"
 #include "geometry_framebuffer.h"
+#include "gpu_timer.h"
 #include "opengl_context.h"
 #include "opengl_object.h"
 #include "player_controller.h"
@@ -10,12 +11,16 @@
 #include "scene.h"
 #include "scene_settings.h"
 #include "shader_program.h"
+#include "shadow_map_camera.h"
 #include "shadow_map_framebuffer.h"
 #include "terrain_streamer.h"
 
+#include <glm/glm.hpp>
+
 #include <QOpenGLWidget>
 #include <QTimer>
 
+#include <array>
 #include <cstdint>
 #include <utility>
 #include <vector>
@@ -50,11 +55,25 @@ private slots:
     void tick();
 
 private:
+    // Renders the stale regions of the shadow map cascades, one pass per region.
+    void drawShadowMapsPerCascade(const std::vector<TerrainChunk *> &chunks,
+                                  const std::uint32_t directionMask);
+
+    // Renders the stale regions of the shadow map cascades, in layered passes that cover a region
+    // of every cascade.
+    void drawShadowMapsLayered(const std::vector<TerrainChunk *> &chunks,
+                               const std::uint32_t directionMask);
+
+    static void recordShadowRegion(const glm::ivec4 &viewport);
+
     void bindTextures(const std::vector<std::pair<GLenum, GLuint>> &textures);
 
+    std::array<ShaderProgram *, 5> geometryPrograms();
+
     QTimer _timer;
     qint64 _startingMSecs;
     qint64 _lastTickMSecs;
+    qint64 _lastPerformanceLogMSecs;
 
     Scene _scene;
     TerrainStreamer _terrainStreamer;
@@ -64,12 +83,22 @@ private:
     std::int32_t _sceneSettingsVersion;
 
     ShaderProgram _shadowDepthProgram;
+    ShaderProgram _shadowDepthLayeredProgram;
+    // Geometry programs are specialized for the camera they render. The reflection and refraction
+    // cameras have one program that keeps the fragments above the water level and another that
+    // keeps those under it.
     ShaderProgram _geometryProgram;
-    ShaderProgram _lightingProgram;
+    std::array<ShaderProgram, 2> _reflectionGeometryPrograms;
+    std::array<ShaderProgram, 2> _refractionGeometryPrograms;
+    // One lighting program per shader quality tier
+    std::array<ShaderProgram, ShaderQualityCount> _lightingPrograms;
     OpenGLObject _ubo;
     ArrayTexture2D _colorTexture;
     ArrayTexture2D _normalTexture;
+    ShadowMapCamera _shadowMapCamera;
     ShadowMapFramebuffer _shadowMapFramebuffer;
+    GpuTimer _shadowGpuTimer;
+    GpuTimer _lightingGpuTimer;
     GeometryFramebuffer _opaqueGeometryFramebuffer;
     GeometryFramebuffer _translucentGeometryFramebuffer;
     GeometryFramebuffer _reflectionGeometryFramebuffer;
@@ -0,0 +1,144 @@
+#include "performance_counters.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace minecraft {
+
+namespace {
+
+double toMilliseconds(const std::int64_t nanoseconds)
+{
+    return static_cast<double>(nanoseconds) * 1e-6;
+}
+
+} // namespace
+
+void PerformanceCounters::log()
+{
+    const auto decompressionCount{chunkDecompressionCount.exchange(0)};
+    const auto decompressionNanoseconds{chunkDecompressionNanoseconds.exchange(0)};
+    qInfo().noquote().nospace()
+        << "Block storage: " << residentChunkCount.load() << " resident + "
+        << compressedChunkCount.load() << " compressed chunks, "
+        << static_cast<double>(blockStorageBytes.load()) / (1024.0 * 1024.0) << " MiB, "
+        << chunkCompressionCount.exchange(0) << " compressions, " << decompressionCount
+        << " decompressions (mean "
+        << (decompressionCount > 0 ? toMilliseconds(decompressionNanoseconds / decompressionCount)
+                                   : 0.0)
+        << " ms, max " << toMilliseconds(maxChunkDecompressionNanoseconds.exchange(0)) << " ms), "
+        << blockCopyOnWriteCount.exchange(0) << " copy-on-writes";
+
+    const auto generationCount{blockFaceGenerationCount.exchange(0)};
+    const auto generationNanoseconds{blockFaceGenerationNanoseconds.exchange(0)};
+    qInfo().noquote().nospace()
+        << "Block faces: " << generationCount << " chunks (mean "
+        << (generationCount > 0 ? toMilliseconds(generationNanoseconds / generationCount) : 0.0)
+        << " ms, max " << toMilliseconds(maxBlockFaceGenerationNanoseconds.exchange(0))
+        << " ms), " << meshedLayerCount.exchange(0) << " layers meshed, "
+        << generatedBlockFaceCount.exchange(0) << " faces generated, "
+        << uploadedInstanceCount.exchange(0) << " instances uploaded, "
+        << queuedBlockFaceGenerationCount.load() << " chunks queued";
+
+    const auto uploadedChunks{uploadedChunkCount.exchange(0)};
+    qInfo().noquote().nospace()
+        << "Block face uploads: " << uploadedChunks << " chunks, "
+        << static_cast<double>(uploadedBytes.exchange(0)) / (1024.0 * 1024.0) << " MiB in "
+        << toMilliseconds(uploadNanoseconds.exchange(0)) << " ms (max "
+        << toMilliseconds(maxUploadNanoseconds.exchange(0)) << " ms per frame), "
+        << deferredUploadCount.load() << " chunks deferred";
+
+    qInfo().noquote().nospace()
+        << "Block face staging: " << stagedChunkCount.exchange(0) << " chunks, "
+        << static_cast<double>(stagedBytes.exchange(0)) / (1024.0 * 1024.0) << " MiB in "
+        << toMilliseconds(stagingNanoseconds.exchange(0)) << " ms on the upload thread, "
+        << recycledStagingBufferCount.exchange(0) << " in recycled buffers";
+
+    const auto cacheHitCount{blockFaceCacheHitCount.exchange(0)};
+    const auto cacheMissCount{blockFaceCacheMissCount.exchange(0)};
+    const auto cacheMissNanoseconds{blockFaceCacheMissNanoseconds.exchange(0)};
+    const auto cacheLookupCount{std::max(cacheHitCount + cacheMissCount, std::int64_t{1})};
+    const auto cacheSavedNanoseconds{
+        cacheMissCount > 0 ? cacheMissNanoseconds / cacheMissCount * cacheHitCount : 0};
+    qInfo().noquote().nospace()
+        << "Block face cache: " << cacheHitCount << " hits ("
+        << blockFaceCacheDiskHitCount.exchange(0) << " from disk), " << cacheMissCount
+        << " misses, " << static_cast<double>(cacheHitCount) * 100.0 / cacheLookupCount
+        << "% hit rate, ~" << toMilliseconds(cacheSavedNanoseconds) << " ms saved, "
+        << static_cast<double>(blockFaceCacheBytes.load()) / (1024.0 * 1024.0)
+        << " MiB in memory, "
+        << static_cast<double>(blockFaceCacheDiskBytes.load()) / (1024.0 * 1024.0)
+        << " MiB on disk";
+
+    // Fragmentation is the share of free instances outside the largest free range.
+    const auto arenaCapacity{blockFaceArenaCapacity.load()};
+    const auto arenaFreeCount{arenaCapacity - blockFaceArenaUsedCount.load()};
+    const auto arenaLargestFreeRange{blockFaceArenaLargestFreeRange.load()};
+    const auto arenaFragmentation{
+        arenaFreeCount > 0
+            ? 100.0 - static_cast<double>(arenaLargestFreeRange) * 100.0 / arenaFreeCount
+            : 0.0};
+    qInfo().noquote().nospace()
+        << "Block face arena: " << arenaCapacity - arenaFreeCount << " / " << arenaCapacity
+        << " instances, " << blockFaceArenaFreeRangeCount.load() << " free ranges, "
+        << arenaFragmentation << "% fragmented, " << blockFaceArenaReallocationCount.exchange(0)
+        << " reallocations";
+
+    qInfo().noquote().nospace()
+        << "Terrain LOD: " << lodChunkCounts[0].load() << " / " << lodChunkCounts[1].load()
+        << " / " << lodChunkCounts[2].load() << " / " << lodChunkCounts[3].load() << " chunks, "
+        << lodInstanceCounts[0].load() << " / " << lodInstanceCounts[1].load() << " / "
+        << lodInstanceCounts[2].load() << " / " << lodInstanceCounts[3].load()
+        << " instances at 1x / 2x / 4x / 8x";
+
+    std::vector<std::int64_t> frameNanoseconds;
+    {
+        const std::lock_guard lock{_frameTimeMutex};
+        frameNanoseconds = std::exchange(_frameNanoseconds, {});
+    }
+    if (!frameNanoseconds.empty()) {
+        std::ranges::sort(frameNanoseconds);
+        const auto percentile{[&frameNanoseconds](const std::size_t percent) {
+            return toMilliseconds(frameNanoseconds[(frameNanoseconds.size() - 1) * percent / 100]);
+        }};
+        qInfo().noquote().nospace()
+            << "Frame time: p50 " << percentile(50) << " ms, p95 " << percentile(95)
+            << " ms, p99 " << percentile(99) << " ms, max " << percentile(100) << " ms";
+    }
+
+    // Rounded down to whole counts per frame
+    const auto frames{std::max(frameCount.exchange(0), std::int64_t{1})};
+    qInfo().noquote().nospace() << "Block face draws: " << blockFaceDrawCount.exchange(0) / frames
+                                << " draw calls, " << drawnInstanceCount.exchange(0) / frames
+                                << " instances, "
+                                << blockFaceVertexArrayBindCount.exchange(0) / frames
+                                << " vertex array binds, "
+                                << blockFaceAttributePointerUpdateCount.exchange(0) / frames
+                                << " attribute pointer updates, "
+                                << shadowChunkDrawCount.exchange(0) / frames
+                                << " shadow chunk draws per frame";
+    const auto gpuSampleCount{shadowGpuSampleCount.exchange(0)};
+    const auto gpuNanoseconds{shadowGpuNanoseconds.exchange(0)};
+    qInfo().noquote().nospace()
+        << "Shadow map updates: " << shadowRegionCount.exchange(0) / frames << " regions, "
+        << shadowTexelCount.exchange(0) / frames << " texels, "
+        << shadowPassCount.exchange(0) / frames << " passes per frame, "
+        << toMilliseconds(shadowSubmissionNanoseconds.exchange(0) / frames) << " ms CPU, "
+        << (gpuSampleCount > 0 ? toMilliseconds(gpuNanoseconds / gpuSampleCount) : 0.0)
+        << " ms GPU per frame";
+    const auto lightingSampleCount{lightingGpuSampleCount.exchange(0)};
+    const auto lightingNanoseconds{lightingGpuNanoseconds.exchange(0)};
+    qInfo().noquote().nospace()
+        << "Lighting pass: "
+        << (lightingSampleCount > 0 ? toMilliseconds(lightingNanoseconds / lightingSampleCount)
+                                    : 0.0)
+        << " ms GPU per frame, "
+        << static_cast<double>(geometryBufferBytes.load()) / (1024.0 * 1024.0)
+        << " MiB of geometry buffers";
+}
+
+} // namespace minecraft
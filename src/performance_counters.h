@@ -0,0 +1,128 @@
+#ifndef MINECRAFT_PERFORMANCE_COUNTERS_H
+#define MINECRAFT_PERFORMANCE_COUNTERS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace minecraft {
+
+// Counters for diagnosing the performance of terrain processing and rendering. They may be updated
+// from worker threads, so all of them are atomic. Counters are accumulated between two calls to
+// log(), while gauges hold the latest measured value. Frame times are recorded separately to log
+// their percentiles.
+class PerformanceCounters
+{
+public:
+    static PerformanceCounters &instance()
+    {
+        static PerformanceCounters counters;
+        return counters;
+    }
+
+    // Prints the counters and resets the accumulated ones.
+    void log();
+
+    // Block storage residency
+    std::atomic<std::int64_t> residentChunkCount{0};   // Gauge
+    std::atomic<std::int64_t> compressedChunkCount{0}; // Gauge
+    std::atomic<std::int64_t> blockStorageBytes{0};    // Gauge
+    std::atomic<std::int64_t> chunkCompressionCount{0};
+    std::atomic<std::int64_t> chunkDecompressionCount{0};
+    std::atomic<std::int64_t> chunkDecompressionNanoseconds{0};
+    std::atomic<std::int64_t> maxChunkDecompressionNanoseconds{0};
+    std::atomic<std::int64_t> blockCopyOnWriteCount{0};
+
+    // Block face generation
+    std::atomic<std::int64_t> blockFaceGenerationCount{0};
+    std::atomic<std::int64_t> blockFaceGenerationNanoseconds{0};
+    std::atomic<std::int64_t> maxBlockFaceGenerationNanoseconds{0};
+    std::atomic<std::int64_t> meshedLayerCount{0};
+    std::atomic<std::int64_t> generatedBlockFaceCount{0};
+    std::atomic<std::int64_t> uploadedInstanceCount{0};
+    std::atomic<std::int64_t> queuedBlockFaceGenerationCount{0}; // Gauge
+
+    // Block face uploads
+    std::atomic<std::int64_t> uploadedChunkCount{0};
+    std::atomic<std::int64_t> uploadedBytes{0};
+    std::atomic<std::int64_t> uploadNanoseconds{0};
+    std::atomic<std::int64_t> maxUploadNanoseconds{0};
+    std::atomic<std::int64_t> deferredUploadCount{0}; // Gauge
+
+    // Block faces written to staging buffers by the upload thread
+    std::atomic<std::int64_t> stagedChunkCount{0};
+    std::atomic<std::int64_t> stagedBytes{0};
+    std::atomic<std::int64_t> stagingNanoseconds{0};
+    // Chunks staged in buffers given back by the render thread rather than new ones
+    std::atomic<std::int64_t> recycledStagingBufferCount{0};
+
+    // Block face cache, counted in sections. Hits include those read from disk, and the meshing
+    // time of misses estimates the time saved by hits.
+    std::atomic<std::int64_t> blockFaceCacheHitCount{0};
+    std::atomic<std::int64_t> blockFaceCacheDiskHitCount{0};
+    std::atomic<std::int64_t> blockFaceCacheMissCount{0};
+    std::atomic<std::int64_t> blockFaceCacheMissNanoseconds{0};
+    std::atomic<std::int64_t> blockFaceCacheBytes{0};     // Gauge
+    std::atomic<std::int64_t> blockFaceCacheDiskBytes{0}; // Gauge
+
+    // Block face arena, in instances
+    std::atomic<std::int64_t> blockFaceArenaCapacity{0};         // Gauge
+    std::atomic<std::int64_t> blockFaceArenaUsedCount{0};        // Gauge
+    std::atomic<std::int64_t> blockFaceArenaFreeRangeCount{0};   // Gauge
+    std::atomic<std::int64_t> blockFaceArenaLargestFreeRange{0}; // Gauge
+    std::atomic<std::int64_t> blockFaceArenaReallocationCount{0};
+
+    // Number of drawn chunks and their block faces at LOD scales 1, 2, 4, and 8
+    std::array<std::atomic<std::int64_t>, 4> lodChunkCounts{};    // Gauges
+    std::array<std::atomic<std::int64_t>, 4> lodInstanceCounts{}; // Gauges
+
+    // Block face drawing
+    std::atomic<std::int64_t> blockFaceDrawCount{0};
+    std::atomic<std::int64_t> blockFaceVertexArrayBindCount{0};
+    // Draws that moved the attribute pointers to another first instance
+    std::atomic<std::int64_t> blockFaceAttributePointerUpdateCount{0};
+    std::atomic<std::int64_t> drawnInstanceCount{0};
+    // Chunks drawn into the shadow map, summed over the cascades
+    std::atomic<std::int64_t> shadowChunkDrawCount{0};
+    // Shadow map regions and texels rendered, summed over the cascades
+    std::atomic<std::int64_t> shadowRegionCount{0};
+    std::atomic<std::int64_t> shadowTexelCount{0};
+    // Chunk list submissions, one per region per cascade, or one per layered pass
+    std::atomic<std::int64_t> shadowPassCount{0};
+    std::atomic<std::int64_t> shadowSubmissionNanoseconds{0};
+    // GPU time of the shadow map passes, measured in some of the frames
+    std::atomic<std::int64_t> shadowGpuNanoseconds{0};
+    std::atomic<std::int64_t> shadowGpuSampleCount{0};
+    // GPU time of the lighting pass, measured in some of the frames
+    std::atomic<std::int64_t> lightingGpuNanoseconds{0};
+    std::atomic<std::int64_t> lightingGpuSampleCount{0};
+    // Size of the four geometry framebuffers, which the lighting pass reads
+    std::atomic<std::int64_t> geometryBufferBytes{0}; // Gauge
+    std::atomic<std::int64_t> frameCount{0};
+
+    // Records the CPU time spent on a frame.
+    void recordFrameTime(const std::int64_t nanoseconds)
+    {
+        const std::lock_guard lock{_frameTimeMutex};
+        _frameNanoseconds.push_back(nanoseconds);
+    }
+
+    static void updateMax(std::atomic<std::int64_t> &counter, const std::int64_t value)
+    {
+        auto current{counter.load(std::memory_order_relaxed)};
+        while (value > current
+               && !counter.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+private:
+    PerformanceCounters() = default;
+
+    std::mutex _frameTimeMutex;
+    std::vector<std::int64_t> _frameNanoseconds;
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_PERFORMANCE_COUNTERS_H
@@ -203,7 +203,8 @@ void PlayerController::mousePressEvent(const QMouseEvent *const event, Terrain &
         return;
     }
     terrain.setBlockAtGlobal(hitPosition, determineNewBlockType(terrain, hitPosition));
-    terrain.getChunk(glm::ivec2{hitPosition.x, hitPosition.z})->markSelfAndNeighborsDirty();
+    // Only the sections around the block need new block faces.
+    terrain.markBlockDirtyAtGlobal(hitPosition);
 }
 
 } // namespace minecraft
@@ -0,0 +1,111 @@
+#include "range_allocator.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace minecraft {
+
+int RangeAllocator::allocate(const int count)
+{
+    // Take the smallest free range that fits, so that large ranges are kept for large allocations.
+    const auto bySizeIt{_freeRangesBySize.lower_bound({count, 0})};
+    if (bySizeIt == _freeRangesBySize.end()) {
+        return -1;
+    }
+    const auto [freeCount, first]{*bySizeIt};
+    removeFreeRange(_freeRanges.find(first));
+    if (freeCount > count) {
+        addFreeRange(first + count, freeCount - count);
+    }
+
+    int allocation;
+    if (_freeAllocations.empty()) {
+        allocation = static_cast<int>(_allocations.size());
+        _allocations.emplace_back();
+    } else {
+        allocation = _freeAllocations.back();
+        _freeAllocations.pop_back();
+    }
+    _allocations[allocation] = {
+        .first = first,
+        .count = count,
+    };
+    _usedCount += count;
+    return allocation;
+}
+
+void RangeAllocator::free(const int allocation)
+{
+    auto [first, count]{_allocations[allocation]};
+    _allocations[allocation] = {};
+    _freeAllocations.push_back(allocation);
+    _usedCount -= count;
+
+    // Merge the range with the free ranges right before and after it.
+    if (const auto nextIt{_freeRanges.find(first + count)}; nextIt != _freeRanges.end()) {
+        count += nextIt->second;
+        removeFreeRange(nextIt);
+    }
+    if (const auto nextIt{_freeRanges.lower_bound(first)}; nextIt != _freeRanges.begin()) {
+        if (const auto previousIt{std::prev(nextIt)};
+            previousIt->first + previousIt->second == first) {
+            first = previousIt->first;
+            count += previousIt->second;
+            removeFreeRange(previousIt);
+        }
+    }
+    addFreeRange(first, count);
+}
+
+std::vector<RangeAllocator::Move> RangeAllocator::pack(const int count)
+{
+    // Leave a quarter of the buffer free, so that it is not packed again soon.
+    auto capacity{std::max(_capacity, _minCapacity)};
+    while (_usedCount + count > capacity / 4 * 3) {
+        capacity *= 2;
+    }
+
+    std::vector<Move> moves;
+    auto first{0};
+    for (auto &allocation : _allocations) {
+        if (allocation.count == 0) {
+            continue;
+        }
+        moves.push_back({
+            .sourceFirst = allocation.first,
+            .destinationFirst = first,
+            .count = allocation.count,
+        });
+        allocation.first = first;
+        first += allocation.count;
+    }
+    _capacity = capacity;
+    _freeRanges.clear();
+    _freeRangesBySize.clear();
+    addFreeRange(first, capacity - first);
+    return moves;
+}
+
+void RangeAllocator::clear()
+{
+    _capacity = 0;
+    _allocations.clear();
+    _freeAllocations.clear();
+    _freeRanges.clear();
+    _freeRangesBySize.clear();
+    _usedCount = 0;
+}
+
+void RangeAllocator::addFreeRange(const int first, const int count)
+{
+    _freeRanges.emplace(first, count);
+    _freeRangesBySize.emplace(count, first);
+}
+
+void RangeAllocator::removeFreeRange(const std::map<int, int>::iterator it)
+{
+    _freeRangesBySize.erase({it->second, it->first});
+    _freeRanges.erase(it);
+}
+
+} // namespace minecraft
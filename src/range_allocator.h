@@ -0,0 +1,90 @@
+#ifndef MINECRAFT_RANGE_ALLOCATOR_H
+#define MINECRAFT_RANGE_ALLOCATOR_H
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace minecraft {
+
+// Bookkeeping of ranges allocated from a buffer of elements, without the buffer itself. Free ranges
+// are indexed by size for best-fit allocation and by position for merging neighbors. When no free
+// range is large enough, the owner of the buffer packs all allocations at its start, which removes
+// the fragmentation, and grows it if it would be more than 3/4 full.
+class RangeAllocator
+{
+public:
+    // A range of elements to copy when the allocations are packed
+    struct Move
+    {
+        int sourceFirst;
+        int destinationFirst;
+        int count;
+    };
+
+    explicit RangeAllocator(const int minCapacity)
+        : _minCapacity{minCapacity}
+        , _capacity{0}
+        , _allocations{}
+        , _freeAllocations{}
+        , _freeRanges{}
+        , _freeRangesBySize{}
+        , _usedCount{0}
+    {}
+
+    // Returns the ID of a new allocation of count elements, which must be positive, or -1 if no
+    // free range is large enough.
+    int allocate(const int count);
+
+    void free(const int allocation);
+
+    int first(const int allocation) const { return _allocations[allocation].first; }
+
+    int count(const int allocation) const { return _allocations[allocation].count; }
+
+    // Packs the allocations at the start of the buffer, and grows it until another count elements
+    // fit with a quarter of it left free. Returns the moves to apply to the contents, whose sources
+    // are in the old buffer and destinations in the new one.
+    std::vector<Move> pack(const int count);
+
+    // Frees all allocations and drops the buffer.
+    void clear();
+
+    int capacity() const { return _capacity; }
+
+    int usedCount() const { return _usedCount; }
+
+    std::size_t freeRangeCount() const { return _freeRanges.size(); }
+
+    int largestFreeRange() const
+    {
+        return _freeRangesBySize.empty() ? 0 : _freeRangesBySize.rbegin()->first;
+    }
+
+private:
+    struct Allocation
+    {
+        int first;
+        int count;
+    };
+
+    void addFreeRange(const int first, const int count);
+    void removeFreeRange(const std::map<int, int>::iterator it);
+
+    int _minCapacity;
+    int _capacity;
+    // Indexed by allocation IDs, which are reused once freed
+    std::vector<Allocation> _allocations;
+    std::vector<int> _freeAllocations;
+    // First elements and counts of the free ranges
+    std::map<int, int> _freeRanges;
+    // The same free ranges as (count, first) pairs, ordered by size and then by position
+    std::set<std::pair<int, int>> _freeRangesBySize;
+    int _usedCount;
+};
+
+} // namespace minecraft
+
+#endif // MINECRAFT_RANGE_ALLOCATOR_H
@@ -7,12 +7,26 @@
 
 namespace minecraft {
 
+// Quality tiers of the lighting shader, each of which is compiled into a program of its own
+enum class ShaderQuality
+{
+    Low,
+    Medium,
+    High,
+};
+
+constexpr int ShaderQualityCount{3};
+
 struct SceneSettingsData
 {
     float sunAltitude{30.0f};
     float sunAzimuth{60.0f};
     float waterRefractiveIndex{1.1f};
     float waterWaveAmplitudeScale{1.0f};
+    // Whether all shadow map cascades are rendered in one layered pass, or one pass each. Off until
+    // the layered pass is measured to be faster on the GPU.
+    bool isLayeredShadowRenderingEnabled{false};
+    ShaderQuality shaderQuality{ShaderQuality::Medium};
 };
 
 class SceneSettings
@@ -16,6 +16,8 @@ SceneSettingsWindow::SceneSettingsWindow(SceneSettings *const settings, QWidget
     , _sunAzimuthSpinBox{nullptr}
     , _waterRefractiveIndexSpinBox{nullptr}
     , _waterWaveAmplitudeScaleSpinBox{nullptr}
+    , _layeredShadowRenderingCheckBox{nullptr}
+    , _shaderQualityComboBox{nullptr}
 {
     setWindowTitle("Scene Settings");
     setWindowIcon(QIcon{":/icons/settings.ico"});
@@ -47,6 +49,14 @@ SceneSettingsWindow::SceneSettingsWindow(SceneSettings *const settings, QWidget
     _waterWaveAmplitudeScaleSpinBox->setSingleStep(0.1);
     _waterWaveAmplitudeScaleSpinBox->setValue(settingsData.waterWaveAmplitudeScale);
 
+    _layeredShadowRenderingCheckBox = new QCheckBox{};
+    _layeredShadowRenderingCheckBox->setChecked(settingsData.isLayeredShadowRenderingEnabled);
+
+    // The items are in the order of ShaderQuality.
+    _shaderQualityComboBox = new QComboBox{};
+    _shaderQualityComboBox->addItems({"Low", "Medium", "High"});
+    _shaderQualityComboBox->setCurrentIndex(static_cast<int>(settingsData.shaderQuality));
+
     const auto mainLayout{new QVBoxLayout{this}};
 
     {
@@ -55,6 +65,8 @@ SceneSettingsWindow::SceneSettingsWindow(SceneSettings *const settings, QWidget
         formLayout->addRow("Sun Azimuth", _sunAzimuthSpinBox);
         formLayout->addRow("Water Refractive Index", _waterRefractiveIndexSpinBox);
         formLayout->addRow("Water Wave Amplitude Scale", _waterWaveAmplitudeScaleSpinBox);
+        formLayout->addRow("Layered Shadow Rendering", _layeredShadowRenderingCheckBox);
+        formLayout->addRow("Shader Quality", _shaderQualityComboBox);
         mainLayout->addLayout(formLayout);
     }
 
@@ -69,6 +81,14 @@ SceneSettingsWindow::SceneSettingsWindow(SceneSettings *const settings, QWidget
          }) {
         connect(spinBox, &QDoubleSpinBox::valueChanged, this, &SceneSettingsWindow::updateSettings);
     };
+    connect(_layeredShadowRenderingCheckBox,
+            &QCheckBox::toggled,
+            this,
+            &SceneSettingsWindow::updateSettings);
+    connect(_shaderQualityComboBox,
+            &QComboBox::currentIndexChanged,
+            this,
+            &SceneSettingsWindow::updateSettings);
 
     connect(resetButton, &QPushButton::clicked, this, &SceneSettingsWindow::resetSettings);
 }
@@ -80,6 +100,8 @@ void SceneSettingsWindow::updateSettings()
     updatedData.sunAzimuth = _sunAzimuthSpinBox->value();
     updatedData.waterRefractiveIndex = _waterRefractiveIndexSpinBox->value();
     updatedData.waterWaveAmplitudeScale = _waterWaveAmplitudeScaleSpinBox->value();
+    updatedData.isLayeredShadowRenderingEnabled = _layeredShadowRenderingCheckBox->isChecked();
+    updatedData.shaderQuality = static_cast<ShaderQuality>(_shaderQualityComboBox->currentIndex());
     _settings->set(updatedData);
 }
 
@@ -90,6 +112,8 @@ void SceneSettingsWindow::resetSettings()
     _sunAzimuthSpinBox->setValue(defaultData.sunAzimuth);
     _waterRefractiveIndexSpinBox->setValue(defaultData.waterRefractiveIndex);
     _waterWaveAmplitudeScaleSpinBox->setValue(defaultData.waterWaveAmplitudeScale);
+    _layeredShadowRenderingCheckBox->setChecked(defaultData.isLayeredShadowRenderingEnabled);
+    _shaderQualityComboBox->setCurrentIndex(static_cast<int>(defaultData.shaderQuality));
     _settings->set(defaultData);
 }
 
@@ -3,6 +3,8 @@
 
 #include "scene_settings.h"
 
+#include <QCheckBox>
+#include <QComboBox>
 #include <QDoubleSpinBox>
 #include <QWidget>
 
@@ -27,6 +29,8 @@ private:
     QDoubleSpinBox *_sunAzimuthSpinBox;
     QDoubleSpinBox *_waterRefractiveIndexSpinBox;
     QDoubleSpinBox *_waterWaveAmplitudeScaleSpinBox;
+    QCheckBox *_layeredShadowRenderingCheckBox;
+    QComboBox *_shaderQualityComboBox;
 };
 
 } // namespace minecraft
@@ -1,35 +1,74 @@
 #include "shader_program.h"
 
+#include "constants.h"
 #include "scope_guard.h"
 
 #include <QFile>
 
+#include <ranges>
+#include <utility>
 #include <vector>
 
 namespace minecraft {
 
-void ShaderProgram::create(const QString &vertexShaderFileName,
-                           const QString &fragmentShaderFileName)
+namespace {
+
+// Returns the #define directives of the definitions that every shader shares with the C++ code,
+// so that they have one source, followed by those of the permutation. The #line directive keeps
+// the line numbers of the shader file in compile errors.
+QByteArray getDefinitionDirectives(const ShaderDefinitions &definitions)
 {
-    const auto context{OpenGLContext::instance()};
+    QByteArray directives;
+    const auto define{[&directives](const QByteArray &name, const int value) {
+        directives.append("#define ");
+        directives.append(name);
+        directives.append(" ");
+        directives.append(QByteArray::number(value));
+        directives.append("\n");
+    }};
+    define("ShadowMapCascadeCount", ShadowMapCascadeCount);
+    define("ShadowMapNearCascadeCount", ShadowMapNearCascadeCount);
+    for (const auto &[name, value] : definitions) {
+        define(name, value);
+    }
+    directives.append("#line 2\n");
+    return directives;
+}
 
-    OpenGLObject vertexShader;
-    OpenGLObject fragmentShader;
-    {
-        const auto shaderDeleter{[](OpenGLContext *const context, const GLuint shader) {
-            context->glDeleteShader(shader);
-        }};
+} // namespace
 
-        vertexShader = OpenGLObject{context->glCreateShader(GL_VERTEX_SHADER), shaderDeleter};
-        context->checkError();
-        if (!vertexShader) {
-            qFatal() << "Failed to create vertex shader";
-        }
+void ShaderProgram::create(const QString &vertexShaderFileName,
+                           const QString &fragmentShaderFileName,
+                           const ShaderDefinitions &definitions)
+{
+    create(vertexShaderFileName, QString{}, fragmentShaderFileName, definitions);
+}
 
-        fragmentShader = OpenGLObject{context->glCreateShader(GL_FRAGMENT_SHADER), shaderDeleter};
+void ShaderProgram::create(const QString &vertexShaderFileName,
+                           const QString &geometryShaderFileName,
+                           const QString &fragmentShaderFileName,
+                           const ShaderDefinitions &definitions)
+{
+    const auto context{OpenGLContext::instance()};
+
+    // Shaders are attached in this order, and the geometry shader is optional.
+    std::vector<std::pair<GLenum, QString>> shaderFileNames{
+        {GL_VERTEX_SHADER, vertexShaderFileName},
+    };
+    if (!geometryShaderFileName.isEmpty()) {
+        shaderFileNames.emplace_back(GL_GEOMETRY_SHADER, geometryShaderFileName);
+    }
+    shaderFileNames.emplace_back(GL_FRAGMENT_SHADER, fragmentShaderFileName);
+
+    std::vector<OpenGLObject> shaders;
+    for (const auto &[type, _] : shaderFileNames) {
+        shaders.emplace_back(context->glCreateShader(type),
+                             [](OpenGLContext *const context, const GLuint shader) {
+                                 context->glDeleteShader(shader);
+                             });
         context->checkError();
-        if (!fragmentShader) {
-            qFatal() << "Failed to create fragment shader";
+        if (!shaders.back()) {
+            qFatal() << "Failed to create shader of type" << type;
         }
     }
 
@@ -44,24 +83,20 @@ void ShaderProgram::create(const QString &vertexShaderFileName,
         qFatal() << "Failed to create shader program";
     }
 
-    compileShader(vertexShader.get(), vertexShaderFileName);
-    compileShader(fragmentShader.get(), fragmentShaderFileName);
-
-    context->glAttachShader(_program.get(), vertexShader.get());
-    context->checkError();
-    context->glAttachShader(_program.get(), fragmentShader.get());
-    context->checkError();
+    const auto definitionDirectives{getDefinitionDirectives(definitions)};
+    for (const auto i : std::views::iota(std::size_t{0}, shaders.size())) {
+        compileShader(shaders[i].get(), shaderFileNames[i].second, definitionDirectives);
+        context->glAttachShader(_program.get(), shaders[i].get());
+        context->checkError();
+    }
     context->glLinkProgram(_program.get());
     context->checkError();
 
-    const ScopeGuard guard{[context,
-                            program{_program.get()},
-                            vertexShader{vertexShader.get()},
-                            fragmentShader{fragmentShader.get()}]() {
-        context->glDetachShader(program, vertexShader);
-        context->checkError();
-        context->glDetachShader(program, fragmentShader);
-        context->checkError();
+    const ScopeGuard guard{[context, program{_program.get()}, &shaders]() {
+        for (const auto &shader : shaders) {
+            context->glDetachShader(program, shader.get());
+            context->checkError();
+        }
     }};
 
     GLint linkStatus{GL_FALSE};
@@ -99,10 +134,12 @@ void ShaderProgram::bindUniformBlock(const QString &name, const GLuint bindingPo
     context->checkError();
 }
 
-void ShaderProgram::compileShader(const GLuint shader, const QString &fileName) const
+void ShaderProgram::compileShader(const GLuint shader,
+                                  const QString &fileName,
+                                  const QByteArray &definitions) const
 {
-    // The source code are in multiple strings, starting with the version string, followed by one
-    // string per .glsl file.
+    // The source code is in three strings: the #version directive, which must come first, the
+    // definitions, and the rest of the preprocessed file.
 
     QFile file{fileName};
     if (!file.open(QFile::ReadOnly)) {
@@ -115,8 +152,18 @@ void ShaderProgram::compileShader(const GLuint shader, const QString &fileName)
 
     const auto context{OpenGLContext::instance()};
 
-    const auto sourceData{fileData.constData()};
-    context->glShaderSource(shader, 1, &sourceData, nullptr);
+    const auto versionLength{static_cast<GLint>(fileData.indexOf('\n') + 1)};
+    const GLchar *const sources[3]{
+        fileData.constData(),
+        definitions.constData(),
+        fileData.constData() + versionLength,
+    };
+    const GLint sourceLengths[3]{
+        versionLength,
+        static_cast<GLint>(definitions.size()),
+        static_cast<GLint>(fileData.size()) - versionLength,
+    };
+    context->glShaderSource(shader, 3, sources, sourceLengths);
     context->checkError();
     context->glCompileShader(shader);
     context->checkError();
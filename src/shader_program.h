@@ -6,13 +6,20 @@
 
 #include <glm/glm.hpp>
 
+#include <QByteArray>
 #include <QString>
 
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace minecraft {
 
+// Preprocessor definitions that select a permutation of a shader program. They are defined in
+// every shader of the program, after the definitions shared with the C++ code.
+using ShaderDefinitions = std::vector<std::pair<QByteArray, int>>;
+
 class ShaderProgram
 {
 public:
@@ -27,7 +34,14 @@ public:
     ShaderProgram &operator=(const ShaderProgram &) = delete;
     ShaderProgram &operator=(ShaderProgram &&) = delete;
 
-    void create(const QString &vertexShaderFileName, const QString &fragmentShaderFileName);
+    void create(const QString &vertexShaderFileName,
+                const QString &fragmentShaderFileName,
+                const ShaderDefinitions &definitions = {});
+
+    void create(const QString &vertexShaderFileName,
+                const QString &geometryShaderFileName,
+                const QString &fragmentShaderFileName,
+                const ShaderDefinitions &definitions = {});
 
     void use() const
     {
@@ -46,6 +60,8 @@ public:
             context->glUniform1i(location, value);
         } else if constexpr (std::is_same_v<T, GLfloat>) {
             context->glUniform1f(location, value);
+        } else if constexpr (std::is_same_v<T, glm::ivec2>) {
+            context->glUniform2i(location, value[0], value[1]);
         } else if constexpr (std::is_same_v<T, glm::vec3>) {
             context->glUniform3f(location, value[0], value[1], value[2]);
         } else if constexpr (std::is_same_v<T, glm::mat4>) {
@@ -80,7 +96,9 @@ private:
     template<typename T>
     static constexpr auto DependentFalse{false};
 
-    void compileShader(const GLuint shader, const QString &fileName) const;
+    void compileShader(const GLuint shader,
+                       const QString &fileName,
+                       const QByteArray &definitions) const;
 
     GLuint getUniformLocation(const QString &name);
 
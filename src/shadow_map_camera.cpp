@@ -6,91 +6,310 @@
 #include <cmath>
 #include <limits>
 #include <ranges>
+#include <utility>
 
 namespace minecraft {
 
+namespace {
+
+int floorMod(const int value, const int divisor)
+{
+    return (value % divisor + divisor) % divisor;
+}
+
+glm::ivec2 floorMod(const glm::ivec2 &value, const int divisor)
+{
+    return {floorMod(value.x, divisor), floorMod(value.y, divisor)};
+}
+
+bool isEmpty(const ShadowMapRegion &region)
+{
+    return glm::any(glm::greaterThanEqual(region.minTexel, region.maxTexel));
+}
+
+ShadowMapRegion intersect(const ShadowMapRegion &a, const ShadowMapRegion &b)
+{
+    return {glm::max(a.minTexel, b.minTexel), glm::min(a.maxTexel, b.maxTexel)};
+}
+
+// Returns the bounding box of the transformed box, which is centered at the transformed center and
+// has the box extents projected onto the axes of the new space.
+AlignedBox3D transformBox(const glm::mat4 &matrix, const AlignedBox3D &box)
+{
+    const auto center{(box.minPoint() + box.maxPoint()) * 0.5f};
+    const auto halfExtent{(box.maxPoint() - box.minPoint()) * 0.5f};
+    const glm::vec3 transformedCenter{matrix * glm::vec4{center, 1.0f}};
+    const auto transformedHalfExtent{glm::abs(glm::vec3{matrix[0]}) * halfExtent.x
+                                     + glm::abs(glm::vec3{matrix[1]}) * halfExtent.y
+                                     + glm::abs(glm::vec3{matrix[2]}) * halfExtent.z};
+    return {transformedCenter - transformedHalfExtent, transformedCenter + transformedHalfExtent};
+}
+
+} // namespace
+
 void ShadowMapCamera::update(const glm::vec3 &lightDirection, const Camera &camera)
 {
-    std::array<float, ShadowMapCascadeCount + 1> ClipSpaceZSplits;
-    ClipSpaceZSplits.front() = -1.0f;
-    ClipSpaceZSplits.back() = 1.0f;
+    ++_frameIndex;
+
+    // The light space only depends on the light direction, so the cached cascades stay valid until
+    // it changes. The light direction vector points towards the light source.
+    if (lightDirection != _lightDirection) {
+        _lightDirection = lightDirection;
+        _lightViewMatrix = glm::lookAt(glm::vec3{0.0f},
+                                       -lightDirection,
+                                       glm::vec3{0.0f, 1.0f, 0.0f});
+        for (auto &cascade : _cascades) {
+            cascade.isValid = false;
+        }
+    }
+
+    // Logarithmic split scheme:
+    // https://computergraphics.stackexchange.com/questions/13026/cascaded-shadow-mapping-csm-partitioning-the-frustum-to-a-nearly-1-by-1-mappi
+    std::array<float, ShadowMapCascadeCount + 1> zSplits;
     {
-        // Logarithmic split scheme:
-        // https://computergraphics.stackexchange.com/questions/13026/cascaded-shadow-mapping-csm-partitioning-the-frustum-to-a-nearly-1-by-1-mappi
         const auto zRatio{camera.far() / camera.near()};
-        for (const auto cascadeIndex : std::views::iota(1, ShadowMapCascadeCount)) {
+        for (const auto cascadeIndex : std::views::iota(0, ShadowMapCascadeCount + 1)) {
             const auto splitRatio{static_cast<float>(cascadeIndex)
                                   / static_cast<float>(ShadowMapCascadeCount)};
-            const auto zSplit{camera.near() * std::pow(zRatio, splitRatio)};
-            const glm::vec4 viewSpaceSplit{0.0f, 0.0f, -zSplit, 1.0f};
-            const auto clipSpaceSplit{camera.projectionMatrix() * viewSpaceSplit};
-            ClipSpaceZSplits[cascadeIndex] = clipSpaceSplit.z / clipSpaceSplit.w;
+            zSplits[cascadeIndex] = camera.near() * std::pow(zRatio, splitRatio);
         }
     }
 
-    // Start with this view matrix and adjust it later for each cascade.
-    // The light direction vector points towards the light source.
+    const auto viewMatrixInverse{glm::inverse(camera.viewMatrix())};
     const auto &cameraPosition{camera.pose().position()};
-    const auto baseShadowViewMatrix{
-        glm::lookAt(cameraPosition, cameraPosition - lightDirection, glm::vec3{0.0f, 1.0f, 0.0f})};
-
-    const auto viewProjectionMatrixInverse{glm::inverse(camera.viewProjectionMatrix())};
+    const auto forward{-glm::vec3{viewMatrixInverse[2]}};
+    // Slopes of the frustum edges along the X and Y axes of the view space
+    const auto &projectionMatrix{camera.projectionMatrix()};
+    const glm::vec2 slopes{1.0f / projectionMatrix[0][0], 1.0f / projectionMatrix[1][1]};
 
     for (const auto cascadeIndex : std::views::iota(0, ShadowMapCascadeCount)) {
+        const auto nearZ{zSplits[cascadeIndex]};
+        const auto farZ{zSplits[cascadeIndex + 1]};
+
+        // The bounding sphere of the part of the frustum does not change with the camera pose, so
+        // the size of the texels stays the same while the camera moves. A margin of one block is
+        // added as before.
+        const auto centerZ{(nearZ + farZ) * 0.5f};
+        const auto getCornerDistanceSquared{[&slopes, centerZ](const float z) {
+            return glm::dot(slopes * z, slopes * z) + (z - centerZ) * (z - centerZ);
+        }};
+        const auto radius{
+            std::sqrt(std::max(getCornerDistanceSquared(nearZ), getCornerDistanceSquared(farZ)))
+            + 1.0f};
+        const auto size{getShadowMapSize(cascadeIndex)};
+        const auto texelSize{2.0f * radius / static_cast<float>(size)};
+        const glm::vec3 lightSpaceCenter{_lightViewMatrix
+                                         * glm::vec4{cameraPosition + forward * centerZ, 1.0f}};
+
+        // Light space bounds of the part of the frustum, which may still be inside a window that
+        // has not moved
         constexpr auto Infinity{std::numeric_limits<float>::infinity()};
-        glm::vec3 minPoint{Infinity};
-        glm::vec3 maxPoint{-Infinity};
-
-        for (const auto clipSpaceX : {-1.0f, 1.0f}) {
-            for (const auto clipSpaceY : {-1.0f, 1.0f}) {
-                for (const auto clipSpaceZ : {
-                         ClipSpaceZSplits[cascadeIndex],
-                         ClipSpaceZSplits[cascadeIndex + 1],
-                     }) {
-                    const auto worldSpacePoint{
-                        viewProjectionMatrixInverse
-                        * glm::vec4{clipSpaceX, clipSpaceY, clipSpaceZ, 1.0f}};
-                    const auto shadowViewSpacePoint{
-                        glm::vec3{baseShadowViewMatrix * (worldSpacePoint / worldSpacePoint.w)}};
-                    minPoint = glm::min(minPoint, shadowViewSpacePoint);
-                    maxPoint = glm::max(maxPoint, shadowViewSpacePoint);
+        glm::vec2 minPoint{Infinity};
+        glm::vec2 maxPoint{-Infinity};
+        for (const auto z : {nearZ, farZ}) {
+            for (const auto x : {-1.0f, 1.0f}) {
+                for (const auto y : {-1.0f, 1.0f}) {
+                    const glm::vec4 viewSpacePoint{glm::vec2{x, y} * slopes * z, -z, 1.0f};
+                    const glm::vec2 lightSpacePoint{_lightViewMatrix * viewMatrixInverse
+                                                    * viewSpacePoint};
+                    minPoint = glm::min(minPoint, lightSpacePoint);
+                    maxPoint = glm::max(maxPoint, lightSpacePoint);
                 }
             }
         }
 
-        // Add a small margin to the bounding box.
-        minPoint -= 1.0f;
-        maxPoint += 1.0f;
-
-        // Rescale the Z dimension to fit shadow-casting objects outside the camera's view frustum.
-        // This does not have a large impact on the shadow map's precision as another unscaled depth
-        // buffer is used for shadow mapping.
-        {
-            const auto middleZ{(minPoint.z + maxPoint.z) * 0.5f};
-            const auto halfZScale{std::max((maxPoint.z - minPoint.z) * 0.5f, 128.0f)};
-            minPoint.z = middleZ - halfZScale;
-            maxPoint.z = middleZ + halfZScale;
+        // Fit shadow-casting objects outside the camera's view frustum in the depth range. It
+        // does not have a large impact on the shadow map's precision as another unscaled depth
+        // buffer is used for shadow mapping. The near plane is kept while the camera moves a
+        // little along the light direction, since depths are relative to it.
+        const auto halfDepth{std::max(radius, 128.0f)};
+        const auto minNearPlaneZ{lightSpaceCenter.z + halfDepth};
+        const auto windowMinTexel{glm::ivec2{glm::round(glm::vec2{lightSpaceCenter} / texelSize)}
+                                  - size / 2};
+
+        auto &cascade{_cascades[cascadeIndex]};
+        if (!cascade.isValid || cascade.texelSize != texelSize
+            || cascade.nearPlaneZ < minNearPlaneZ
+            || cascade.nearPlaneZ > minNearPlaneZ + DepthSlack) {
+            cascade.isValid = true;
+            cascade.isUpdated = true;
+            cascade.texelSize = texelSize;
+            cascade.windowMinTexel = windowMinTexel;
+            cascade.nearPlaneZ = minNearPlaneZ + DepthSlack * 0.5f;
+            cascade.depthRange = halfDepth * 2.0f + DepthSlack;
+            cascade.staleRegions.assign(1, getWindow(cascadeIndex));
+        } else {
+            // Far cascades cover large areas and move less often.
+            const auto windowMin{glm::vec2{cascade.windowMinTexel} * texelSize};
+            const auto windowMax{glm::vec2{cascade.windowMinTexel + size} * texelSize};
+            const auto isCovered{glm::all(glm::greaterThanEqual(minPoint, windowMin))
+                                 && glm::all(glm::lessThanEqual(maxPoint, windowMax))};
+            const auto updateInterval{std::uint64_t{1} << std::max(cascadeIndex - 1, 0)};
+            cascade.isUpdated = !isCovered
+                                || (_frameIndex + static_cast<std::uint64_t>(cascadeIndex))
+                                           % updateInterval
+                                       == 0;
+            if (cascade.isUpdated && windowMinTexel != cascade.windowMinTexel) {
+                moveWindow(cascadeIndex, windowMinTexel);
+            }
+        }
+
+        // Use orthographic projection so that the depth is linear. The view space Z is negative
+        // below the near plane.
+        cascade.viewMatrix = glm::translate(glm::mat4{1.0f},
+                                            glm::vec3{0.0f, 0.0f, -cascade.nearPlaneZ})
+                             * _lightViewMatrix;
+        cascade.projectionMatrix = getRegionProjectionMatrix(cascadeIndex, getWindow(cascadeIndex));
+    }
+}
+
+void ShadowMapCamera::invalidate(const AlignedBox3D &box)
+{
+    // Orthographic shadows fall right below the box along the light direction.
+    const auto lightSpaceBox{transformBox(_lightViewMatrix, box)};
+    for (const auto cascadeIndex : std::views::iota(0, ShadowMapCascadeCount)) {
+        const auto &cascade{_cascades[cascadeIndex]};
+        if (!cascade.isValid) {
+            continue;
+        }
+        // Texels next to the box are filtered with those under it.
+        const ShadowMapRegion region{
+            glm::ivec2{glm::floor(glm::vec2{lightSpaceBox.minPoint()} / cascade.texelSize)} - 1,
+            glm::ivec2{glm::ceil(glm::vec2{lightSpaceBox.maxPoint()} / cascade.texelSize)} + 1,
+        };
+        if (const auto staleRegion{intersect(region, getWindow(cascadeIndex))};
+            !isEmpty(staleRegion)) {
+            addStaleRegion(cascadeIndex, staleRegion);
+        }
+    }
+}
+
+glm::vec2 ShadowMapCamera::getTextureOffset(const int cascadeIndex) const
+{
+    const auto size{getShadowMapSize(cascadeIndex)};
+    return glm::vec2{floorMod(_cascades[cascadeIndex].windowMinTexel, size)}
+           / static_cast<float>(size);
+}
+
+std::vector<ShadowMapRegion> ShadowMapCamera::takeRegionsToRender(const int cascadeIndex)
+{
+    auto &cascade{_cascades[cascadeIndex]};
+    if (!cascade.isUpdated) {
+        return {};
+    }
+    std::vector<ShadowMapRegion> regions;
+    const auto window{getWindow(cascadeIndex)};
+    const auto size{getShadowMapSize(cascadeIndex)};
+    for (const auto &staleRegion : std::exchange(cascade.staleRegions, {})) {
+        const auto region{intersect(staleRegion, window)};
+        if (isEmpty(region)) {
+            continue;
+        }
+        // Split the region where it wraps around the texture layer.
+        const auto wrapTexel{region.minTexel - floorMod(region.minTexel, size) + size};
+        const auto splitTexel{glm::min(wrapTexel, region.maxTexel)};
+        for (const auto &[minX, maxX] : {std::pair{region.minTexel.x, splitTexel.x},
+                                         std::pair{splitTexel.x, region.maxTexel.x}}) {
+            for (const auto &[minY, maxY] : {std::pair{region.minTexel.y, splitTexel.y},
+                                             std::pair{splitTexel.y, region.maxTexel.y}}) {
+                if (const ShadowMapRegion piece{{minX, minY}, {maxX, maxY}}; !isEmpty(piece)) {
+                    regions.push_back(piece);
+                }
+            }
         }
+    }
+    return regions;
+}
 
-        // Shift the Z values to ensure they are always negative.
-        auto &shadowViewMatrix{_viewMatrices[cascadeIndex]};
-        shadowViewMatrix = baseShadowViewMatrix;
-        shadowViewMatrix[3][2] -= maxPoint.z;
-        minPoint.z -= maxPoint.z;
-        maxPoint.z = 0.0f;
-
-        // Use orthographic projection so that the depth is linear. Note that near and far values
-        // have inverted signs.
-        _projectionMatrices[cascadeIndex]
-            = glm::ortho(minPoint.x, maxPoint.x, minPoint.y, maxPoint.y, -maxPoint.z, -minPoint.z);
+glm::mat4 ShadowMapCamera::getRegionViewProjectionMatrix(const int cascadeIndex,
+                                                         const ShadowMapRegion &region) const
+{
+    return getRegionProjectionMatrix(cascadeIndex, region) * _cascades[cascadeIndex].viewMatrix;
+}
+
+glm::ivec4 ShadowMapCamera::getRegionViewport(const int cascadeIndex,
+                                              const ShadowMapRegion &region) const
+{
+    return glm::ivec4{floorMod(region.minTexel, getShadowMapSize(cascadeIndex)),
+                      region.maxTexel - region.minTexel};
+}
+
+bool ShadowMapCamera::isShadowCasterInRegion(const int cascadeIndex,
+                                             const ShadowMapRegion &region,
+                                             const AlignedBox3D &box) const
+{
+    const auto &cascade{_cascades[cascadeIndex]};
+    const auto viewSpaceBox{transformBox(cascade.viewMatrix, box)};
+    const auto regionMin{glm::vec2{region.minTexel} * cascade.texelSize};
+    const auto regionMax{glm::vec2{region.maxTexel} * cascade.texelSize};
+
+    // The light is toward +Z, and casters in front of the region still shadow it, so only the far
+    // plane bounds Z.
+    return glm::all(glm::greaterThanEqual(glm::vec2{viewSpaceBox.maxPoint()}, regionMin))
+           && glm::all(glm::lessThanEqual(glm::vec2{viewSpaceBox.minPoint()}, regionMax))
+           && viewSpaceBox.maxPoint().z >= -cascade.depthRange;
+}
+
+glm::mat4 ShadowMapCamera::getRegionProjectionMatrix(const int cascadeIndex,
+                                                     const ShadowMapRegion &region) const
+{
+    const auto &cascade{_cascades[cascadeIndex]};
+    const auto regionMin{glm::vec2{region.minTexel} * cascade.texelSize};
+    const auto regionMax{glm::vec2{region.maxTexel} * cascade.texelSize};
+    // Note that near and far values have inverted signs.
+    return glm::ortho(regionMin.x, regionMax.x, regionMin.y, regionMax.y, 0.0f, cascade.depthRange);
+}
+
+void ShadowMapCamera::moveWindow(const int cascadeIndex, const glm::ivec2 &windowMinTexel)
+{
+    auto &cascade{_cascades[cascadeIndex]};
+    const auto previousWindow{getWindow(cascadeIndex)};
+    cascade.windowMinTexel = windowMinTexel;
+    const auto window{getWindow(cascadeIndex)};
+    const auto offset{window.minTexel - previousWindow.minTexel};
+    if (glm::any(
+            glm::greaterThanEqual(glm::abs(offset), glm::ivec2{getShadowMapSize(cascadeIndex)}))) {
+        cascade.staleRegions.assign(1, window);
+        return;
     }
-};
+
+    // Texels in both windows are kept, and the strips exposed along X and Y are rendered.
+    if (offset.x != 0) {
+        addStaleRegion(cascadeIndex,
+                       {
+                           {offset.x > 0 ? previousWindow.maxTexel.x : window.minTexel.x,
+                            window.minTexel.y},
+                           {offset.x > 0 ? window.maxTexel.x : previousWindow.minTexel.x,
+                            window.maxTexel.y},
+                       });
+    }
+    if (offset.y != 0) {
+        const auto kept{intersect(window, previousWindow)};
+        addStaleRegion(cascadeIndex,
+                       {
+                           {kept.minTexel.x,
+                            offset.y > 0 ? previousWindow.maxTexel.y : window.minTexel.y},
+                           {kept.maxTexel.x,
+                            offset.y > 0 ? window.maxTexel.y : previousWindow.minTexel.y},
+                       });
+    }
+}
+
+void ShadowMapCamera::addStaleRegion(const int cascadeIndex, const ShadowMapRegion &region)
+{
+    auto &staleRegions{_cascades[cascadeIndex].staleRegions};
+    if (std::ssize(staleRegions) >= MaxStaleRegionCount) {
+        staleRegions.assign(1, getWindow(cascadeIndex));
+    } else {
+        staleRegions.push_back(region);
+    }
+}
 
 glm::vec2 ShadowMapCamera::getDepthBlurScale(const int cascadeIndex) const
 {
     // In the current implementation, this scale has to be very small to avoid light bleeding.
     const glm::vec2 viewSpaceScale{0.05f};
-    const auto &projectionMatrix{_projectionMatrices[cascadeIndex]};
+    const auto &projectionMatrix{_cascades[cascadeIndex].projectionMatrix};
     const auto clipSpaceScale{viewSpaceScale
                               * glm::vec2{projectionMatrix[0][0], projectionMatrix[1][1]}};
     const auto ndcScale{clipSpaceScale * 0.5f};
@@ -1,35 +1,128 @@
 #ifndef MINECRAFT_SHADOW_MAP_CAMERA_H
 #define MINECRAFT_SHADOW_MAP_CAMERA_H
 
+#include "aligned_box_3d.h"
 #include "camera.h"
 #include "constants.h"
 
 #include <glm/glm.hpp>
 
 #include <array>
+#include <cstdint>
+#include <vector>
 
 namespace minecraft {
 
+// A rectangle [minTexel, maxTexel) of shadow map texels in the light space of a cascade. Texel
+// coordinates are absolute, so a texel keeps its coordinates while the cascade moves.
+struct ShadowMapRegion
+{
+    glm::ivec2 minTexel;
+    glm::ivec2 maxTexel;
+};
+
+// Places the shadow map cascades and decides which of their texels to render in each frame. The
+// cascades are cached across frames: each one is a window of texels that is snapped to whole texels
+// in a light space fixed by the light direction, and texel (x, y) is always stored at
+// (x mod size, y mod size) of its texture layer, where size is the resolution of the cascade. When
+// a cascade moves, the texels it already has stay valid, and only the newly exposed strips are
+// rendered. Far cascades move at a lower cadence while their windows still cover their parts of the
+// view frustum. A cascade is rendered again in full when the light direction changes, and the
+// texels under changed chunks are patched.
 class ShadowMapCamera
 {
 public:
+    ShadowMapCamera()
+        : _lightDirection{0.0f}
+        , _lightViewMatrix{1.0f}
+        , _frameIndex{0}
+        , _cascades{}
+    {}
+
     void update(const glm::vec3 &lightDirection, const Camera &camera);
 
+    // Marks the texels that the box may cast shadows on stale in all cascades.
+    void invalidate(const AlignedBox3D &box);
+
     const glm::mat4 &viewMatrix(const int cascadeIndex) const
     {
-        return _viewMatrices[cascadeIndex];
+        return _cascades[cascadeIndex].viewMatrix;
     }
 
+    // Projects the whole window of the cascade.
     const glm::mat4 &projectionMatrix(const int cascadeIndex) const
     {
-        return _projectionMatrices[cascadeIndex];
+        return _cascades[cascadeIndex].projectionMatrix;
     }
 
+    // Offset from the texture coordinates within the window to those in the texture layer, which
+    // wrap around.
+    glm::vec2 getTextureOffset(const int cascadeIndex) const;
+
     glm::vec2 getDepthBlurScale(const int cascadeIndex) const;
 
+    // Returns the stale regions of the cascade to render in this frame, and marks them rendered.
+    // None of the regions wraps around the texture layer.
+    std::vector<ShadowMapRegion> takeRegionsToRender(const int cascadeIndex);
+
+    // Returns the view-projection matrix that maps the region to the whole viewport.
+    glm::mat4 getRegionViewProjectionMatrix(const int cascadeIndex,
+                                            const ShadowMapRegion &region) const;
+
+    // Returns the viewport (x, y, width, height) of the region in the texture layer.
+    glm::ivec4 getRegionViewport(const int cascadeIndex, const ShadowMapRegion &region) const;
+
+    // Distance from the near plane to the far plane, which normalizes the stored depths
+    float getDepthRange(const int cascadeIndex) const { return _cascades[cascadeIndex].depthRange; }
+
+    // Returns true if the box may cast shadows into the region, i.e., it overlaps the orthographic
+    // volume of the region extended toward the light.
+    bool isShadowCasterInRegion(const int cascadeIndex,
+                                const ShadowMapRegion &region,
+                                const AlignedBox3D &box) const;
+
+    bool isShadowCasterInCascade(const int cascadeIndex, const AlignedBox3D &box) const
+    {
+        return isShadowCasterInRegion(cascadeIndex, getWindow(cascadeIndex), box);
+    }
+
 private:
-    std::array<glm::mat4, ShadowMapCascadeCount> _viewMatrices;
-    std::array<glm::mat4, ShadowMapCascadeCount> _projectionMatrices;
+    // More stale regions than this are merged into the whole window.
+    static constexpr int MaxStaleRegionCount{16};
+    // Distance that the light space Z of a cascade may drift before it is rendered again in full
+    static constexpr float DepthSlack{64.0f};
+
+    struct Cascade
+    {
+        bool isValid{false};
+        // Whether the stale regions are rendered in this frame
+        bool isUpdated{false};
+        float texelSize{0.0f};
+        glm::ivec2 windowMinTexel{0};
+        // Light space Z of the near plane, and the distance to the far plane
+        float nearPlaneZ{0.0f};
+        float depthRange{0.0f};
+        glm::mat4 viewMatrix{1.0f};
+        glm::mat4 projectionMatrix{1.0f};
+        std::vector<ShadowMapRegion> staleRegions;
+    };
+
+    ShadowMapRegion getWindow(const int cascadeIndex) const
+    {
+        const auto &cascade{_cascades[cascadeIndex]};
+        return {cascade.windowMinTexel, cascade.windowMinTexel + getShadowMapSize(cascadeIndex)};
+    }
+
+    glm::mat4 getRegionProjectionMatrix(const int cascadeIndex,
+                                        const ShadowMapRegion &region) const;
+    void moveWindow(const int cascadeIndex, const glm::ivec2 &windowMinTexel);
+    void addStaleRegion(const int cascadeIndex, const ShadowMapRegion &region);
+
+    glm::vec3 _lightDirection;
+    // Rotates world space into the light space shared by all cascades
+    glm::mat4 _lightViewMatrix;
+    std::uint64_t _frameIndex;
+    std::array<Cascade, ShadowMapCascadeCount> _cascades;
 };
 
 } // namespace minecraft
@@ -1,22 +1,48 @@
 #include "shadow_map_framebuffer.h"
 
-#include "constants.h"
+#include <algorithm>
+#include <bit>
+#include <ranges>
 
 namespace minecraft {
 
-void ShadowMapFramebuffer::resize(const int width, const int height)
+namespace {
+
+GLenum getMomentInternalFormat()
+{
+    switch (ShadowMapFramebuffer::MomentFormat) {
+    case ShadowMapMomentFormat::RG32F:
+        return GL_RG32F;
+    case ShadowMapMomentFormat::RG16F:
+        return GL_RG16F;
+    case ShadowMapMomentFormat::RG16:
+        return GL_RG16;
+    }
+    return GL_RG32F;
+}
+
+} // namespace
+
+float ShadowMapFramebuffer::getMomentPrecision()
 {
-    if (_width == width && _height == height) {
-        return;
+    // The variance is the difference of two moments, each of which is off by up to half a step,
+    // and the square of the first one doubles its error. Half floats have steps of 2^-11 in
+    // [0.5, 1].
+    switch (MomentFormat) {
+    case ShadowMapMomentFormat::RG32F:
+        return 0.0f;
+    case ShadowMapMomentFormat::RG16F:
+        return 1.5f / 2048.0f;
+    case ShadowMapMomentFormat::RG16:
+        return 1.5f / 65535.0f;
     }
-    _width = width;
-    _height = height;
-    _depthTexture.reset();
-    _depthRenderbuffer.reset();
+    return 0.0f;
+}
 
+void ShadowMapFramebuffer::create()
+{
     const auto &context{OpenGLContext::instance()};
 
-    // Create the FBO if it does not exist yet.
     if (!_fbo) {
         GLuint fbo{0u};
         context->glGenFramebuffers(1, &fbo);
@@ -31,82 +57,172 @@ void ShadowMapFramebuffer::resize(const int width, const int height)
     context->glBindFramebuffer(GL_FRAMEBUFFER, _fbo.get());
     context->checkError();
 
-    {
+    const auto createTexture{[context] {
         GLuint texture{0u};
         context->glGenTextures(1, &texture);
         context->checkError();
-        _depthTexture = OpenGLObject{
+        return OpenGLObject{
             texture,
             [](OpenGLContext *const context, const GLuint texture) {
                 context->glDeleteTextures(1, &texture);
             },
         };
-    }
-    context->glBindTexture(GL_TEXTURE_2D_ARRAY, _depthTexture.get());
-    context->checkError();
-    context->glTexImage3D(GL_TEXTURE_2D_ARRAY,
-                          0,
-                          GL_RG32F,
-                          width,
-                          height,
-                          ShadowMapCascadeCount,
-                          0,
-                          GL_RG,
-                          GL_FLOAT,
-                          nullptr);
-    context->checkError();
+    }};
 
-    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    context->checkError();
-    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    context->checkError();
+    for (const auto tierIndex : std::views::iota(0, TierCount)) {
+        auto &tier{_tiers[tierIndex]};
+        tier = {};
+        const auto cascadeCount{getCascadeCount(tierIndex)};
+        if (cascadeCount == 0) {
+            continue;
+        }
+        const auto size{getShadowMapSize(getFirstCascadeIndex(tierIndex))};
 
-    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    context->checkError();
-    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    context->checkError();
+        // The moments are prefiltered into a full mip chain, from which the lighting pass reads
+        // averages over large filter regions in a few fetches.
+        const auto levelCount{static_cast<int>(std::bit_width(static_cast<unsigned int>(size)))};
+        tier.momentTexture = createTexture();
+        context->glBindTexture(GL_TEXTURE_2D_ARRAY, tier.momentTexture.get());
+        context->checkError();
+        for (const auto level : std::views::iota(0, levelCount)) {
+            context->glTexImage3D(GL_TEXTURE_2D_ARRAY,
+                                  level,
+                                  static_cast<GLint>(getMomentInternalFormat()),
+                                  std::max(size >> level, 1),
+                                  std::max(size >> level, 1),
+                                  cascadeCount,
+                                  0,
+                                  GL_RG,
+                                  GL_FLOAT,
+                                  nullptr);
+            context->checkError();
+        }
+        context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        context->checkError();
 
-    setTextureLayer(0);
+        context->glTexParameteri(GL_TEXTURE_2D_ARRAY,
+                                 GL_TEXTURE_MIN_FILTER,
+                                 GL_LINEAR_MIPMAP_LINEAR);
+        context->checkError();
+        context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        context->checkError();
 
-    {
-        GLuint renderbuffer{0u};
-        context->glGenRenderbuffers(1, &renderbuffer);
+        // The cascades are stored toroidally, so samples near the edges wrap around. The sizes are
+        // powers of two, so every mip texel still covers a contiguous block of the cascade.
+        context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
         context->checkError();
-        _depthRenderbuffer = OpenGLObject{
-            renderbuffer,
-            [](OpenGLContext *const context, const GLuint renderbuffer) {
-                context->glDeleteRenderbuffers(1, &renderbuffer);
-            },
-        };
+        context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        context->checkError();
+
+        // The depth buffer is only used to find the nearest occluder, and the moments keep their
+        // own precision. It is layered like the moments, so that all cascades of the tier can be
+        // rendered in one pass, and 16 bits keep its size down.
+        tier.depthTestTexture = createTexture();
+        context->glBindTexture(GL_TEXTURE_2D_ARRAY, tier.depthTestTexture.get());
+        context->checkError();
+        context->glTexImage3D(GL_TEXTURE_2D_ARRAY,
+                              0,
+                              GL_DEPTH_COMPONENT16,
+                              size,
+                              size,
+                              cascadeCount,
+                              0,
+                              GL_DEPTH_COMPONENT,
+                              GL_UNSIGNED_SHORT,
+                              nullptr);
+        context->checkError();
+        context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        context->checkError();
+        context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        context->checkError();
+
+        setTextureLayer(getFirstCascadeIndex(tierIndex));
+        {
+            const auto status{context->glCheckFramebufferStatus(GL_FRAMEBUFFER)};
+            context->checkError();
+            if (status != GL_FRAMEBUFFER_COMPLETE) {
+                qFatal() << "Failed to initialize framebuffer";
+            }
+        }
     }
-    context->glBindRenderbuffer(GL_RENDERBUFFER, _depthRenderbuffer.get());
+}
+
+void ShadowMapFramebuffer::bindLayered(const int tierIndex)
+{
+    const auto &context{OpenGLContext::instance()};
+    auto &tier{_tiers[tierIndex]};
+    tier.isChanged = true;
+
+    context->glBindFramebuffer(GL_FRAMEBUFFER, _fbo.get());
     context->checkError();
-    context->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+    context->glFramebufferTexture(GL_FRAMEBUFFER,
+                                  GL_COLOR_ATTACHMENT0,
+                                  tier.momentTexture.get(),
+                                  0);
     context->checkError();
-    context->glFramebufferRenderbuffer(GL_FRAMEBUFFER,
-                                       GL_DEPTH_ATTACHMENT,
-                                       GL_RENDERBUFFER,
-                                       _depthRenderbuffer.get());
+    context->glFramebufferTexture(GL_FRAMEBUFFER,
+                                  GL_DEPTH_ATTACHMENT,
+                                  tier.depthTestTexture.get(),
+                                  0);
     context->checkError();
-
     {
-        const auto status{context->glCheckFramebufferStatus(GL_FRAMEBUFFER)};
+        const GLenum drawBuffers[1]{GL_COLOR_ATTACHMENT0};
+        context->glDrawBuffers(1, drawBuffers);
         context->checkError();
-        if (status != GL_FRAMEBUFFER_COMPLETE) {
-            qFatal() << "Failed to initialize framebuffer";
+    }
+}
+
+void ShadowMapFramebuffer::updateMipmaps()
+{
+    const auto &context{OpenGLContext::instance()};
+
+    for (auto &tier : _tiers) {
+        if (!tier.isChanged) {
+            continue;
         }
+        tier.isChanged = false;
+        // The whole chain is regenerated, but reading the base level dominates its cost, and that
+        // is far less than reading the base level dozens of times per lit pixel.
+        context->glBindTexture(GL_TEXTURE_2D_ARRAY, tier.momentTexture.get());
+        context->checkError();
+        context->glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        context->checkError();
     }
+    context->glBindTexture(GL_TEXTURE_2D_ARRAY, 0u);
+    context->checkError();
 }
 
-void ShadowMapFramebuffer::setTextureLayer(const int cascadeIndex) const
+void ShadowMapFramebuffer::clear() const
 {
     const auto &context{OpenGLContext::instance()};
 
+    // Normalized depths are at most 1. The shared clear color does not fit 16-bit formats.
+    const GLfloat farMoments[4]{1.0f, 1.0f, 0.0f, 0.0f};
+    context->glClearBufferfv(GL_COLOR, 0, farMoments);
+    context->checkError();
+    context->glClear(GL_DEPTH_BUFFER_BIT);
+    context->checkError();
+}
+
+void ShadowMapFramebuffer::setTextureLayer(const int cascadeIndex)
+{
+    const auto &context{OpenGLContext::instance()};
+    const auto tierIndex{getTierIndex(cascadeIndex)};
+    auto &tier{_tiers[tierIndex]};
+    tier.isChanged = true;
+    const auto layer{cascadeIndex - getFirstCascadeIndex(tierIndex)};
+
     context->glFramebufferTextureLayer(GL_FRAMEBUFFER,
                                        GL_COLOR_ATTACHMENT0,
-                                       _depthTexture.get(),
+                                       tier.momentTexture.get(),
+                                       0,
+                                       layer);
+    context->checkError();
+    context->glFramebufferTextureLayer(GL_FRAMEBUFFER,
+                                       GL_DEPTH_ATTACHMENT,
+                                       tier.depthTestTexture.get(),
                                        0,
-                                       cascadeIndex);
+                                       layer);
     context->checkError();
     {
         const GLenum drawBuffers[1]{GL_COLOR_ATTACHMENT0};
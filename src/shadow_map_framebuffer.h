@@ -1,20 +1,34 @@
 #ifndef SHADOW_MAP_FRAMEBUFFER_H
 #define SHADOW_MAP_FRAMEBUFFER_H
 
+#include "constants.h"
 #include "opengl_context.h"
 #include "opengl_object.h"
 
+#include <array>
+
 namespace minecraft {
 
+// Storage formats of the moments, i.e., the linear depths normalized by the depth range of the
+// cascade, and their squares
+enum class ShadowMapMomentFormat
+{
+    RG32F,
+    RG16F,
+    RG16,
+};
+
+// Holds the shadow map cascades in one texture array per resolution tier: the near cascades are
+// the layers of one array, and the far cascades are the layers of another.
 class ShadowMapFramebuffer
 {
 public:
+    static constexpr auto MomentFormat{ShadowMapMomentFormat::RG16};
+    static constexpr auto TierCount{2};
+
     ShadowMapFramebuffer()
-        : _width{0}
-        , _height{0}
-        , _fbo{}
-        , _depthTexture{}
-        , _depthRenderbuffer{}
+        : _fbo{}
+        , _tiers{}
     {}
 
     ShadowMapFramebuffer(const ShadowMapFramebuffer &) = delete;
@@ -23,33 +37,70 @@ public:
     ShadowMapFramebuffer &operator=(const ShadowMapFramebuffer &) = delete;
     ShadowMapFramebuffer &operator=(ShadowMapFramebuffer &&) = delete;
 
-    int width() const { return _width; }
+    static int getTierIndex(const int cascadeIndex)
+    {
+        return cascadeIndex < ShadowMapNearCascadeCount ? 0 : 1;
+    }
+
+    static int getFirstCascadeIndex(const int tierIndex)
+    {
+        return tierIndex == 0 ? 0 : ShadowMapNearCascadeCount;
+    }
+
+    static int getCascadeCount(const int tierIndex)
+    {
+        return tierIndex == 0 ? ShadowMapNearCascadeCount
+                              : ShadowMapCascadeCount - ShadowMapNearCascadeCount;
+    }
 
-    int height() const { return _height; }
+    // Returns the error of the stored moments, which bounds their variance from below.
+    static float getMomentPrecision();
 
-    void resize(const int width, const int height);
+    // Creates the textures of all tiers, whose sizes are fixed.
+    void create();
 
-    GLuint depthTexture() const { return _depthTexture.get(); }
+    GLuint momentTexture(const int tierIndex) const
+    {
+        return _tiers[tierIndex].momentTexture.get();
+    }
 
-    void bind(const int cascadeIndex) const
+    void bind(const int cascadeIndex)
     {
         const auto &context{OpenGLContext::instance()};
 
         context->glBindFramebuffer(GL_FRAMEBUFFER, _fbo.get());
         context->checkError();
         setTextureLayer(cascadeIndex);
-        context->glViewport(0, 0, _width, _height);
+        const auto size{getShadowMapSize(cascadeIndex)};
+        context->glViewport(0, 0, size, size);
         context->checkError();
     }
 
+    // Binds all cascade layers of the tier, which a geometry shader selects with gl_Layer. The
+    // viewports are left to the caller.
+    void bindLayered(const int tierIndex);
+
+    // Regenerates the mipmaps of the moments of the tiers that have been bound for rendering since
+    // the last call.
+    void updateMipmaps();
+
+    // Clears the moments to the far plane and the depth buffer, within the scissor box if the
+    // scissor test is enabled.
+    void clear() const;
+
 private:
-    void setTextureLayer(const int cascadeIndex) const;
+    struct Tier
+    {
+        OpenGLObject momentTexture;
+        // Depth buffer for the depth test, as opposed to the linear depths in momentTexture
+        OpenGLObject depthTestTexture;
+        bool isChanged{false};
+    };
+
+    void setTextureLayer(const int cascadeIndex);
 
-    int _width;
-    int _height;
     OpenGLObject _fbo;
-    OpenGLObject _depthTexture;
-    OpenGLObject _depthRenderbuffer;
+    std::array<Tier, TierCount> _tiers;
 };
 
 } // namespace minecraft
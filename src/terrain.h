@@ -54,6 +54,22 @@ public:
             block);
     }
 
+    void markBlockDirtyAtGlobal(const glm::ivec3 &position)
+    {
+        if (position.y < 0 || position.y >= TerrainChunk::SizeY) {
+            return;
+        }
+        const auto chunk{getChunk(glm::ivec2{position.x, position.z})};
+        if (chunk == nullptr) {
+            return;
+        }
+        chunk->markBlockDirty(glm::ivec3{
+            position.x - chunk->originXZ()[0],
+            position.y,
+            position.z - chunk->originXZ()[1],
+        });
+    }
+
     template<typename Callable>
     void forEachChunk(Callable callable)
     {
@@ -1,49 +1,325 @@
 #include "terrain_chunk.h"
 
 #include "block_face_generation_task.h"
+#include "block_face_uploader.h"
 
-#include <QThreadPool>
-
+#include <algorithm>
+#include <initializer_list>
+#include <limits>
 #include <ranges>
 
 namespace minecraft {
 
-void TerrainChunk::prepareDraw()
+namespace {
+
+// FNV-1a hash of a sequence of blocks
+class BlockHasher
 {
-    if (!_isVisible) {
+public:
+    constexpr void add(const BlockType block)
+    {
+        _hash ^= static_cast<std::uint64_t>(block);
+        _hash *= 0x100000001B3ull;
+    }
+
+    constexpr std::uint64_t hash() const { return _hash; }
+
+private:
+    std::uint64_t _hash{0xCBF29CE484222325ull};
+};
+
+// Fingerprint of a border filled with the same block
+consteval std::uint64_t getUniformBorderFingerprint(const BlockType block)
+{
+    BlockHasher hasher;
+    for ([[maybe_unused]] const auto i :
+         std::views::iota(0, TerrainChunk::SectionSizeY * TerrainChunk::SizeX)) {
+        hasher.add(block);
+    }
+    return hasher.hash();
+}
+
+} // namespace
+
+// Borders along the X and Z axes have the same size.
+static_assert(TerrainChunk::SizeX == TerrainChunk::SizeZ);
+
+const std::uint64_t TerrainChunk::MissingBorderFingerprint{
+    getUniformBorderFingerprint(MissingNeighborBlock)};
+
+std::uint64_t TerrainChunk::getBorderFingerprint(const int neighborIndex, const int section) const
+{
+    auto &fingerprint{_borderFingerprints[neighborIndex][section]};
+    auto &sectionMask{_borderFingerprintSectionMasks[neighborIndex]};
+    if (((sectionMask >> section) & 1u) == 0) {
+        fingerprint = getBorderFingerprint(_blockStorage.blocks(), neighborIndex, section);
+        sectionMask |= 1u << section;
+    }
+    return fingerprint;
+}
+
+std::uint64_t TerrainChunk::getBorderFingerprint(const BlockStorage::BlockArray &blocks,
+                                                 const int neighborIndex,
+                                                 const int section)
+{
+    BlockHasher hasher;
+    for (const auto y : std::views::iota(section * SectionSizeY, (section + 1) * SectionSizeY)) {
+        for (const auto i : std::views::iota(0, SizeX)) {
+            switch (NeighborDirections[neighborIndex]) {
+            case Direction::PositiveX:
+                hasher.add(blocks[SizeX - 1][y][i]);
+                break;
+            case Direction::NegativeX:
+                hasher.add(blocks[0][y][i]);
+                break;
+            case Direction::PositiveZ:
+                hasher.add(blocks[i][y][SizeZ - 1]);
+                break;
+            case Direction::NegativeZ:
+            default:
+                hasher.add(blocks[i][y][0]);
+            }
+        }
+    }
+    return hasher.hash();
+}
+
+void TerrainChunk::compressBlocks()
+{
+    if (_blockStorage.isCompressed()) {
+        return;
+    }
+    for (const auto i : std::views::iota(0, 4)) {
+        for (const auto section : std::views::iota(0, SectionCount)) {
+            getBorderFingerprint(i, section);
+        }
+    }
+    _blockStorage.compress();
+}
+
+std::uint32_t TerrainChunk::getFrontFacingDirectionMask(const AlignedBox3D &boundingBox,
+                                                        const glm::vec3 &eye)
+{
+    // A face pointing to +X is only visible if the eye is on its +X side, and all such faces in the
+    // box are on the +X side of its minimum X.
+    std::uint32_t directionMask{0};
+    for (const auto axis : std::views::iota(0, 3)) {
+        if (eye[axis] > boundingBox.minPoint()[axis]) {
+            directionMask |= 1u << (axis * 2);
+        }
+        if (eye[axis] < boundingBox.maxPoint()[axis]) {
+            directionMask |= 1u << (axis * 2 + 1);
+        }
+    }
+    return directionMask;
+}
+
+std::uint32_t TerrainChunk::getLightFacingDirectionMask(const glm::vec3 &lightDirection)
+{
+    std::uint32_t directionMask{0};
+    for (const auto axis : std::views::iota(0, 3)) {
+        if (lightDirection[axis] > 0.0f) {
+            directionMask |= 1u << (axis * 2);
+        } else if (lightDirection[axis] < 0.0f) {
+            directionMask |= 1u << (axis * 2 + 1);
+        }
+    }
+    return directionMask;
+}
+
+void TerrainChunk::markStaleBordersDirty()
+{
+    for (const auto i : std::views::iota(0, 4)) {
+        const auto neighbor{_neighbors[i]};
+        // Directions come in pairs of opposite directions.
+        const auto oppositeIndex{i ^ 1};
+        // This chunk against the neighbor border
+        const auto fingerprints{getNeighborBorderFingerprints(i)};
+        for (const auto section : std::views::iota(0, SectionCount)) {
+            const auto neighborFingerprint{neighbor != nullptr
+                                               ? neighbor->getBorderFingerprint(oppositeIndex,
+                                                                                section)
+                                               : MissingBorderFingerprint};
+            if (fingerprints[section] != neighborFingerprint) {
+                ++_blockVersions[section];
+            }
+        }
+        if (neighbor == nullptr) {
+            continue;
+        }
+        // The neighbor against the border of this chunk
+        const auto neighborFingerprints{neighbor->getNeighborBorderFingerprints(oppositeIndex)};
+        for (const auto section : std::views::iota(0, SectionCount)) {
+            if (neighborFingerprints[section] != getBorderFingerprint(i, section)) {
+                ++neighbor->_blockVersions[section];
+            }
+        }
+    }
+}
+
+void TerrainChunk::markBlockDirty(const glm::ivec3 &position)
+{
+    const auto markSectionDirty{[](TerrainChunk *const chunk, const int y) {
+        if (chunk != nullptr && y >= 0 && y < SizeY) {
+            ++chunk->_blockVersions[y / SectionSizeY];
+        }
+    }};
+    // Blocks are meshed in cells of the LOD grid, so a change affects its whole cell and the cells
+    // next to it. Marking the same section more than once is harmless.
+    const auto cellMin{position / _lodScale * _lodScale};
+    const auto cellMax{cellMin + (_lodScale - 1)};
+    for (const auto y : {cellMin.y - 1, position.y, cellMax.y + 1}) {
+        markSectionDirty(this, y);
+    }
+    if (cellMax.x == SizeX - 1) {
+        markSectionDirty(getNeighbor(Direction::PositiveX), position.y);
+    }
+    if (cellMin.x == 0) {
+        markSectionDirty(getNeighbor(Direction::NegativeX), position.y);
+    }
+    if (cellMax.z == SizeZ - 1) {
+        markSectionDirty(getNeighbor(Direction::PositiveZ), position.y);
+    }
+    if (cellMin.z == 0) {
+        markSectionDirty(getNeighbor(Direction::NegativeZ), position.y);
+    }
+}
+
+void TerrainChunk::setLodScale(const int lodScale)
+{
+    if (lodScale == _lodScale) {
         return;
     }
+    const auto previousLodScale{_lodScale};
+    _lodScale = lodScale;
+    markSelfDirty();
+    // The borders of the neighbors are generated against the LOD grid of this chunk, except that a
+    // finer chunk is read as air whatever its scale. Neighbors coarser than both scales see no
+    // change.
+    for (const auto neighbor : _neighbors) {
+        if (neighbor != nullptr && std::max(previousLodScale, lodScale) >= neighbor->_lodScale) {
+            neighbor->markSelfDirty();
+        }
+    }
+}
+
+bool TerrainChunk::hasBlockFacesToUpload()
+{
+    const std::lock_guard lock{_blockFaceMutex};
+    switch (_state) {
+    case TerrainChunkState::Meshed:
+        // Block faces are left to the uploader while it runs.
+        return !BlockFaceUploader::instance().isRunning();
+    case TerrainChunkState::Staged:
+        return _stagedBlockFaces->isReady();
+    default:
+        return false;
+    }
+}
+
+std::int64_t TerrainChunk::uploadBlockFaces()
+{
+    if (!_isVisible) {
+        return 0;
+    }
+    std::int64_t uploadedInstanceCount{0};
     {
         const std::lock_guard lock{_blockFaceMutex};
-        if (_isBlockFaceReady) {
-            // If new instance attributes were generated by a worker thread, upload them to the GPU.
-            for (const auto i : std::views::iota(0, 4)) {
-                _renderers[i].uploadInstances(_blockFaces[i]);
+        // If new instance attributes were generated by a worker thread, upload the updated sections
+        // to the GPU, or copy them from the staging buffer once the uploader has filled it.
+        if (_state == TerrainChunkState::Meshed && !BlockFaceUploader::instance().isRunning()) {
+            uploadedInstanceCount
+                = _renderer.upload(*_blockFaces, SectionCount, _blockFaceSectionMask);
+        } else if (_state == TerrainChunkState::Staged && _stagedBlockFaces->isReady()) {
+            uploadedInstanceCount
+                = _renderer.upload(*_stagedBlockFaces, SectionCount, _blockFaceSectionMask);
+        } else {
+            return 0;
+        }
+        for (const auto section : std::views::iota(0, SectionCount)) {
+            if (((_blockFaceSectionMask >> section) & 1u) == 0) {
+                continue;
             }
-            _rendererBoundingBoxes = _blockFaceBoundingBoxes;
-            _rendererVersion = _blockFaceVersion;
-
-            // Instance attributes are no longer needed once uploaded to the GPU.
-            _isBlockFaceReady = false;
-            for (auto &blockFaces : _blockFaces) {
-                blockFaces.clear();
+            for (const auto i : std::views::iota(0, 4)) {
+                _rendererSectionBoundingBoxes[i][section] = _blockFaceBoundingBoxes[i][section];
             }
-            _blockFaceVersion = -1;
-        }
-        if (_rendererVersion < _blockVersion && _blockFaceVersion < 0) {
-            // If the renderer data are out of date or unavailable (version = -1), and no worker
-            // thread is currently working on it, start a new block face generation task.
-            _isBlockFaceReady = false;
-            for (auto &blockFaces : _blockFaces) {
-                blockFaces.clear();
+            _rendererVersions[section] = _blockFaceVersions[section];
+        }
+        for (const auto i : std::views::iota(0, 4)) {
+            auto minPoint{glm::vec3{std::numeric_limits<float>::max()}};
+            auto maxPoint{glm::vec3{std::numeric_limits<float>::lowest()}};
+            for (const auto &boundingBox : _rendererSectionBoundingBoxes[i]) {
+                if (!boundingBox.isEmpty()) {
+                    minPoint = glm::min(minPoint, boundingBox.minPoint());
+                    maxPoint = glm::max(maxPoint, boundingBox.maxPoint());
+                }
             }
-            _blockFaceVersion = _blockVersion;
-            // Auto-deletion is enabled by default.
-            QThreadPool::globalInstance()->start(new BlockFaceGenerationTask{this});
+            _rendererBoundingBoxes[i] = AlignedBox3D{minPoint, maxPoint};
         }
+
+        // Instance attributes are no longer needed once uploaded to the GPU. Their memory is
+        // reused by later block face generation tasks.
+        _state = TerrainChunkState::Uploaded;
+        BlockFaceGenerationTask::recycleBlockFaces(std::move(_blockFaces));
+        _stagedBlockFaces.reset();
+        _blockFaceSectionMask = 0;
     }
     // The renderer data may be out of date, but we still render them because they are better than
     // nothing.
+    return uploadedInstanceCount * static_cast<std::int64_t>(sizeof(BlockFace));
+}
+
+void TerrainChunk::releaseRendererResources()
+{
+    _renderer.releaseResources();
+    _rendererVersions.fill(-1);
+    const std::lock_guard lock{_blockFaceMutex};
+    if (_state == TerrainChunkState::Staged) {
+        // The sections are regenerated, because all renderer versions are reset.
+        _stagedBlockFaces.reset();
+        _blockFaceSectionMask = 0;
+        _state = TerrainChunkState::NeighborsReady;
+    } else if (_state == TerrainChunkState::Uploaded) {
+        _state = TerrainChunkState::NeighborsReady;
+    }
+}
+
+std::uint32_t TerrainChunk::getOutdatedSectionMask() const
+{
+    // If the renderer data of some sections are out of date or unavailable (version = -1), and no
+    // worker thread is currently working on them, these sections need new block faces.
+    if (_state == TerrainChunkState::Generated || _blockFaceSectionMask != 0) {
+        return 0;
+    }
+    std::uint32_t sectionMask{0};
+    for (const auto section : std::views::iota(0, SectionCount)) {
+        if (_rendererVersions[section] < _blockVersions[section]) {
+            sectionMask |= 1u << section;
+        }
+    }
+    return sectionMask;
+}
+
+bool TerrainChunk::needsBlockFaceGeneration()
+{
+    const std::lock_guard lock{_blockFaceMutex};
+    return getOutdatedSectionMask() != 0;
+}
+
+BlockFaceGenerationTask *TerrainChunk::createBlockFaceGenerationTask()
+{
+    const std::lock_guard lock{_blockFaceMutex};
+    const auto sectionMask{getOutdatedSectionMask()};
+    if (sectionMask == 0) {
+        return nullptr;
+    }
+    for (const auto section : std::views::iota(0, SectionCount)) {
+        if (((sectionMask >> section) & 1u) != 0) {
+            _blockFaceVersions[section] = _blockVersions[section];
+        }
+    }
+    _blockFaceSectionMask = sectionMask;
+    return new BlockFaceGenerationTask{this, sectionMask};
 }
 
 } // namespace minecraft
@@ -2,20 +2,27 @@
 #define MINECRAFT_TERRAIN_CHUNK_H
 
 #include "aligned_box_3d.h"
+#include "block_storage.h"
+#include "block_face_renderer.h"
 #include "block_type.h"
 #include "direction.h"
-#include "instanced_renderer.h"
 #include "vertex_attribute.h"
 
 #include <glm/glm.hpp>
 
 #include <array>
 #include <cstdint>
+#include <memory>
 #include <mutex>
+#include <ranges>
+#include <utility>
 #include <vector>
 
 namespace minecraft {
 
+class BlockFaceGenerationTask;
+class BlockFaceUploader;
+
 enum class BlockFaceGroup : int {
     Opaque = 0,
     Translucent = 1,
@@ -23,24 +30,60 @@ enum class BlockFaceGroup : int {
     UnderWater = 3,
 };
 
+// Lifecycle of a chunk's block faces
+enum class TerrainChunkState : int {
+    // Blocks are generated, but block faces are not because some neighbors may still be missing.
+    Generated = 0,
+    // All neighbors are generated, or will not be generated at the frontier of the terrain.
+    NeighborsReady = 1,
+    // New block faces are generated and waiting for upload.
+    Meshed = 2,
+    // New block faces are in a staging buffer of BlockFaceUploader, waiting to be copied.
+    Staged = 3,
+    // Block faces are uploaded to the GPU. Sections are still regenerated after changes.
+    Uploaded = 4,
+};
+
+// Each block face is stored once under the set of groups it belongs to. The sets are ordered so
+// that every group is a contiguous range of sets.
+enum class BlockFaceGroupSet : int {
+    OpaqueUnderWater = 0,
+    OpaqueAboveAndUnderWater = 1,
+    OpaqueAboveWater = 2,
+    Opaque = 3,
+    Translucent = 4,
+};
+
 class TerrainChunk
 {
 public:
     TerrainChunk(const glm::ivec2 originXZ)
         : _originXZ{originXZ}
         , _neighbors{}
-        , _blocks{}
-        , _blockVersion{0}
+        , _blockStorage{}
+        , _blockVersions{}
         , _isVisible{false}
+        , _lodScale{1}
         , _blockFaceMutex{}
-        , _isBlockFaceReady{false}
+        , _state{TerrainChunkState::Generated}
+        , _blockFaceSectionMask{0}
         , _blockFaces{}
+        , _stagedBlockFaces{}
         , _blockFaceBoundingBoxes{}
-        , _blockFaceVersion{-1}
-        , _renderers{}
+        , _blockFaceVersions{}
+        , _renderer{}
+        , _rendererSectionBoundingBoxes{}
         , _rendererBoundingBoxes{}
-        , _rendererVersion{-1}
-    {}
+        , _rendererVersions{}
+        , _borderFingerprints{}
+        , _borderFingerprintSectionMasks{}
+        , _neighborBorderFingerprints{}
+    {
+        _rendererVersions.fill(-1);
+        for (auto &fingerprints : _neighborBorderFingerprints) {
+            fingerprints.fill(MissingBorderFingerprint);
+        }
+    }
 
     glm::ivec2 originXZ() const { return _originXZ; }
 
@@ -51,22 +94,61 @@ public:
 
     BlockType getBlockAtLocal(const glm::ivec3 &position) const
     {
-        return _blocks[position.x][position.y][position.z];
+        return _blockStorage.get(position);
     }
 
     void setBlockAtLocal(const glm::ivec3 &position, const BlockType block)
     {
         // We do not increment the block version here because this makes terrain generation very
-        // inefficient. Users are responsible for calling markSelfDirty() or
+        // inefficient. Users are responsible for calling markSelfDirty(), markBlockDirty(), or
         // markSelfAndNeighborsDirty() after modifications.
-        _blocks[position.x][position.y][position.z] = block;
+        _blockStorage.set(position, block);
+        if (position.x == 0 || position.x == SizeX - 1 || position.z == 0
+            || position.z == SizeZ - 1) {
+            // The fingerprints of the section are computed again when needed.
+            for (auto &sectionMask : _borderFingerprintSectionMasks) {
+                sectionMask &= ~(1u << (position.y / SectionSizeY));
+            }
+        }
     }
 
+    BlockStorage &blockStorage() { return _blockStorage; }
+
+    const BlockStorage &blockStorage() const { return _blockStorage; }
+
+    // Compresses the block data. The fingerprints of the borders are computed before, so that the
+    // neighbors can compare borders without decompressing the blocks.
+    void compressBlocks();
+
     bool isVisible() const { return _isVisible; }
 
     void setVisible(const bool visible) { _isVisible = visible; }
 
-    void markSelfDirty() { ++_blockVersion; }
+    // Block faces are generated from a grid downsampled by this factor, which is a power of two up
+    // to MaxLodScale. Each cell of the grid holds the most common block of its blocks.
+    int lodScale() const { return _lodScale; }
+
+    // Changing the scale regenerates the block faces of this chunk and of the neighbors that read
+    // its border in a different grid.
+    void setLodScale(const int lodScale);
+
+    // Incremented whenever the blocks of the section or its neighbor borders may have changed
+    std::int32_t blockVersion(const int section) const { return _blockVersions[section]; }
+
+    void markSelfDirty()
+    {
+        for (auto &version : _blockVersions) {
+            ++version;
+        }
+    }
+
+    // Marks the sections whose block faces may be affected by a change of the given block, which
+    // include the sections of adjacent blocks in this chunk and the neighboring chunks.
+    void markBlockDirty(const glm::ivec3 &position);
+
+    // Marks the sections of this chunk and its neighbors dirty if their block faces were generated
+    // with neighbor borders different from the current ones, e.g., when a neighbor first appears.
+    void markStaleBordersDirty();
 
     void markSelfAndNeighborsDirty()
     {
@@ -78,27 +160,71 @@ public:
         }
     }
 
-    void prepareDraw();
+    TerrainChunkState state()
+    {
+        const std::lock_guard lock{_blockFaceMutex};
+        return _state;
+    }
 
-    const AlignedBox3D &rendererBoundingBox(const BlockFaceGroup group) const
+    // Allows block faces to be generated. Until then, no block face generation task is created, so
+    // that the borders are not generated against missing neighbors.
+    void markNeighborsReady()
     {
-        return _rendererBoundingBoxes[static_cast<int>(group)];
+        const std::lock_guard lock{_blockFaceMutex};
+        if (_state == TerrainChunkState::Generated) {
+            _state = TerrainChunkState::NeighborsReady;
+        }
     }
 
-    void draw(const BlockFaceGroup group)
+    // Returns true if block faces generated by a worker thread are ready to be uploaded by the
+    // render thread, either from the CPU or from a signaled staging buffer.
+    bool hasBlockFacesToUpload();
+
+    // Uploads the block faces generated by a worker thread, if they are ready, and returns the
+    // number of uploaded bytes. Until then, the previous block faces are drawn.
+    std::int64_t uploadBlockFaces();
+
+    // Returns true if some sections have out-of-date block faces, and no worker thread is
+    // generating block faces for this chunk.
+    bool needsBlockFaceGeneration();
+
+    // Creates a task that generates the block faces of the out-of-date sections, or returns nullptr
+    // if there are none. The sections are determined at this moment rather than when the chunk is
+    // scheduled, so the task always works on the latest blocks.
+    BlockFaceGenerationTask *createBlockFaceGenerationTask();
+
+    // Number of block faces on the GPU, including those of out-of-date sections
+    GLsizei instanceCount() const { return _renderer.totalInstanceCount(); }
+
+    const AlignedBox3D &rendererBoundingBox(const BlockFaceGroup group) const
     {
-        // This gives 2 triangles per quad: (0, 1, 2) and (0, 2, 3).
-        _renderers[static_cast<int>(group)].draw(4, GL_TRIANGLE_FAN);
+        return _rendererBoundingBoxes[static_cast<int>(group)];
     }
 
-    void releaseRendererResources()
+    // Draws the faces of the given group whose direction bits are set in directionMask, where bit i
+    // corresponds to Direction{i}.
+    void draw(const BlockFaceGroup group, const std::uint32_t directionMask = AllDirectionsMask)
     {
-        for (auto &renderer : _renderers) {
-            renderer.releaseResources();
+        const auto [firstSet, lastSet]{getGroupSetRange(group)};
+        for (const auto faceIndex : std::views::iota(0, 6)) {
+            if (((directionMask >> faceIndex) & 1u) != 0) {
+                _renderer.draw(getBlockFaceSlot(faceIndex, firstSet, 0),
+                               getBlockFaceSlot(faceIndex, lastSet, 0));
+            }
         }
-        _rendererVersion = -1;
     }
 
+    // Returns the directions of faces inside the bounding box that can face the eye. Faces of the
+    // other directions are back faces, which are hidden behind the front faces of the same blocks.
+    static std::uint32_t getFrontFacingDirectionMask(const AlignedBox3D &boundingBox,
+                                                     const glm::vec3 &eye);
+
+    // Returns the directions of faces that face toward the light of the given direction.
+    static std::uint32_t getLightFacingDirectionMask(const glm::vec3 &lightDirection);
+
+    // Staged block faces are dropped as well, since they belong to the render context.
+    void releaseRendererResources();
+
     AlignedBox3D boundingBox() const
     {
         return {
@@ -116,16 +242,61 @@ public:
         return {alignedX, alignedZ};
     }
 
-    static constexpr int SizeX{64};
-    static constexpr int SizeY{256};
-    static constexpr int SizeZ{64};
+    static constexpr int SizeX{BlockStorage::SizeX};
+    static constexpr int SizeY{BlockStorage::SizeY};
+    static constexpr int SizeZ{BlockStorage::SizeZ};
+
+    // Block faces are generated and uploaded per section, which is a horizontal slab of the chunk.
+    static constexpr int SectionSizeY{16};
+    static constexpr int SectionCount{SizeY / SectionSizeY};
+    static constexpr std::uint32_t AllSectionsMask{(1u << SectionCount) - 1u};
+
+    // Cells of the LOD grids never cross sections.
+    static constexpr int MaxLodScale{8};
+    static_assert(SectionSizeY % MaxLodScale == 0);
+
+    static constexpr std::uint32_t AllDirectionsMask{0b111111u};
+
+    static constexpr int BlockFaceGroupSetCount{5};
+    static constexpr int BlockFaceSlotCount{6 * BlockFaceGroupSetCount * SectionCount};
+
+    // Block faces are laid out as [direction][group set][section], so that the faces of a group
+    // facing one direction are a contiguous range.
+    static constexpr int getBlockFaceSlot(const int faceIndex,
+                                          const int groupSet,
+                                          const int section)
+    {
+        return (faceIndex * BlockFaceGroupSetCount + groupSet) * SectionCount + section;
+    }
+
+    // Returns the range [first, last) of group sets that contain the given group.
+    static constexpr std::pair<int, int> getGroupSetRange(const BlockFaceGroup group)
+    {
+        switch (group) {
+        case BlockFaceGroup::Opaque:
+            return {static_cast<int>(BlockFaceGroupSet::OpaqueUnderWater),
+                    static_cast<int>(BlockFaceGroupSet::Translucent)};
+        case BlockFaceGroup::Translucent:
+            return {static_cast<int>(BlockFaceGroupSet::Translucent), BlockFaceGroupSetCount};
+        case BlockFaceGroup::AboveWater:
+            return {static_cast<int>(BlockFaceGroupSet::OpaqueAboveAndUnderWater),
+                    static_cast<int>(BlockFaceGroupSet::Opaque)};
+        case BlockFaceGroup::UnderWater:
+        default:
+            return {static_cast<int>(BlockFaceGroupSet::OpaqueUnderWater),
+                    static_cast<int>(BlockFaceGroupSet::OpaqueAboveWater)};
+        }
+    }
 
 private:
     friend class BlockFaceGenerationTask;
+    friend class BlockFaceUploader;
+    friend class TerrainChunkTest;
 
     template<typename Self>
     static auto getNeighborPointer(Self &self, const Direction direction)
     {
+        // Keep the order in sync with NeighborDirections.
         switch (direction) {
         case Direction::PositiveX:
             return &self._neighbors[0];
@@ -140,23 +311,75 @@ private:
         }
     }
 
+    static constexpr auto NeighborDirections{std::to_array<Direction>({
+        Direction::PositiveX,
+        Direction::NegativeX,
+        Direction::PositiveZ,
+        Direction::NegativeZ,
+    })};
+
+    // Must be called with _blockFaceMutex locked.
+    std::uint32_t getOutdatedSectionMask() const;
+
+    // Worker threads set the fingerprints along with the block faces, so they are copied under the
+    // lock.
+    std::array<std::uint64_t, SectionCount> getNeighborBorderFingerprints(const int neighborIndex)
+    {
+        const std::lock_guard lock{_blockFaceMutex};
+        return _neighborBorderFingerprints[neighborIndex];
+    }
+
+    // Fingerprint of the blocks of a section on the border facing the given neighbor, i.e., the
+    // padding that the neighbor uses when generating its block faces.
+    std::uint64_t getBorderFingerprint(const int neighborIndex, const int section) const;
+
+    // Same as above, but from the given blocks instead of the cache of this chunk
+    static std::uint64_t getBorderFingerprint(const BlockStorage::BlockArray &blocks,
+                                              const int neighborIndex,
+                                              const int section);
+
+    // Fingerprint of a border without a neighbor chunk, which is treated as all solid so that no
+    // walls are generated at the frontier of the terrain
+    static const std::uint64_t MissingBorderFingerprint;
+
+    // Block that fills the paddings without a neighbor chunk
+    static constexpr BlockType MissingNeighborBlock{BlockType::Stone};
+
     glm::ivec2 _originXZ;
     std::array<TerrainChunk *, 4> _neighbors;
 
-    std::array<std::array<std::array<BlockType, SizeZ>, SizeY>, SizeX> _blocks;
-    std::int32_t _blockVersion;
+    BlockStorage _blockStorage;
+    std::array<std::int32_t, SectionCount> _blockVersions;
 
     bool _isVisible;
+    int _lodScale;
 
     std::mutex _blockFaceMutex;
-    bool _isBlockFaceReady;
-    std::array<std::vector<BlockFace>, 4> _blockFaces;
-    std::array<AlignedBox3D, 4> _blockFaceBoundingBoxes;
-    std::int32_t _blockFaceVersion;
-
-    std::array<InstancedRenderer, 4> _renderers;
+    TerrainChunkState _state;
+    // Sections being generated by a worker thread, or zero if there is no such task.
+    std::uint32_t _blockFaceSectionMask;
+    // Indexed by getBlockFaceSlot(), or null if no block faces are waiting for upload
+    std::unique_ptr<BlockFaceSlots> _blockFaces;
+    // Set in the Staged state, after BlockFaceUploader takes _blockFaces
+    std::unique_ptr<StagedBlockFaces> _stagedBlockFaces;
+    // Indexed by [group][section]
+    std::array<std::array<AlignedBox3D, SectionCount>, 4> _blockFaceBoundingBoxes;
+    std::array<std::int32_t, SectionCount> _blockFaceVersions;
+
+    BlockFaceRenderer _renderer;
+    std::array<std::array<AlignedBox3D, SectionCount>, 4> _rendererSectionBoundingBoxes;
     std::array<AlignedBox3D, 4> _rendererBoundingBoxes;
-    std::int32_t _rendererVersion;
+    std::array<std::int32_t, SectionCount> _rendererVersions;
+
+    // Indexed by [neighbor][section]
+    // Cached fingerprints of the borders of this chunk. They are always valid while the blocks are
+    // compressed, because writing a border block decompresses them.
+    mutable std::array<std::array<std::uint64_t, SectionCount>, 4> _borderFingerprints;
+    // Indexed by neighbor. Sections whose cached fingerprints are valid
+    mutable std::array<std::uint32_t, 4> _borderFingerprintSectionMasks;
+    // Fingerprints of the neighbor borders that the latest block faces are generated with, which
+    // are computed by the worker threads and set along with the block faces
+    std::array<std::array<std::uint64_t, SectionCount>, 4> _neighborBorderFingerprints;
 };
 
 inline const TerrainChunk *TerrainChunk::getNeighbor(const Direction direction) const
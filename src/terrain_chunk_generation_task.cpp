@@ -1,6 +1,5 @@
 #include "terrain_chunk_generation_task.h"
 
-#include "block_face_generation_task.h"
 #include "block_type.h"
 #include "constants.h"
 #include "glm/common.hpp"
@@ -123,14 +122,8 @@ void TerrainChunkGenerationTask::run()
             generateColumn(glm::ivec2{localX, localZ});
         }
     }
-    {
-        // After generating a new terrain chunk, we had better get its instance attributes ready.
-        // Otherwise, the chunk will spend a few additional frames to generate the attributes.
-        // This task can be a very large object, so we allocate it on the heap to avoid stack
-        // overflow errors.
-        const auto task{std::make_unique<BlockFaceGenerationTask>(_chunk.get())};
-        task->run();
-    }
+    // Block faces are generated later, once the neighbors of the chunk are ready. Generating them
+    // here would produce walls on the borders that are thrown away when the neighbors arrive.
     const std::lock_guard lock{_streamer->_mutex};
     _streamer->_pendingChunks.erase(_chunk->originXZ());
     _streamer->_readyChunks.push_back(std::move(_chunk));
@@ -1,10 +1,19 @@
 #include "terrain_streamer.h"
 
+#include "block_face_generation_task.h"
+#include "performance_counters.h"
 #include "terrain_chunk_generation_task.h"
 
+#include <QElapsedTimer>
 #include <QThreadPool>
 
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <ranges>
+#include <tuple>
 #include <utility>
 
 namespace minecraft {
@@ -15,6 +24,31 @@ constexpr auto VisibleDistance{512.0f};
 constexpr auto GenerateDistance{576.0f};
 constexpr auto ReleaseDistance{2048.0f};
 
+// Block data not accessed for this many frames are compressed in memory.
+constexpr auto CompressionIdleFrameCount{300};
+// Limit the number of compressions per frame to bound the time spent on them.
+constexpr auto MaxCompressionsPerFrame{2};
+
+// Chunks use the coarsest LOD grid whose error on screen is within this many pixels. The error of a
+// grid is taken as half of its cell size.
+constexpr auto MaxLodScreenSpaceError{12.0f};
+// Switching to a coarser grid needs a smaller error, so that chunks near the thresholds do not
+// switch back and forth.
+constexpr auto LodHysteresis{0.8f};
+// Limit the number of LOD switches of meshed chunks per frame, because each one regenerates the
+// block faces of the chunk and up to four neighbors. The other chunks switch in later frames.
+constexpr auto MaxLodSwitchesPerFrame{4};
+
+// Block face uploads stop for the frame once either budget is used up. The budgets are checked
+// before each chunk, so at least one chunk is uploaded per frame, and large meshes are never
+// starved.
+constexpr std::int64_t MaxUploadBytesPerFrame{std::int64_t{4} << 20};
+constexpr std::int64_t MaxUploadNanosecondsPerFrame{2'000'000};
+
+// Block face generation tasks run before the queued terrain chunk generation tasks, because they
+// update what is already on screen.
+constexpr auto BlockFaceGenerationPriority{1};
+
 float getChunkDistance(const glm::vec3 &position, const glm::ivec2 originXZ)
 {
     const glm::vec2 positionXZ{position.x, position.z};
@@ -24,10 +58,47 @@ float getChunkDistance(const glm::vec3 &position, const glm::ivec2 originXZ)
     return glm::length(distancesPerAxis);
 }
 
+// Neighbors of a chunk are ready if they are generated, or if they are too far away to be
+// generated, in which case the chunk is at the frontier of the terrain.
+bool areNeighborsReady(const TerrainChunk &chunk, const glm::vec3 &cameraPosition)
+{
+    const auto isNeighborReady{[&](const Direction direction, const glm::ivec2 offset) {
+        return chunk.getNeighbor(direction) != nullptr
+               || getChunkDistance(cameraPosition, chunk.originXZ() + offset) > GenerateDistance;
+    }};
+    return isNeighborReady(Direction::PositiveX, {TerrainChunk::SizeX, 0})
+           && isNeighborReady(Direction::NegativeX, {-TerrainChunk::SizeX, 0})
+           && isNeighborReady(Direction::PositiveZ, {0, TerrainChunk::SizeZ})
+           && isNeighborReady(Direction::NegativeZ, {0, -TerrainChunk::SizeZ});
+}
+
+// Returns the LOD scale of a chunk at the given distance. pixelsPerBlock is the size in pixels of a
+// block at unit distance.
+int selectLodScale(const int currentLodScale, const float distance, const float pixelsPerBlock)
+{
+    auto lodScale{1};
+    while (lodScale < TerrainChunk::MaxLodScale) {
+        const auto nextLodScale{lodScale * 2};
+        const auto error{0.5f * static_cast<float>(nextLodScale) * pixelsPerBlock
+                         / std::max(distance, 1.0f)};
+        const auto maxError{nextLodScale > currentLodScale
+                                ? MaxLodScreenSpaceError * LodHysteresis
+                                : MaxLodScreenSpaceError};
+        if (error > maxError) {
+            break;
+        }
+        lodScale = nextLodScale;
+    }
+    return lodScale;
+}
+
 } // namespace
 
-std::vector<TerrainChunk *> TerrainStreamer::update(const glm::vec3 &cameraPosition)
+std::vector<TerrainChunk *> TerrainStreamer::update(const Camera &camera)
 {
+    _changedBoundingBoxes.clear();
+
+    const auto &cameraPosition{camera.pose().position()};
     const glm::vec2 cameraXZ{cameraPosition.x, cameraPosition.z};
     const auto minOrigin{
         TerrainChunk::alignToChunkOrigin(glm::ivec2{glm::floor(cameraXZ - GenerateDistance)})};
@@ -79,39 +150,194 @@ std::vector<TerrainChunk *> TerrainStreamer::update(const glm::vec3 &cameraPosit
         });
     }
 
+    const auto pixelsPerBlock{static_cast<float>(camera.viewportHeight())
+                              / (2.0f * std::tan(glm::radians(camera.fieldOfViewY()) * 0.5f))};
+    std::array<std::int64_t, 4> lodChunkCounts{};
+    std::array<std::int64_t, 4> lodInstanceCounts{};
+    auto lodSwitchCount{0};
+
     std::vector<TerrainChunk *> result;
+    const auto prepareDraw{[&](TerrainChunk *const chunk, const float distance) {
+        if (const auto lodScale{selectLodScale(chunk->lodScale(), distance, pixelsPerBlock)};
+            lodScale != chunk->lodScale()) {
+            // Chunks without block faces yet switch for free.
+            const auto state{chunk->state()};
+            const auto isMeshed{state != TerrainChunkState::Generated
+                                && state != TerrainChunkState::NeighborsReady};
+            if (!isMeshed || lodSwitchCount < MaxLodSwitchesPerFrame) {
+                chunk->setLodScale(lodScale);
+                if (isMeshed) {
+                    ++lodSwitchCount;
+                }
+            }
+        }
+        const auto lodIndex{static_cast<std::size_t>(
+            std::countr_zero(static_cast<unsigned int>(chunk->lodScale())))};
+        ++lodChunkCounts[lodIndex];
+        lodInstanceCounts[lodIndex] += chunk->instanceCount();
+        if (chunk->state() == TerrainChunkState::Generated
+            && areNeighborsReady(*chunk, cameraPosition)) {
+            chunk->markNeighborsReady();
+        }
+        if (chunk->hasBlockFacesToUpload()) {
+            _blockFaceUploadQueue.push_back({.chunk = chunk, .distance = distance});
+        }
+        result.push_back(chunk);
+    }};
+    auto compressionCount{0};
+    std::int64_t compressedChunkCount{0};
+    std::int64_t residentChunkCount{0};
+    std::int64_t blockStorageBytes{0};
 
-    _terrain->forEachChunk([&cameraPosition, &result](TerrainChunk *const chunk) {
+    _terrain->forEachChunk([&](TerrainChunk *const chunk) {
         const auto distance{getChunkDistance(cameraPosition, chunk->originXZ())};
         if (distance <= VisibleDistance) {
             // All chunks closer than VisibleDistance are visible.
             if (!chunk->isVisible()) {
                 chunk->setVisible(true);
-                chunk->markSelfAndNeighborsDirty();
+                addChangedBoundingBox(chunk->rendererBoundingBox(BlockFaceGroup::Opaque));
+                // Neighbors that appeared or changed while this chunk was invisible, and neighbors
+                // that have never seen this chunk, need new block faces on the shared borders.
+                chunk->markStaleBordersDirty();
             }
-            chunk->prepareDraw();
-            result.push_back(chunk);
+            prepareDraw(chunk, distance);
         } else if (distance <= GenerateDistance) {
             // Do nothing for chunks between VisibleDistance and GenerateDistance. This introduces
             // hysteresis to prevent flickering.
             if (chunk->isVisible()) {
-                chunk->prepareDraw();
-                result.push_back(chunk);
+                prepareDraw(chunk, distance);
             }
         } else {
             // All chunks farther than GenerateDistance are invisible.
+            // Hiding a chunk does not change any blocks, so the neighbors need no new block faces.
             if (chunk->isVisible()) {
                 chunk->setVisible(false);
-                chunk->markSelfAndNeighborsDirty();
+                addChangedBoundingBox(chunk->rendererBoundingBox(BlockFaceGroup::Opaque));
             }
             // Release the renderer resources for chunks farther than ReleaseDistance.
             if (distance > ReleaseDistance) {
                 chunk->releaseRendererResources();
             }
         }
+
+        // Compress the block data of chunks that have not been accessed for a while. They are
+        // decompressed on the next access from physics, meshing, or edits.
+        auto &blockStorage{chunk->blockStorage()};
+        if (!blockStorage.isCompressed()
+            && blockStorage.incrementIdleFrameCount() > CompressionIdleFrameCount
+            && compressionCount < MaxCompressionsPerFrame) {
+            chunk->compressBlocks();
+            ++compressionCount;
+        }
+        ++(blockStorage.isCompressed() ? compressedChunkCount : residentChunkCount);
+        blockStorageBytes += static_cast<std::int64_t>(blockStorage.memoryUsage());
     });
 
+    auto &counters{PerformanceCounters::instance()};
+    counters.residentChunkCount = residentChunkCount;
+    counters.compressedChunkCount = compressedChunkCount;
+    counters.blockStorageBytes = blockStorageBytes;
+    for (const auto i : std::views::iota(0, 4)) {
+        counters.lodChunkCounts[i] = lodChunkCounts[i];
+        counters.lodInstanceCounts[i] = lodInstanceCounts[i];
+    }
+
+    uploadBlockFaces();
+    scheduleBlockFaceGeneration(result, camera);
+
     return result;
 }
 
+void TerrainStreamer::uploadBlockFaces()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // The queue is rebuilt every frame, so chunks that are no longer drawn are dropped from it.
+    std::ranges::sort(_blockFaceUploadQueue,
+                      [](const auto &a, const auto &b) { return a.distance < b.distance; });
+    std::int64_t uploadedBytes{0};
+    std::int64_t uploadedChunkCount{0};
+    for (const auto &request : _blockFaceUploadQueue) {
+        if (uploadedChunkCount > 0
+            && (uploadedBytes >= MaxUploadBytesPerFrame
+                || timer.nsecsElapsed() >= MaxUploadNanosecondsPerFrame)) {
+            break;
+        }
+        // The shadows of both the previous and the new block faces change. Faces may also be
+        // removed without uploading any bytes.
+        const auto previousBoundingBox{request.chunk->rendererBoundingBox(BlockFaceGroup::Opaque)};
+        const auto bytes{request.chunk->uploadBlockFaces()};
+        const auto &boundingBox{request.chunk->rendererBoundingBox(BlockFaceGroup::Opaque)};
+        if (bytes > 0 || boundingBox.minPoint() != previousBoundingBox.minPoint()
+            || boundingBox.maxPoint() != previousBoundingBox.maxPoint()) {
+            addChangedBoundingBox(previousBoundingBox);
+            addChangedBoundingBox(boundingBox);
+        }
+        uploadedBytes += bytes;
+        ++uploadedChunkCount;
+    }
+
+    auto &counters{PerformanceCounters::instance()};
+    const auto nanoseconds{timer.nsecsElapsed()};
+    counters.uploadedChunkCount += uploadedChunkCount;
+    counters.uploadedBytes += uploadedBytes;
+    counters.uploadNanoseconds += nanoseconds;
+    PerformanceCounters::updateMax(counters.maxUploadNanoseconds, nanoseconds);
+    counters.deferredUploadCount
+        = static_cast<std::int64_t>(_blockFaceUploadQueue.size()) - uploadedChunkCount;
+    _blockFaceUploadQueue.clear();
+}
+
+void TerrainStreamer::addChangedBoundingBox(const AlignedBox3D &boundingBox)
+{
+    if (!boundingBox.isEmpty()) {
+        _changedBoundingBoxes.push_back(boundingBox);
+    }
+}
+
+void TerrainStreamer::scheduleBlockFaceGeneration(const std::vector<TerrainChunk *> &chunks,
+                                                  const Camera &camera)
+{
+    const auto &cameraPosition{camera.pose().position()};
+
+    // Chunks that are no longer drawn are not queued again, which cancels their requests. Because
+    // the sections are determined when the task is created, requests never become stale when the
+    // blocks change while queued.
+    _blockFaceGenerationQueue.clear();
+    for (const auto chunk : chunks) {
+        if (chunk->needsBlockFaceGeneration()) {
+            _blockFaceGenerationQueue.push_back({
+                .chunk = chunk,
+                .isOutsideViewFrustum = !camera.isInViewFrustum(chunk->boundingBox()),
+                .distance = getChunkDistance(cameraPosition, chunk->originXZ()),
+            });
+        }
+    }
+
+    // Chunks in the view frustum come first, and then the closest chunks.
+    std::ranges::sort(_blockFaceGenerationQueue, [](const auto &a, const auto &b) {
+        return std::tie(a.isOutsideViewFrustum, a.distance)
+               < std::tie(b.isOutsideViewFrustum, b.distance);
+    });
+
+    const auto threadPool{QThreadPool::globalInstance()};
+    const auto taskCount{
+        std::max(threadPool->maxThreadCount() - BlockFaceGenerationTask::pendingCount(), 0)};
+    auto startedTaskCount{0};
+    for (const auto &request : _blockFaceGenerationQueue) {
+        if (startedTaskCount >= taskCount) {
+            break;
+        }
+        if (const auto task{request.chunk->createBlockFaceGenerationTask()}; task != nullptr) {
+            // Auto-deletion is enabled by default.
+            threadPool->start(task, BlockFaceGenerationPriority);
+            ++startedTaskCount;
+        }
+    }
+
+    PerformanceCounters::instance().queuedBlockFaceGenerationCount
+        = static_cast<std::int64_t>(_blockFaceGenerationQueue.size()) - startedTaskCount;
+}
+
 } // namespace minecraft
@@ -1,6 +1,8 @@
 #ifndef MINECRAFT_TERRAIN_STREAMER_H
 #define MINECRAFT_TERRAIN_STREAMER_H
 
+#include "aligned_box_3d.h"
+#include "camera.h"
 #include "ivec2_hash.h"
 #include "terrain.h"
 #include "terrain_chunk.h"
@@ -21,16 +23,55 @@ public:
         : _terrain{terrain}
     {}
 
-    std::vector<TerrainChunk *> update(const glm::vec3 &cameraPosition);
+    std::vector<TerrainChunk *> update(const Camera &camera);
+
+    // Bounding boxes of the opaque block faces that appeared or disappeared in the last update,
+    // whose shadows have changed
+    const std::vector<AlignedBox3D> &changedBoundingBoxes() const { return _changedBoundingBoxes; }
 
 private:
     friend class TerrainChunkGenerationTask;
+    friend class TerrainStreamerTest;
+
+    // A chunk waiting for block face generation, and the key to sort it by
+    struct BlockFaceGenerationRequest
+    {
+        TerrainChunk *chunk;
+        bool isOutsideViewFrustum;
+        float distance;
+    };
+
+    // A chunk whose block faces wait for upload, and the key to sort it by
+    struct BlockFaceUploadRequest
+    {
+        TerrainChunk *chunk;
+        float distance;
+    };
+
+    // Uploads the block faces of the queued chunks, the closest first, until the byte or time
+    // budget of the frame is used up. The other chunks keep drawing their previous block faces
+    // and stay queued for later frames.
+    void uploadBlockFaces();
+
+    // Starts block face generation tasks for the drawn chunks that need them, in the order of
+    // priority. Only as many tasks as worker threads are handed to the thread pool at a time, and
+    // the other chunks wait in a queue that is rebuilt every frame, so that they are re-prioritized
+    // as the camera moves, and dropped once they are no longer drawn.
+    void scheduleBlockFaceGeneration(const std::vector<TerrainChunk *> &chunks,
+                                     const Camera &camera);
+
+    void addChangedBoundingBox(const AlignedBox3D &boundingBox);
 
     Terrain *_terrain;
 
     std::mutex _mutex;
     std::unordered_set<glm::ivec2, IVec2Hash> _pendingChunks;
     std::vector<std::unique_ptr<TerrainChunk>> _readyChunks;
+
+    std::vector<BlockFaceUploadRequest> _blockFaceUploadQueue;
+    std::vector<BlockFaceGenerationRequest> _blockFaceGenerationQueue;
+
+    std::vector<AlignedBox3D> _changedBoundingBoxes;
 };
 
 } // namespace minecraft
@@ -29,6 +29,10 @@ struct UniformBufferData
 
     // Use vec4 instead of vec2 to avoid alignment issues.
     glm::vec4 shadowMapDepthBlurScales[ShadowMapCascadeCount];
+    // Offsets from the texture coordinates in the windows of the cascades to their texture layers
+    glm::vec4 shadowMapTextureOffsets[ShadowMapCascadeCount];
+    // Depth ranges that scale the normalized moments back, and minimum variances of the moments
+    glm::vec4 shadowMapMomentScales[ShadowMapCascadeCount];
 
     glm::mat4 viewMatrixInverse;
     glm::mat4 projectionMatrixInverse;
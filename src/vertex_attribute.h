@@ -22,24 +22,47 @@ struct VertexAttribute
 template<typename Vertex>
 struct VertexAttributeTrait;
 
+// Block face attributes packed into 8 bytes. Positions are relative to the chunk origin, which is
+// set per draw. See block_face.glsl for decoding.
 struct BlockFace
 {
-    glm::ivec3 faceOrigin;
-    GLubyte faceIndex;
-    GLubyte textureIndex;
-    GLubyte blockType;
-    GLubyte mediumType;
+    // Bits 0-5: x, bits 6-13: y, bits 14-19: z of the minimum block covered by the face
+    // Bits 20-22: face index
+    // Bits 23-29: number of blocks covered along the face tangent
+    GLuint geometry;
+    // Bits 0-7: number of blocks covered along the face bitangent
+    // Bits 8-15: texture index
+    // Bits 16-18: block type
+    // Bits 19-21: medium type
+    GLuint material;
+
+    static constexpr BlockFace pack(const glm::ivec3 &localPosition,
+                                    const int faceIndex,
+                                    const int width,
+                                    const int height,
+                                    const int textureIndex,
+                                    const int blockType,
+                                    const int mediumType)
+    {
+        return {
+            .geometry = static_cast<GLuint>(localPosition.x)
+                        | static_cast<GLuint>(localPosition.y) << 6
+                        | static_cast<GLuint>(localPosition.z) << 14
+                        | static_cast<GLuint>(faceIndex) << 20 | static_cast<GLuint>(width) << 23,
+            .material = static_cast<GLuint>(height) | static_cast<GLuint>(textureIndex) << 8
+                        | static_cast<GLuint>(blockType) << 16
+                        | static_cast<GLuint>(mediumType) << 19,
+        };
+    }
 };
 
+static_assert(sizeof(BlockFace) == 8);
+
 template<>
 struct VertexAttributeTrait<BlockFace>
 {
     static constexpr auto Attributes{std::to_array<VertexAttribute>({
-        {true, 0u, 3, GL_INT, offsetof(BlockFace, faceOrigin)},
-        {true, 1u, 1, GL_UNSIGNED_BYTE, offsetof(BlockFace, faceIndex)},
-        {true, 2u, 1, GL_UNSIGNED_BYTE, offsetof(BlockFace, textureIndex)},
-        {true, 3u, 1, GL_UNSIGNED_BYTE, offsetof(BlockFace, blockType)},
-        {true, 4u, 1, GL_UNSIGNED_BYTE, offsetof(BlockFace, mediumType)},
+        {true, 0u, 2, GL_UNSIGNED_INT, offsetof(BlockFace, geometry)},
     })};
 };
 
@@ -0,0 +1,178 @@
+#include "block_face_cache.h"
+#include "performance_counters.h"
+#include "vertex_attribute.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ranges>
+
+namespace minecraft {
+
+class BlockFaceCacheTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void insertAndFind();
+    void memoryEviction();
+    void diskRoundTrip();
+    void corruptedFilesAreRejected();
+
+private:
+    // Finds an entry with a new cache that indexes the files of the directory.
+    static std::shared_ptr<const BlockFaceCacheEntry> findOnDisk(const QString &directory,
+                                                                 const std::uint64_t key);
+    // Inserts an entry into a new cache and waits until its file is written.
+    static void insertToDisk(const QString &directory,
+                             const std::uint64_t key,
+                             std::shared_ptr<const BlockFaceCacheEntry> entry);
+};
+
+namespace {
+
+// An entry with the given number of faces in the first slot, which differ for each seed
+std::shared_ptr<const BlockFaceCacheEntry> createEntry(const int faceCount, const int seed)
+{
+    auto entry{std::make_shared<BlockFaceCacheEntry>()};
+    for (const auto i : std::views::iota(0, faceCount)) {
+        entry->blockFaces.push_back(
+            BlockFace::pack({i % 64, seed % 256, i / 64 % 64}, seed % 6, 1, 1, 0, 6, 0));
+    }
+    entry->slotOffsets.fill(static_cast<std::uint32_t>(faceCount));
+    entry->slotOffsets.front() = 0;
+    entry->minPoints.fill(glm::ivec3{0, seed, 0});
+    entry->maxPoints.fill(glm::ivec3{63, seed, 63});
+    return entry;
+}
+
+bool isEqual(const BlockFaceCacheEntry &a, const BlockFaceCacheEntry &b)
+{
+    const auto isFaceEqual{[](const BlockFace &faceA, const BlockFace &faceB) {
+        return faceA.geometry == faceB.geometry && faceA.material == faceB.material;
+    }};
+    return std::ranges::equal(a.blockFaces, b.blockFaces, isFaceEqual)
+           && a.slotOffsets == b.slotOffsets && a.minPoints == b.minPoints
+           && a.maxPoints == b.maxPoints;
+}
+
+} // namespace
+
+std::shared_ptr<const BlockFaceCacheEntry> BlockFaceCacheTest::findOnDisk(const QString &directory,
+                                                                          const std::uint64_t key)
+{
+    BlockFaceCache cache;
+    cache.setDirectory(directory);
+    auto entry{cache.find(key)};
+    cache._diskThreadPool.waitForDone();
+    return entry;
+}
+
+void BlockFaceCacheTest::insertToDisk(const QString &directory,
+                                      const std::uint64_t key,
+                                      std::shared_ptr<const BlockFaceCacheEntry> entry)
+{
+    BlockFaceCache cache;
+    cache.setDirectory(directory);
+    cache.insert(key, std::move(entry));
+    cache._diskThreadPool.waitForDone();
+}
+
+void BlockFaceCacheTest::insertAndFind()
+{
+    BlockFaceCache cache;
+    QVERIFY(cache.find(1) == nullptr);
+    const auto entry{createEntry(10, 1)};
+    cache.insert(1, entry);
+    QVERIFY(cache.find(1) == entry);
+    QVERIFY(cache.find(2) == nullptr);
+
+    // Entries with the same key have the same contents, so the first one is kept.
+    cache.insert(1, createEntry(10, 2));
+    QVERIFY(cache.find(1) == entry);
+    QCOMPARE(PerformanceCounters::instance().blockFaceCacheBytes.load(),
+             static_cast<std::int64_t>(entry->byteCount()));
+}
+
+void BlockFaceCacheTest::memoryEviction()
+{
+    // Room for two entries but not three
+    const auto byteCount{createEntry(100, 0)->byteCount()};
+    BlockFaceCache cache{byteCount * 5 / 2};
+    cache.insert(1, createEntry(100, 1));
+    cache.insert(2, createEntry(100, 2));
+    // Finding an entry makes it the most recently used one.
+    QVERIFY(cache.find(1) != nullptr);
+    cache.insert(3, createEntry(100, 3));
+    QVERIFY(cache.find(1) != nullptr);
+    QVERIFY(cache.find(2) == nullptr);
+    QVERIFY(cache.find(3) != nullptr);
+    QCOMPARE(cache._memoryByteCount, 2 * byteCount);
+}
+
+void BlockFaceCacheTest::diskRoundTrip()
+{
+    const QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const auto entry{createEntry(300, 7)};
+    insertToDisk(directory.path(), 0xFEDCBA9876543210ull, entry);
+
+    auto &counters{PerformanceCounters::instance()};
+    const auto diskHitCount{counters.blockFaceCacheDiskHitCount.load()};
+    const auto foundEntry{findOnDisk(directory.path(), 0xFEDCBA9876543210ull)};
+    QVERIFY(foundEntry != nullptr);
+    QVERIFY(isEqual(*foundEntry, *entry));
+    QCOMPARE(counters.blockFaceCacheDiskHitCount.load(), diskHitCount + 1);
+    QVERIFY(findOnDisk(directory.path(), 0xFEDCBA9876543211ull) == nullptr);
+
+    // Entries without faces are valid.
+    insertToDisk(directory.path(), 5, createEntry(0, 5));
+    const auto emptyEntry{findOnDisk(directory.path(), 5)};
+    QVERIFY(emptyEntry != nullptr);
+    QVERIFY(emptyEntry->blockFaces.empty());
+}
+
+void BlockFaceCacheTest::corruptedFilesAreRejected()
+{
+    const QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    BlockFaceCache cache;
+    cache.setDirectory(directory.path());
+    const auto getFilePath{[&cache](const std::uint64_t key) { return cache.getFilePath(key); }};
+    // Overwrites the bytes of a file at the given offset.
+    const auto corruptFile{[](const QString &filePath,
+                              const qint64 offset,
+                              const QByteArray &bytes) {
+        QFile file{filePath};
+        QVERIFY(file.open(QFile::ReadWrite));
+        QVERIFY(file.seek(offset));
+        QCOMPARE(file.write(bytes), static_cast<qint64>(bytes.size()));
+    }};
+    for (const auto key : std::views::iota(std::uint64_t{1}, std::uint64_t{6})) {
+        insertToDisk(directory.path(), key, createEntry(20, static_cast<int>(key)));
+    }
+
+    // The magic number, the format version, and the key of the header
+    corruptFile(getFilePath(1), 0, QByteArray{"XXXX"});
+    corruptFile(getFilePath(2), 4, QByteArray{"\x7F\x00\x00\x00", 4});
+    QVERIFY(QFile::remove(getFilePath(3)));
+    QVERIFY(QFile::copy(getFilePath(4), getFilePath(3)));
+    // A face count that does not match the size of the file
+    corruptFile(getFilePath(5), 16, QByteArray{"\x15\x00\x00\x00", 4});
+    for (const auto key : {1, 2, 3, 5}) {
+        QVERIFY(findOnDisk(directory.path(), key) == nullptr);
+        // Rejected files are removed, so that they are written again.
+        QVERIFY(!QFile::exists(getFilePath(key)));
+    }
+    QVERIFY(findOnDisk(directory.path(), 4) != nullptr);
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::BlockFaceCacheTest)
+
+#include "block_face_cache_test.moc"
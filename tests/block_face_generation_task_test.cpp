@@ -0,0 +1,181 @@
+#include "block_face_generation_task.h"
+#include "block_storage.h"
+#include "block_type.h"
+#include "terrain.h"
+#include "terrain_chunk.h"
+
+#include <QTest>
+
+#include <bitset>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <ranges>
+#include <utility>
+
+namespace minecraft {
+
+class BlockFaceGenerationTaskTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void emptyLayersAreSkipped();
+    void enclosedLayersAreSkipped();
+    void onlyLayersOfSectionsAreMeshed();
+    void downsamplingKeepsMostCommonBlocks();
+
+private:
+    // Returns the layers that a task for the given sections of the chunk would mesh.
+    static std::bitset<TerrainChunk::SizeY> getMeshedLayers(TerrainChunk &chunk,
+                                                            const std::uint32_t sectionMask);
+};
+
+namespace {
+
+void fillLayers(TerrainChunk &chunk, const int minY, const int maxY, const BlockType block)
+{
+    for (const auto x : std::views::iota(0, TerrainChunk::SizeX)) {
+        for (const auto y : std::views::iota(minY, maxY)) {
+            for (const auto z : std::views::iota(0, TerrainChunk::SizeZ)) {
+                chunk.setBlockAtLocal({x, y, z}, block);
+            }
+        }
+    }
+}
+
+std::bitset<TerrainChunk::SizeY> toLayers(const std::initializer_list<int> ys)
+{
+    std::bitset<TerrainChunk::SizeY> layers;
+    for (const auto y : ys) {
+        layers.set(static_cast<std::size_t>(y));
+    }
+    return layers;
+}
+
+} // namespace
+
+std::bitset<TerrainChunk::SizeY> BlockFaceGenerationTaskTest::getMeshedLayers(
+    TerrainChunk &chunk,
+    const std::uint32_t sectionMask)
+{
+    BlockFaceGenerationTask task{&chunk, sectionMask};
+    task.selectLayers();
+    return task._meshedLayers;
+}
+
+void BlockFaceGenerationTaskTest::emptyLayersAreSkipped()
+{
+    TerrainChunk chunk{{0, 0}};
+    QVERIFY(getMeshedLayers(chunk, TerrainChunk::AllSectionsMask).none());
+
+    // Layers with a few blocks are meshed, and so are full layers exposed to air.
+    chunk.setBlockAtLocal({3, 70, 5}, BlockType::Grass);
+    fillLayers(chunk, 100, 101, BlockType::Water);
+    QVERIFY(getMeshedLayers(chunk, TerrainChunk::AllSectionsMask) == toLayers({70, 100}));
+}
+
+void BlockFaceGenerationTaskTest::enclosedLayersAreSkipped()
+{
+    // Missing neighbors are treated as solid, so only the bottom and top layers of solid ground
+    // have visible faces.
+    Terrain terrain;
+    terrain.setChunk(std::make_unique<TerrainChunk>(glm::ivec2{0, 0}));
+    auto &chunk{*terrain.getChunk({0, 0})};
+    fillLayers(chunk, 0, 100, BlockType::Stone);
+    QVERIFY(getMeshedLayers(chunk, TerrainChunk::AllSectionsMask) == toLayers({0, 99}));
+
+    // A hole exposes its own layer and the faces of the layers above and below it.
+    chunk.setBlockAtLocal({10, 30, 10}, BlockType::Air);
+    QVERIFY(getMeshedLayers(chunk, TerrainChunk::AllSectionsMask)
+            == toLayers({0, 29, 30, 31, 99}));
+    chunk.setBlockAtLocal({10, 30, 10}, BlockType::Stone);
+
+    // Water is not solid, so it exposes the faces around it.
+    chunk.setBlockAtLocal({10, 60, 10}, BlockType::Water);
+    QVERIFY(getMeshedLayers(chunk, TerrainChunk::AllSectionsMask)
+            == toLayers({0, 59, 60, 61, 99}));
+    chunk.setBlockAtLocal({10, 60, 10}, BlockType::Stone);
+
+    // A solid neighbor keeps the layers enclosed, but a hole in its border exposes the border of
+    // the chunk at that layer.
+    auto neighbor{std::make_unique<TerrainChunk>(glm::ivec2{TerrainChunk::SizeX, 0})};
+    fillLayers(*neighbor, 0, 100, BlockType::Stone);
+    neighbor->setBlockAtLocal({0, 50, 20}, BlockType::Air);
+    neighbor->setBlockAtLocal({1, 70, 20}, BlockType::Air);
+    terrain.setChunk(std::move(neighbor));
+    QVERIFY(getMeshedLayers(chunk, TerrainChunk::AllSectionsMask) == toLayers({0, 50, 99}));
+}
+
+void BlockFaceGenerationTaskTest::onlyLayersOfSectionsAreMeshed()
+{
+    TerrainChunk chunk{{0, 0}};
+    fillLayers(chunk, 0, 100, BlockType::Stone);
+
+    // The top layer of the ground is in section 6.
+    QVERIFY(getMeshedLayers(chunk, 1u << 6) == toLayers({99}));
+    QVERIFY(getMeshedLayers(chunk, (1u << 1) | (1u << 5)).none());
+    QVERIFY(getMeshedLayers(chunk, 0u).none());
+
+    // Cells of a LOD grid are only known after downsampling, so all layers of the sections are
+    // meshed, in the coordinates of the grid.
+    chunk.setLodScale(4);
+    const auto sectionSizeY{TerrainChunk::SectionSizeY / 4};
+    std::bitset<TerrainChunk::SizeY> layers;
+    for (const auto y : std::views::iota(sectionSizeY, 2 * sectionSizeY)) {
+        layers.set(static_cast<std::size_t>(y));
+    }
+    QVERIFY(getMeshedLayers(chunk, 1u << 1) == layers);
+}
+
+void BlockFaceGenerationTaskTest::downsamplingKeepsMostCommonBlocks()
+{
+    // About 1 MiB, filled with air
+    const auto blocks{std::make_unique<BlockStorage::BlockArray>()};
+    // Fills a cell in X, Y, Z order with the given numbers of blocks, and the rest with air.
+    const auto fillCell{[&blocks](const glm::ivec3 &cell,
+                                  const int scale,
+                                  const std::initializer_list<std::pair<BlockType, int>> counts) {
+        auto i{0};
+        const auto setBlock{[&](const BlockType block) {
+            const auto position{cell * scale
+                                + glm::ivec3{i / (scale * scale), i / scale % scale, i % scale}};
+            (*blocks)[position.x][position.y][position.z] = block;
+            ++i;
+        }};
+        for (const auto &[block, count] : counts) {
+            for ([[maybe_unused]] const auto j : std::views::iota(0, count)) {
+                setBlock(block);
+            }
+        }
+        while (i < scale * scale * scale) {
+            setBlock(BlockType::Air);
+        }
+    }};
+    const auto getDownsampledBlock{[&blocks](const glm::ivec3 &cell, const int scale) {
+        return BlockFaceGenerationTask::getDownsampledBlock(*blocks, cell, scale);
+    }};
+
+    // The most common block wins, even if it is not the majority of the cell.
+    fillCell({0, 0, 0}, 2, {{BlockType::Stone, 3}, {BlockType::Dirt, 2}, {BlockType::Water, 2}});
+    QCOMPARE(getDownsampledBlock({0, 0, 0}, 2), BlockType::Stone);
+    // Blocks are read as they are without downsampling.
+    QCOMPARE(getDownsampledBlock({1, 0, 0}, 1), BlockType::Dirt);
+
+    // A tie with air keeps the other block, but air wins if it is more common.
+    fillCell({1, 0, 0}, 2, {{BlockType::Water, 4}});
+    QCOMPARE(getDownsampledBlock({1, 0, 0}, 2), BlockType::Water);
+    fillCell({1, 0, 0}, 2, {{BlockType::Water, 3}});
+    QCOMPARE(getDownsampledBlock({1, 0, 0}, 2), BlockType::Air);
+
+    fillCell({1, 1, 1}, 8, {{BlockType::Grass, 256}});
+    QCOMPARE(getDownsampledBlock({1, 1, 1}, 8), BlockType::Grass);
+    fillCell({1, 1, 1}, 8, {{BlockType::Grass, 255}, {BlockType::Stone, 1}});
+    QCOMPARE(getDownsampledBlock({1, 1, 1}, 8), BlockType::Air);
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::BlockFaceGenerationTaskTest)
+
+#include "block_face_generation_task_test.moc"
@@ -0,0 +1,129 @@
+#include "block_face_mesher.h"
+#include "object_pool.h"
+#include "terrain_chunk.h"
+
+#include <QTest>
+
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <ranges>
+#include <vector>
+
+namespace {
+
+// Number of calls to the global operator new, which the array and sized forms also go through
+std::atomic<std::int64_t> allocationCount{0};
+
+} // namespace
+
+void *operator new(const std::size_t size)
+{
+    ++allocationCount;
+    if (const auto pointer{std::malloc(size != 0 ? size : 1)}; pointer != nullptr) {
+        return pointer;
+    }
+    throw std::bad_alloc{};
+}
+
+// GCC warns when it inlines these into code that allocated with operator new, which is replaced
+// above to allocate with malloc.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *const pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *const pointer, const std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace minecraft {
+
+class BlockFaceMesherAllocationTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void steadyStateMeshing();
+};
+
+void BlockFaceMesherAllocationTest::steadyStateMeshing()
+{
+    // Two chunks with different numbers of faces are meshed in turns, as when a chunk is edited
+    // back and forth. Their blocks are generated before counting.
+    std::vector<std::unique_ptr<BlockFaceMesher::PaddedBlockArray>> chunkBlocks;
+    std::mt19937 generator{7u};
+    for (const auto airProbability : {0.3, 0.6}) {
+        std::bernoulli_distribution isAir{airProbability};
+        auto &blocks{*chunkBlocks.emplace_back(
+            std::make_unique<BlockFaceMesher::PaddedBlockArray>())};
+        for (auto &layers : blocks) {
+            for (auto &row : layers | std::views::drop(1) | std::views::take(TerrainChunk::SizeY)) {
+                for (auto &block : row) {
+                    block = isAir(generator) ? BlockType::Air : BlockType::Stone;
+                }
+            }
+        }
+    }
+    std::bitset<TerrainChunk::SizeY> meshedLayers;
+    meshedLayers.set();
+
+    // The same steps as BlockFaceGenerationTask, without the chunk and the cache.
+    ObjectPool<BlockFaceMesher> mesherPool{2};
+    ObjectPool<BlockFaceSlots> blockFacePool{2};
+    std::vector<std::size_t> previousInstanceCounts(TerrainChunk::BlockFaceSlotCount, 0);
+    BlockFaceMesher::SectionPoints minPoints;
+    BlockFaceMesher::SectionPoints maxPoints;
+    constexpr auto WarmUpCount{2};
+    for (const auto i : std::views::iota(0, WarmUpCount + 8)) {
+        const auto initialAllocationCount{allocationCount.load()};
+
+        auto mesher{mesherPool.acquire()};
+        auto blockFaces{blockFacePool.acquire()};
+        blockFaces->resize(TerrainChunk::BlockFaceSlotCount);
+        for (const auto slot : std::views::iota(std::size_t{0}, blockFaces->size())) {
+            (*blockFaces)[slot].clear();
+            (*blockFaces)[slot].reserve(previousInstanceCounts[slot]);
+        }
+        for (const auto group : std::views::iota(0, 4)) {
+            minPoints[group].fill(glm::ivec3{std::numeric_limits<int>::max()});
+            maxPoints[group].fill(glm::ivec3{std::numeric_limits<int>::min()});
+        }
+        mesher->blocks() = *chunkBlocks[static_cast<std::size_t>(i % 2)];
+        mesher->generate(1, meshedLayers, {0, 0}, *blockFaces, minPoints, maxPoints);
+        for (const auto slot : std::views::iota(std::size_t{0}, blockFaces->size())) {
+            previousInstanceCounts[slot] = (*blockFaces)[slot].size();
+        }
+        mesherPool.release(std::move(mesher));
+        blockFacePool.release(std::move(blockFaces));
+
+        // Both chunks are meshed once before the pooled objects have enough capacity for both.
+        const auto meshAllocationCount{allocationCount.load() - initialAllocationCount};
+        if (i == 0) {
+            QVERIFY(meshAllocationCount > 0);
+        } else if (i >= WarmUpCount) {
+            QCOMPARE(meshAllocationCount, std::int64_t{0});
+        }
+    }
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::BlockFaceMesherAllocationTest)
+
+#include "block_face_mesher_allocation_test.moc"
@@ -0,0 +1,344 @@
+#include "block_face_mesher.h"
+#include "constants.h"
+#include "direction.h"
+#include "terrain_chunk.h"
+
+#include <QTest>
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <random>
+#include <ranges>
+#include <string>
+#include <vector>
+
+namespace minecraft {
+
+namespace {
+
+constexpr auto FaceDirections{std::to_array<glm::ivec3>({
+    {1, 0, 0},
+    {-1, 0, 0},
+    {0, 1, 0},
+    {0, -1, 0},
+    {0, 0, 1},
+    {0, 0, -1},
+})};
+
+// Axes of the face tangents and bitangents. See block_face.glsl.
+constexpr auto FaceTangentAxes{std::to_array<int>({2, 2, 0, 0, 0, 0})};
+constexpr auto FaceBitangentAxes{std::to_array<int>({1, 1, 2, 2, 1, 1})};
+
+// A face of a single block: x, y, z, face index, block type, medium type, and group set
+using UnitFace = std::array<int, 7>;
+
+bool isFluid(const BlockType block)
+{
+    return block == BlockType::Air || block == BlockType::Water || block == BlockType::Lava;
+}
+
+// The face rules of the mesher, written out per block.
+bool isFaceVisible(const BlockType block, const BlockType neighbor, const int faceIndex)
+{
+    switch (block) {
+    case BlockType::Air:
+        return false;
+    case BlockType::Water:
+        return Direction{faceIndex} == Direction::PositiveY && neighbor == BlockType::Air;
+    case BlockType::Lava:
+        return neighbor == BlockType::Air || neighbor == BlockType::Water;
+    default:
+        return isFluid(neighbor);
+    }
+}
+
+int getGroupSet(const BlockType block, const BlockType neighbor, const int y)
+{
+    if (block == BlockType::Water) {
+        return static_cast<int>(BlockFaceGroupSet::Translucent);
+    }
+    const auto isUnderWater{y < WaterLevel && neighbor == BlockType::Water};
+    const auto isAboveWater{y >= WaterLevel - 1};
+    if (isUnderWater) {
+        return static_cast<int>(isAboveWater ? BlockFaceGroupSet::OpaqueAboveAndUnderWater
+                                             : BlockFaceGroupSet::OpaqueUnderWater);
+    }
+    return static_cast<int>(isAboveWater ? BlockFaceGroupSet::OpaqueAboveWater
+                                         : BlockFaceGroupSet::Opaque);
+}
+
+// Generates the unit faces of the meshed layers one block at a time.
+std::vector<UnitFace> generateNaiveFaces(const BlockFaceMesher::PaddedBlockArray &blocks,
+                                         const std::bitset<TerrainChunk::SizeY> &meshedLayers)
+{
+    std::vector<UnitFace> faces;
+    for (const auto x : std::views::iota(0, TerrainChunk::SizeX)) {
+        for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
+            if (!meshedLayers.test(static_cast<std::size_t>(y))) {
+                continue;
+            }
+            for (const auto z : std::views::iota(0, TerrainChunk::SizeZ)) {
+                const auto block{blocks[x + 1][y + 1][z + 1]};
+                for (const auto faceIndex : std::views::iota(0, 6)) {
+                    const auto neighborPosition{glm::ivec3{x, y, z} + FaceDirections[faceIndex]};
+                    const auto neighbor{blocks[neighborPosition.x + 1][neighborPosition.y + 1]
+                                              [neighborPosition.z + 1]};
+                    if (isFaceVisible(block, neighbor, faceIndex)) {
+                        faces.push_back({x,
+                                         y,
+                                         z,
+                                         faceIndex,
+                                         static_cast<int>(block),
+                                         static_cast<int>(neighbor),
+                                         getGroupSet(block, neighbor, y)});
+                    }
+                }
+            }
+        }
+    }
+    return faces;
+}
+
+// Decodes the merged faces into unit faces, checking that every unit face is in the slot of its
+// direction, group set, and section, and inside the bounding boxes of its groups.
+void expandBlockFaces(const BlockFaceSlots &blockFaces,
+                      const glm::ivec2 &originXZ,
+                      const BlockFaceMesher::SectionPoints &minPoints,
+                      const BlockFaceMesher::SectionPoints &maxPoints,
+                      std::vector<UnitFace> &faces)
+{
+    for (const auto faceIndex : std::views::iota(0, 6)) {
+        for (const auto groupSet : std::views::iota(0, TerrainChunk::BlockFaceGroupSetCount)) {
+            for (const auto section : std::views::iota(0, TerrainChunk::SectionCount)) {
+                const auto slot{TerrainChunk::getBlockFaceSlot(faceIndex, groupSet, section)};
+                for (const auto &blockFace : blockFaces[static_cast<std::size_t>(slot)]) {
+                    const glm::ivec3 position{
+                        static_cast<int>(blockFace.geometry & 0x3Fu),
+                        static_cast<int>((blockFace.geometry >> 6) & 0xFFu),
+                        static_cast<int>((blockFace.geometry >> 14) & 0x3Fu),
+                    };
+                    const auto width{static_cast<int>((blockFace.geometry >> 23) & 0x7Fu)};
+                    const auto height{static_cast<int>(blockFace.material & 0xFFu)};
+                    const auto blockType{static_cast<int>((blockFace.material >> 16) & 0x7u)};
+                    const auto mediumType{static_cast<int>((blockFace.material >> 19) & 0x7u)};
+                    QCOMPARE(static_cast<int>((blockFace.geometry >> 20) & 0x7u), faceIndex);
+                    for (const auto i : std::views::iota(0, width)) {
+                        for (const auto j : std::views::iota(0, height)) {
+                            auto unitPosition{position};
+                            unitPosition[FaceTangentAxes[faceIndex]] += i;
+                            unitPosition[FaceBitangentAxes[faceIndex]] += j;
+                            QCOMPARE(unitPosition.y / TerrainChunk::SectionSizeY, section);
+                            const glm::ivec3 minPoint{originXZ[0] + unitPosition.x,
+                                                      unitPosition.y,
+                                                      originXZ[1] + unitPosition.z};
+                            const auto maxPoint{minPoint + glm::ivec3{1}};
+                            for (const auto group : std::views::iota(0, 4)) {
+                                const auto [firstSet, lastSet]{
+                                    TerrainChunk::getGroupSetRange(BlockFaceGroup{group})};
+                                if (groupSet < firstSet || groupSet >= lastSet) {
+                                    continue;
+                                }
+                                const auto &groupMin{minPoints[group][section]};
+                                const auto &groupMax{maxPoints[group][section]};
+                                QVERIFY2(minPoint.x >= groupMin.x && minPoint.y >= groupMin.y
+                                             && minPoint.z >= groupMin.z
+                                             && maxPoint.x <= groupMax.x
+                                             && maxPoint.y <= groupMax.y
+                                             && maxPoint.z <= groupMax.z,
+                                         "A face is outside the bounding box of its group.");
+                            }
+                            faces.push_back({unitPosition.x,
+                                             unitPosition.y,
+                                             unitPosition.z,
+                                             faceIndex,
+                                             blockType,
+                                             mediumType,
+                                             groupSet});
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+std::string toString(const UnitFace &face)
+{
+    std::string string{"("};
+    for (const auto &value : face) {
+        string += std::to_string(value) + (&value == &face.back() ? ")" : ", ");
+    }
+    return string;
+}
+
+// Fills the blocks of the chunk and its X/Z paddings from a function of the position in the chunk,
+// where the paddings are at -1 and Size. The Y paddings are left as air.
+void fillBlocks(BlockFaceMesher &mesher,
+                const std::function<BlockType(const glm::ivec3 &)> &getBlock)
+{
+    auto &blocks{mesher.blocks()};
+    for (const auto x : std::views::iota(0, TerrainChunk::SizeX + 2)) {
+        for (const auto y : std::views::iota(0, TerrainChunk::SizeY + 2)) {
+            for (const auto z : std::views::iota(0, TerrainChunk::SizeZ + 2)) {
+                const auto isYPadding{y == 0 || y == TerrainChunk::SizeY + 1};
+                blocks[x][y][z] = isYPadding ? BlockType::Air
+                                             : getBlock(glm::ivec3{x - 1, y - 1, z - 1});
+            }
+        }
+    }
+}
+
+std::bitset<TerrainChunk::SizeY> getSectionLayers(const std::uint32_t sectionMask)
+{
+    std::bitset<TerrainChunk::SizeY> layers;
+    for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
+        layers.set(static_cast<std::size_t>(y),
+                   ((sectionMask >> (y / TerrainChunk::SectionSizeY)) & 1u) != 0);
+    }
+    return layers;
+}
+
+} // namespace
+
+class BlockFaceMesherTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void randomBlocks();
+    void allSolid();
+    void checkerboard();
+    void waterBoundaries();
+    void chunkBorders();
+    void partialSections();
+
+private:
+    // Meshes the blocks of the mesher with both meshers, and compares the unit faces they cover.
+    void verifyFaces(const std::bitset<TerrainChunk::SizeY> &meshedLayers);
+
+    std::unique_ptr<BlockFaceMesher> _mesher{std::make_unique<BlockFaceMesher>()};
+};
+
+void BlockFaceMesherTest::verifyFaces(const std::bitset<TerrainChunk::SizeY> &meshedLayers)
+{
+    // An origin far from zero, so that chunk-relative and world positions are not confused.
+    const glm::ivec2 originXZ{-192, 320};
+    BlockFaceSlots blockFaces(TerrainChunk::BlockFaceSlotCount);
+    BlockFaceMesher::SectionPoints minPoints;
+    BlockFaceMesher::SectionPoints maxPoints;
+    for (const auto i : std::views::iota(0, 4)) {
+        minPoints[i].fill(glm::ivec3{std::numeric_limits<int>::max()});
+        maxPoints[i].fill(glm::ivec3{std::numeric_limits<int>::min()});
+    }
+    _mesher->generate(1, meshedLayers, originXZ, blockFaces, minPoints, maxPoints);
+
+    auto expectedFaces{generateNaiveFaces(_mesher->blocks(), meshedLayers)};
+    std::vector<UnitFace> faces;
+    expandBlockFaces(blockFaces, originXZ, minPoints, maxPoints, faces);
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+    std::ranges::sort(expectedFaces);
+    std::ranges::sort(faces);
+    if (const auto duplicate{std::ranges::adjacent_find(faces)}; duplicate != faces.end()) {
+        QFAIL(("Unit face covered twice: " + toString(*duplicate)).c_str());
+    }
+    const auto [expectedEnd, end]{std::ranges::mismatch(expectedFaces, faces)};
+    if (expectedEnd != expectedFaces.end()) {
+        QFAIL(("Unit face missing: " + toString(*expectedEnd)).c_str());
+    }
+    if (end != faces.end()) {
+        QFAIL(("Unit face not visible: " + toString(*end)).c_str());
+    }
+}
+
+void BlockFaceMesherTest::randomBlocks()
+{
+    for (const auto seed : std::views::iota(0u, 4u)) {
+        std::mt19937 generator{seed};
+        // Mostly air and stone, so that faces can be merged, with some of every other type.
+        std::discrete_distribution<int> distribution{8, 1, 1, 1, 1, 1, 8, 2};
+        fillBlocks(*_mesher, [&](const glm::ivec3 &) {
+            return static_cast<BlockType>(distribution(generator));
+        });
+        verifyFaces(getSectionLayers(TerrainChunk::AllSectionsMask));
+    }
+}
+
+void BlockFaceMesherTest::allSolid()
+{
+    fillBlocks(*_mesher, [](const glm::ivec3 &) { return BlockType::Stone; });
+    verifyFaces(getSectionLayers(TerrainChunk::AllSectionsMask));
+}
+
+void BlockFaceMesherTest::checkerboard()
+{
+    fillBlocks(*_mesher, [](const glm::ivec3 &position) {
+        return (position.x + position.y + position.z) % 2 == 0 ? BlockType::Stone : BlockType::Air;
+    });
+    verifyFaces(getSectionLayers(TerrainChunk::AllSectionsMask));
+}
+
+void BlockFaceMesherTest::waterBoundaries()
+{
+    // Rolling terrain that crosses the water level, with lava pockets under the water and islands
+    // above it. Water at the X paddings is cut off, so that water meets air at the chunk border.
+    fillBlocks(*_mesher, [](const glm::ivec3 &position) {
+        const auto height{WaterLevel - 8 + (position.x * 7 + position.z * 3) % 17};
+        if (position.y < height - 3) {
+            return (position.x / 4 + position.z / 4) % 5 == 0 && position.y > height - 6
+                       ? BlockType::Lava
+                       : BlockType::Stone;
+        }
+        if (position.y < height) {
+            return BlockType::Dirt;
+        }
+        if (position.y == height) {
+            return position.y >= WaterLevel ? BlockType::Grass : BlockType::Dirt;
+        }
+        const auto isPadding{position.x < 0 || position.x >= TerrainChunk::SizeX};
+        return position.y < WaterLevel && !isPadding ? BlockType::Water : BlockType::Air;
+    });
+    verifyFaces(getSectionLayers(TerrainChunk::AllSectionsMask));
+}
+
+void BlockFaceMesherTest::chunkBorders()
+{
+    // A solid chunk whose neighbors are air, water, lava, and solid, so that only the borders have
+    // faces, and the faces of each border have their own medium.
+    fillBlocks(*_mesher, [](const glm::ivec3 &position) {
+        if (position.x >= TerrainChunk::SizeX) {
+            return BlockType::Air;
+        }
+        if (position.x < 0) {
+            return BlockType::Water;
+        }
+        if (position.z >= TerrainChunk::SizeZ) {
+            return BlockType::Lava;
+        }
+        return position.y == TerrainChunk::SizeY - 1 ? BlockType::Snow : BlockType::Stone;
+    });
+    verifyFaces(getSectionLayers(TerrainChunk::AllSectionsMask));
+}
+
+void BlockFaceMesherTest::partialSections()
+{
+    // Faces are only generated in the meshed sections, and never merged across sections.
+    std::mt19937 generator{42u};
+    std::bernoulli_distribution isAir{0.2};
+    fillBlocks(*_mesher, [&](const glm::ivec3 &) {
+        return isAir(generator) ? BlockType::Air : BlockType::Dirt;
+    });
+    verifyFaces(getSectionLayers(0b0011'0000'1010u));
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::BlockFaceMesherTest)
+
+#include "block_face_mesher_test.moc"
@@ -0,0 +1,176 @@
+#include "block_storage.h"
+#include "performance_counters.h"
+
+#include <QTest>
+
+#include <ranges>
+
+namespace minecraft {
+
+class BlockStorageTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void layerSummaryFollowsWrites();
+    void layerSummarySurvivesCompression();
+    void snapshotIsCopiedOnWrite();
+    void compressionRoundTrip();
+};
+
+namespace {
+
+void fillLayer(BlockStorage &storage, const int y, const BlockType block)
+{
+    for (const auto x : std::views::iota(0, BlockStorage::SizeX)) {
+        for (const auto z : std::views::iota(0, BlockStorage::SizeZ)) {
+            storage.set({x, y, z}, block);
+        }
+    }
+}
+
+// Blocks with runs of very different lengths: air and stone spanning many full-height columns,
+// single blocks alternating, and layered terrain columns.
+BlockType getRoundTripBlock(const int x, const int y, const int z)
+{
+    if (x < 8) {
+        return BlockType::Air;
+    }
+    if (x < 16) {
+        return BlockType::Stone;
+    }
+    if (x < 18) {
+        return (x + y + z) % 2 == 0 ? BlockType::Dirt : BlockType::Water;
+    }
+    if (y == 0) {
+        return BlockType::Bedrock;
+    }
+    if (y < 40 + (x + z) % 8) {
+        return BlockType::Stone;
+    }
+    return y < 60 ? BlockType::Grass : BlockType::Air;
+}
+
+} // namespace
+
+void BlockStorageTest::layerSummaryFollowsWrites()
+{
+    BlockStorage storage;
+    QVERIFY(storage.emptyLayers().all());
+    QVERIFY(storage.solidLayers().none());
+
+    fillLayer(storage, 10, BlockType::Stone);
+    QVERIFY(!storage.emptyLayers().test(10));
+    QVERIFY(storage.solidLayers().test(10));
+    QCOMPARE(storage.emptyLayers().count(), std::size_t{BlockStorage::SizeY - 1});
+    QCOMPARE(storage.solidLayers().count(), std::size_t{1});
+
+    // Writing the same block again changes nothing.
+    storage.set({3, 10, 4}, BlockType::Stone);
+    QVERIFY(storage.solidLayers().test(10));
+
+    // Water and lava are neither air nor solid.
+    storage.set({3, 10, 4}, BlockType::Water);
+    QVERIFY(!storage.emptyLayers().test(10));
+    QVERIFY(!storage.solidLayers().test(10));
+    storage.set({3, 10, 4}, BlockType::Lava);
+    QVERIFY(!storage.solidLayers().test(10));
+    storage.set({3, 10, 4}, BlockType::Dirt);
+    QVERIFY(storage.solidLayers().test(10));
+
+    fillLayer(storage, 10, BlockType::Air);
+    QVERIFY(storage.emptyLayers().all());
+    QVERIFY(storage.solidLayers().none());
+}
+
+void BlockStorageTest::layerSummarySurvivesCompression()
+{
+    BlockStorage storage;
+    fillLayer(storage, 0, BlockType::Bedrock);
+    storage.set({1, 1, 1}, BlockType::Grass);
+    const auto emptyLayers{storage.emptyLayers()};
+    const auto solidLayers{storage.solidLayers()};
+
+    storage.compress();
+    QVERIFY(storage.isCompressed());
+    QVERIFY(storage.emptyLayers() == emptyLayers);
+    QVERIFY(storage.solidLayers() == solidLayers);
+
+    // Writes after decompression keep counting from the same numbers.
+    storage.set({1, 1, 1}, BlockType::Air);
+    QVERIFY(!storage.isCompressed());
+    QVERIFY(storage.emptyLayers().test(1));
+    QVERIFY(storage.solidLayers().test(0));
+}
+
+void BlockStorageTest::snapshotIsCopiedOnWrite()
+{
+    auto &copyCount{PerformanceCounters::instance().blockCopyOnWriteCount};
+    BlockStorage storage;
+    storage.set({0, 0, 0}, BlockType::Stone);
+
+    // Writes while a snapshot is alive go to a copy.
+    auto snapshot{storage.snapshot()};
+    auto initialCopyCount{copyCount.load()};
+    storage.set({0, 0, 0}, BlockType::Grass);
+    storage.set({0, 1, 0}, BlockType::Grass);
+    QCOMPARE((*snapshot)[0][0][0], BlockType::Stone);
+    QCOMPARE((*snapshot)[0][1][0], BlockType::Air);
+    QCOMPARE(storage.get({0, 0, 0}), BlockType::Grass);
+    QCOMPARE(copyCount.load() - initialCopyCount, std::int64_t{1});
+
+    // Writes after the snapshot is released modify the data in place.
+    snapshot.reset();
+    initialCopyCount = copyCount.load();
+    storage.set({0, 0, 0}, BlockType::Dirt);
+    QCOMPARE(copyCount.load() - initialCopyCount, std::int64_t{0});
+
+    // Snapshots outlive the array dropped by compression.
+    snapshot = storage.snapshot();
+    storage.compress();
+    QCOMPARE((*snapshot)[0][0][0], BlockType::Dirt);
+    storage.set({0, 0, 0}, BlockType::Stone);
+    QCOMPARE((*snapshot)[0][0][0], BlockType::Dirt);
+    QCOMPARE(storage.get({0, 0, 0}), BlockType::Stone);
+}
+
+void BlockStorageTest::compressionRoundTrip()
+{
+    BlockStorage storage;
+    for (const auto x : std::views::iota(0, BlockStorage::SizeX)) {
+        for (const auto y : std::views::iota(0, BlockStorage::SizeY)) {
+            for (const auto z : std::views::iota(0, BlockStorage::SizeZ)) {
+                storage.set({x, y, z}, getRoundTripBlock(x, y, z));
+            }
+        }
+    }
+
+    storage.compress();
+    QVERIFY(storage.isCompressed());
+    QVERIFY(storage.memoryUsage() < sizeof(BlockStorage::BlockArray) / 8);
+
+    auto &counters{PerformanceCounters::instance()};
+    counters.maxChunkDecompressionNanoseconds = 0;
+    const auto initialDecompressionCount{counters.chunkDecompressionCount.load()};
+
+    // The first read decompresses all blocks at once.
+    auto differentBlockCount{0};
+    for (const auto x : std::views::iota(0, BlockStorage::SizeX)) {
+        for (const auto y : std::views::iota(0, BlockStorage::SizeY)) {
+            for (const auto z : std::views::iota(0, BlockStorage::SizeZ)) {
+                differentBlockCount += storage.get({x, y, z}) != getRoundTripBlock(x, y, z);
+            }
+        }
+    }
+    QCOMPARE(differentBlockCount, 0);
+    QVERIFY(!storage.isCompressed());
+    QCOMPARE(counters.chunkDecompressionCount.load() - initialDecompressionCount,
+             std::int64_t{1});
+    QVERIFY(counters.maxChunkDecompressionNanoseconds.load() > 0);
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::BlockStorageTest)
+
+#include "block_storage_test.moc"
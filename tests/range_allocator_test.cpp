@@ -0,0 +1,156 @@
+#include "range_allocator.h"
+
+#include <QTest>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <ranges>
+#include <vector>
+
+namespace minecraft {
+
+class RangeAllocatorTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void bestFit();
+    void fragmentation();
+    void coalescing();
+    void packingUnderFillLimit();
+};
+
+void RangeAllocatorTest::bestFit()
+{
+    RangeAllocator allocator{16};
+    QVERIFY(allocator.allocate(1) < 0);
+    QVERIFY(allocator.pack(1).empty());
+    QCOMPARE(allocator.capacity(), 16);
+
+    // Free ranges of 6 and 3 elements, separated by allocations
+    const auto a{allocator.allocate(6)};
+    const auto b{allocator.allocate(1)};
+    const auto c{allocator.allocate(3)};
+    const auto d{allocator.allocate(6)};
+    QCOMPARE(allocator.first(d), 10);
+    allocator.free(a);
+    allocator.free(c);
+    QCOMPARE(allocator.freeRangeCount(), std::size_t{2});
+
+    // The smallest range that fits is taken, and the remainder stays free.
+    const auto e{allocator.allocate(2)};
+    QCOMPARE(allocator.first(e), 7);
+    const auto f{allocator.allocate(4)};
+    QCOMPARE(allocator.first(f), 0);
+    QCOMPARE(allocator.largestFreeRange(), 2);
+    QCOMPARE(allocator.usedCount(), 1 + 6 + 2 + 4);
+    QCOMPARE(allocator.count(b), 1);
+}
+
+void RangeAllocatorTest::fragmentation()
+{
+    RangeAllocator allocator{16};
+    allocator.pack(16 / 4 * 3);
+    QCOMPARE(allocator.capacity(), 16);
+    std::vector<int> allocations;
+    for (auto i{0}; i < 8; ++i) {
+        allocations.push_back(allocator.allocate(2));
+        QCOMPARE(allocator.first(allocations.back()), 2 * i);
+    }
+    QVERIFY(allocator.allocate(1) < 0);
+
+    // Half of the elements are free, but in ranges too small for 4 elements.
+    for (auto i{0}; i < 8; i += 2) {
+        allocator.free(allocations[static_cast<std::size_t>(i)]);
+    }
+    QCOMPARE(allocator.usedCount(), 8);
+    QCOMPARE(allocator.freeRangeCount(), std::size_t{4});
+    QCOMPARE(allocator.largestFreeRange(), 2);
+    QVERIFY(allocator.allocate(4) < 0);
+
+    // Freed allocation IDs are reused.
+    const auto allocation{allocator.allocate(2)};
+    QVERIFY(std::ranges::find(allocations, allocation) != allocations.end());
+}
+
+void RangeAllocatorTest::coalescing()
+{
+    RangeAllocator allocator{32};
+    allocator.pack(1);
+    std::vector<int> allocations;
+    for (auto i{0}; i < 6; ++i) {
+        allocations.push_back(allocator.allocate(4));
+    }
+    // The tail of the buffer after the last allocation is free.
+    QCOMPARE(allocator.freeRangeCount(), std::size_t{1});
+
+    // With the next range free
+    allocator.free(allocations[2]);
+    allocator.free(allocations[1]);
+    QCOMPARE(allocator.freeRangeCount(), std::size_t{2});
+    QCOMPARE(allocator.largestFreeRange(), 8);
+    // With the previous range free
+    allocator.free(allocations[3]);
+    QCOMPARE(allocator.freeRangeCount(), std::size_t{2});
+    QCOMPARE(allocator.largestFreeRange(), 12);
+    // With both ranges free, merging into the tail
+    allocator.free(allocations[5]);
+    allocator.free(allocations[4]);
+    QCOMPARE(allocator.freeRangeCount(), std::size_t{1});
+    QCOMPARE(allocator.largestFreeRange(), 28);
+
+    allocator.free(allocations[0]);
+    QCOMPARE(allocator.freeRangeCount(), std::size_t{1});
+    QCOMPARE(allocator.largestFreeRange(), 32);
+    QCOMPARE(allocator.usedCount(), 0);
+    QCOMPARE(allocator.first(allocator.allocate(32)), 0);
+}
+
+void RangeAllocatorTest::packingUnderFillLimit()
+{
+    RangeAllocator allocator{16};
+    allocator.pack(1);
+    std::vector<int> allocations;
+    for (auto i{0}; i < 6; ++i) {
+        allocations.push_back(allocator.allocate(2));
+    }
+    allocator.free(allocations[1]);
+    allocator.free(allocations[3]);
+    QVERIFY(allocator.allocate(5) < 0);
+
+    // 8 used and 4 more fit in 3/4 of the buffer, so it is only packed, in the order of the IDs.
+    auto moves{allocator.pack(4)};
+    QCOMPARE(allocator.capacity(), 16);
+    constexpr std::array<std::size_t, 4> KeptIndices{0, 2, 4, 5};
+    QCOMPARE(moves.size(), KeptIndices.size());
+    for (const auto i : std::views::iota(std::size_t{0}, KeptIndices.size())) {
+        const auto first{static_cast<int>(2 * i)};
+        QCOMPARE(moves[i].sourceFirst, static_cast<int>(2 * KeptIndices[i]));
+        QCOMPARE(moves[i].destinationFirst, first);
+        QCOMPARE(moves[i].count, 2);
+        QCOMPARE(allocator.first(allocations[KeptIndices[i]]), first);
+    }
+    QCOMPARE(allocator.freeRangeCount(), std::size_t{1});
+    QCOMPARE(allocator.largestFreeRange(), 8);
+    QCOMPARE(allocator.first(allocator.allocate(5)), 8);
+
+    // 13 used and 12 more exceed 3/4 of 16 and 32 elements, so the buffer grows to 64.
+    QVERIFY(allocator.allocate(12) < 0);
+    moves = allocator.pack(12);
+    QCOMPARE(allocator.capacity(), 64);
+    QCOMPARE(moves.size(), std::size_t{5});
+    QCOMPARE(allocator.usedCount(), 13);
+    QCOMPARE(allocator.first(allocator.allocate(12)), 13);
+
+    allocator.clear();
+    QCOMPARE(allocator.capacity(), 0);
+    QCOMPARE(allocator.usedCount(), 0);
+    QVERIFY(allocator.allocate(1) < 0);
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::RangeAllocatorTest)
+
+#include "range_allocator_test.moc"
@@ -0,0 +1,368 @@
+#include "block_face_generation_task.h"
+#include "block_face_renderer.h"
+#include "block_type.h"
+#include "terrain.h"
+#include "terrain_chunk.h"
+
+#include <QTest>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <utility>
+#include <vector>
+
+namespace minecraft {
+
+class TerrainChunkTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void blockEditMarksAdjacentSections();
+    void blockEditMarksLodCells();
+    void lodChangeMarksNeighbors();
+    void staleBordersMarkChangedSections();
+    void meshedBordersAreNotStale();
+    void uploadedStateTransitions();
+    void stagedStateTransitions();
+
+private:
+    // Generates the block faces of the outdated sections of the chunk on this thread.
+    static void generateBlockFaces(TerrainChunk &chunk);
+    // Moves the meshed block faces of the chunk to a staging buffer, as BlockFaceUploader does. The
+    // staging buffer has no buffer object or fence, so it is ready at once without OpenGL.
+    static void stageBlockFaces(TerrainChunk &chunk);
+};
+
+namespace {
+
+using BlockVersions = std::array<std::int32_t, TerrainChunk::SectionCount>;
+
+// Creates the chunk at the origin and its 8 surrounding chunks.
+std::unique_ptr<Terrain> createTerrain()
+{
+    auto terrain{std::make_unique<Terrain>()};
+    for (const auto x : std::views::iota(-1, 2)) {
+        for (const auto z : std::views::iota(-1, 2)) {
+            terrain->setChunk(std::make_unique<TerrainChunk>(
+                glm::ivec2{x * TerrainChunk::SizeX, z * TerrainChunk::SizeZ}));
+        }
+    }
+    return terrain;
+}
+
+BlockVersions getBlockVersions(const TerrainChunk &chunk)
+{
+    BlockVersions versions;
+    for (const auto section : std::views::iota(0, TerrainChunk::SectionCount)) {
+        versions[section] = chunk.blockVersion(section);
+    }
+    return versions;
+}
+
+// Returns the sections whose block versions have changed since the given ones.
+std::uint32_t getDirtySectionMask(const TerrainChunk &chunk, const BlockVersions &versions)
+{
+    std::uint32_t sectionMask{0};
+    for (const auto section : std::views::iota(0, TerrainChunk::SectionCount)) {
+        if (chunk.blockVersion(section) != versions[section]) {
+            sectionMask |= 1u << section;
+        }
+    }
+    return sectionMask;
+}
+
+using SectionMasks = std::array<std::array<std::uint32_t, 3>, 3>;
+
+// Applies a change to the terrain, and returns the dirty sections of the chunks, indexed by
+// [x + 1][z + 1] of their origins in chunks.
+template<typename Change>
+SectionMasks getDirtySectionMasks(Terrain &terrain, const Change &change)
+{
+    const auto getChunk{[&terrain](const int x, const int z) {
+        return terrain.getChunk({(x - 1) * TerrainChunk::SizeX, (z - 1) * TerrainChunk::SizeZ});
+    }};
+    std::array<std::array<BlockVersions, 3>, 3> versions;
+    for (const auto x : std::views::iota(0, 3)) {
+        for (const auto z : std::views::iota(0, 3)) {
+            versions[x][z] = getBlockVersions(*getChunk(x, z));
+        }
+    }
+    change();
+    SectionMasks sectionMasks;
+    for (const auto x : std::views::iota(0, 3)) {
+        for (const auto z : std::views::iota(0, 3)) {
+            sectionMasks[x][z] = getDirtySectionMask(*getChunk(x, z), versions[x][z]);
+        }
+    }
+    return sectionMasks;
+}
+
+// Marks a block of the chunk at the origin dirty.
+SectionMasks markBlockDirty(Terrain &terrain, const glm::ivec3 &position)
+{
+    return getDirtySectionMasks(terrain,
+                                [&] { terrain.getChunk({0, 0})->markBlockDirty(position); });
+}
+
+// Fills the plane of the chunk at the given X with the given block.
+void fillPlaneX(TerrainChunk &chunk, const int x, const BlockType block)
+{
+    for (const auto y : std::views::iota(0, TerrainChunk::SizeY)) {
+        for (const auto z : std::views::iota(0, TerrainChunk::SizeZ)) {
+            chunk.setBlockAtLocal({x, y, z}, block);
+        }
+    }
+}
+
+} // namespace
+
+void TerrainChunkTest::generateBlockFaces(TerrainChunk &chunk)
+{
+    const std::unique_ptr<BlockFaceGenerationTask> task{chunk.createBlockFaceGenerationTask()};
+    QVERIFY(task != nullptr);
+    // No other task is created while the sections are being generated.
+    QVERIFY(!chunk.needsBlockFaceGeneration());
+    QVERIFY(chunk.createBlockFaceGenerationTask() == nullptr);
+    task->run();
+}
+
+void TerrainChunkTest::stageBlockFaces(TerrainChunk &chunk)
+{
+    const std::lock_guard lock{chunk._blockFaceMutex};
+    QCOMPARE(chunk._state, TerrainChunkState::Meshed);
+    std::vector<GLsizei> slotFirsts(chunk._blockFaces->size() + 1, 0);
+    chunk._stagedBlockFaces = std::make_unique<StagedBlockFaces>(OpenGLObject{},
+                                                                 0,
+                                                                 nullptr,
+                                                                 std::move(slotFirsts));
+    chunk._state = TerrainChunkState::Staged;
+    BlockFaceGenerationTask::recycleBlockFaces(std::move(chunk._blockFaces));
+}
+
+void TerrainChunkTest::blockEditMarksAdjacentSections()
+{
+    const auto terrain{createTerrain()};
+
+    // Inside a section, away from the borders
+    auto sectionMasks{markBlockDirty(*terrain, {10, 40, 10})};
+    QCOMPARE(sectionMasks[1][1], 1u << 2);
+    for (const auto x : std::views::iota(0, 3)) {
+        for (const auto z : std::views::iota(0, 3)) {
+            QVERIFY((x == 1 && z == 1) || sectionMasks[x][z] == 0u);
+        }
+    }
+
+    // On the top of a section, next to the negative X neighbor
+    sectionMasks = markBlockDirty(*terrain, {0, 47, 5});
+    QCOMPARE(sectionMasks[1][1], (1u << 2) | (1u << 3));
+    QCOMPARE(sectionMasks[0][1], 1u << 2);
+    QCOMPARE(sectionMasks[2][1], 0u);
+    QCOMPARE(sectionMasks[1][0], 0u);
+    QCOMPARE(sectionMasks[1][2], 0u);
+
+    // On the bottom of a section, in the positive X and Z corner. Diagonal neighbors never read the
+    // block.
+    sectionMasks = markBlockDirty(*terrain, {63, 16, 63});
+    QCOMPARE(sectionMasks[1][1], (1u << 0) | (1u << 1));
+    QCOMPARE(sectionMasks[2][1], 1u << 1);
+    QCOMPARE(sectionMasks[1][2], 1u << 1);
+    QCOMPARE(sectionMasks[2][2], 0u);
+    QCOMPARE(sectionMasks[0][1], 0u);
+
+    // At the bottom and top of the chunk, there are no sections beyond.
+    QCOMPARE(markBlockDirty(*terrain, {30, 0, 30})[1][1], 1u << 0);
+    QCOMPARE(markBlockDirty(*terrain, {30, TerrainChunk::SizeY - 1, 30})[1][1],
+             1u << (TerrainChunk::SectionCount - 1));
+}
+
+void TerrainChunkTest::blockEditMarksLodCells()
+{
+    const auto terrain{createTerrain()};
+    terrain->getChunk({0, 0})->setLodScale(4);
+
+    // The cell spans Y in [32, 36), so the layers next to it are in sections 1 and 2. Along X and
+    // Z, the cell touches the positive X and negative Z borders, although the block does not.
+    const auto sectionMasks{markBlockDirty(*terrain, {61, 33, 2})};
+    QCOMPARE(sectionMasks[1][1], (1u << 1) | (1u << 2));
+    QCOMPARE(sectionMasks[2][1], 1u << 2);
+    QCOMPARE(sectionMasks[1][0], 1u << 2);
+    QCOMPARE(sectionMasks[0][1], 0u);
+    QCOMPARE(sectionMasks[1][2], 0u);
+}
+
+void TerrainChunkTest::lodChangeMarksNeighbors()
+{
+    const auto terrain{createTerrain()};
+    auto &chunk{*terrain->getChunk({0, 0})};
+    terrain->getChunk({TerrainChunk::SizeX, 0})->setLodScale(4);
+    terrain->getChunk({0, TerrainChunk::SizeZ})->setLodScale(2);
+    terrain->getChunk({0, -TerrainChunk::SizeZ})->setLodScale(8);
+    const auto setLodScale{[&](const int lodScale) {
+        return getDirtySectionMasks(*terrain, [&] { chunk.setLodScale(lodScale); });
+    }};
+
+    // Neighbors read the border of the chunk in its grid unless they are coarser than both the
+    // previous and the new scale. Diagonal neighbors never read it.
+    for (const auto lodScale : {2, 1}) {
+        const auto sectionMasks{setLodScale(lodScale)};
+        QCOMPARE(sectionMasks[1][1], TerrainChunk::AllSectionsMask);
+        QCOMPARE(sectionMasks[0][1], TerrainChunk::AllSectionsMask);
+        QCOMPARE(sectionMasks[1][2], TerrainChunk::AllSectionsMask);
+        QCOMPARE(sectionMasks[2][1], 0u);
+        QCOMPARE(sectionMasks[1][0], 0u);
+        QCOMPARE(sectionMasks[0][0], 0u);
+    }
+    const auto sectionMasks{setLodScale(8)};
+    QCOMPARE(sectionMasks[2][1], TerrainChunk::AllSectionsMask);
+    QCOMPARE(sectionMasks[1][0], TerrainChunk::AllSectionsMask);
+    QCOMPARE(sectionMasks[2][2], 0u);
+
+    // The same scale changes nothing.
+    for (const auto &masks : setLodScale(8)) {
+        for (const auto sectionMask : masks) {
+            QCOMPARE(sectionMask, 0u);
+        }
+    }
+}
+
+void TerrainChunkTest::staleBordersMarkChangedSections()
+{
+    // Block faces are first generated as if the borders were all missing, which are treated as
+    // solid. Two neighbors with solid borders facing each other look the same.
+    Terrain terrain;
+    terrain.setChunk(std::make_unique<TerrainChunk>(glm::ivec2{0, 0}));
+    terrain.setChunk(std::make_unique<TerrainChunk>(glm::ivec2{TerrainChunk::SizeX, 0}));
+    auto &chunk{*terrain.getChunk({0, 0})};
+    auto &neighbor{*terrain.getChunk({TerrainChunk::SizeX, 0})};
+    fillPlaneX(chunk, TerrainChunk::SizeX - 1, BlockType::Stone);
+    fillPlaneX(neighbor, 0, BlockType::Stone);
+    neighbor.setBlockAtLocal({5, 40, 5}, BlockType::Dirt);
+    chunk.compressBlocks();
+    neighbor.compressBlocks();
+
+    // Unchanged borders are compared without decompressing the blocks.
+    auto versions{getBlockVersions(chunk)};
+    auto neighborVersions{getBlockVersions(neighbor)};
+    chunk.markStaleBordersDirty();
+    neighbor.markStaleBordersDirty();
+    QCOMPARE(getDirtySectionMask(chunk, versions), 0u);
+    QCOMPARE(getDirtySectionMask(neighbor, neighborVersions), 0u);
+    QVERIFY(chunk.blockStorage().isCompressed());
+    QVERIFY(neighbor.blockStorage().isCompressed());
+
+    // Blocks away from the borders do not change them.
+    neighbor.setBlockAtLocal({5, 40, 5}, BlockType::Air);
+    chunk.markStaleBordersDirty();
+    QCOMPARE(getDirtySectionMask(chunk, versions), 0u);
+    QCOMPARE(getDirtySectionMask(neighbor, neighborVersions), 0u);
+
+    // Only the section with the changed border block is marked, and only in the chunk that reads
+    // it as padding.
+    neighbor.setBlockAtLocal({0, 40, 5}, BlockType::Air);
+    chunk.markStaleBordersDirty();
+    QCOMPARE(getDirtySectionMask(chunk, versions), 1u << 2);
+    QCOMPARE(getDirtySectionMask(neighbor, neighborVersions), 0u);
+    QVERIFY(chunk.blockStorage().isCompressed());
+}
+
+void TerrainChunkTest::meshedBordersAreNotStale()
+{
+    // Both chunks are all air, so their borders differ from missing neighbors, which are solid.
+    Terrain terrain;
+    terrain.setChunk(std::make_unique<TerrainChunk>(glm::ivec2{0, 0}));
+    terrain.setChunk(std::make_unique<TerrainChunk>(glm::ivec2{TerrainChunk::SizeX, 0}));
+    auto &chunk{*terrain.getChunk({0, 0})};
+    auto &neighbor{*terrain.getChunk({TerrainChunk::SizeX, 0})};
+    chunk.markNeighborsReady();
+    generateBlockFaces(chunk);
+
+    // The block faces of the chunk are generated against the border of the neighbor, but the
+    // neighbor has no block faces yet.
+    const auto versions{getBlockVersions(chunk)};
+    const auto neighborVersions{getBlockVersions(neighbor)};
+    chunk.markStaleBordersDirty();
+    QCOMPARE(getDirtySectionMask(chunk, versions), 0u);
+    QCOMPARE(getDirtySectionMask(neighbor, neighborVersions), TerrainChunk::AllSectionsMask);
+}
+
+void TerrainChunkTest::uploadedStateTransitions()
+{
+    // The chunk is all air, so its block faces are empty and uploading them needs no OpenGL.
+    TerrainChunk chunk{{0, 0}};
+    chunk.setVisible(true);
+    QCOMPARE(chunk.state(), TerrainChunkState::Generated);
+    QVERIFY(!chunk.needsBlockFaceGeneration());
+    QVERIFY(chunk.createBlockFaceGenerationTask() == nullptr);
+
+    chunk.markNeighborsReady();
+    QCOMPARE(chunk.state(), TerrainChunkState::NeighborsReady);
+    QVERIFY(chunk.needsBlockFaceGeneration());
+    generateBlockFaces(chunk);
+    QCOMPARE(chunk.state(), TerrainChunkState::Meshed);
+    QVERIFY(chunk.hasBlockFacesToUpload());
+
+    // Block faces of invisible chunks wait for upload.
+    chunk.setVisible(false);
+    QCOMPARE(chunk.uploadBlockFaces(), std::int64_t{0});
+    QCOMPARE(chunk.state(), TerrainChunkState::Meshed);
+    chunk.setVisible(true);
+    chunk.uploadBlockFaces();
+    QCOMPARE(chunk.state(), TerrainChunkState::Uploaded);
+    QVERIFY(!chunk.hasBlockFacesToUpload());
+    QVERIFY(!chunk.needsBlockFaceGeneration());
+
+    // Uploaded sections are regenerated after changes, and a new mesh goes through Meshed again.
+    chunk.markBlockDirty({10, 40, 10});
+    QVERIFY(chunk.needsBlockFaceGeneration());
+    generateBlockFaces(chunk);
+    QCOMPARE(chunk.state(), TerrainChunkState::Meshed);
+    chunk.uploadBlockFaces();
+    QCOMPARE(chunk.state(), TerrainChunkState::Uploaded);
+
+    // Releasing the renderer drops all uploaded sections, which are generated again.
+    chunk.releaseRendererResources();
+    QCOMPARE(chunk.state(), TerrainChunkState::NeighborsReady);
+    QVERIFY(chunk.needsBlockFaceGeneration());
+
+    // Meshed block faces are still uploaded after a release.
+    generateBlockFaces(chunk);
+    chunk.releaseRendererResources();
+    QCOMPARE(chunk.state(), TerrainChunkState::Meshed);
+    chunk.uploadBlockFaces();
+    QCOMPARE(chunk.state(), TerrainChunkState::Uploaded);
+}
+
+void TerrainChunkTest::stagedStateTransitions()
+{
+    TerrainChunk chunk{{0, 0}};
+    chunk.setVisible(true);
+    chunk.markNeighborsReady();
+    generateBlockFaces(chunk);
+    stageBlockFaces(chunk);
+    QCOMPARE(chunk.state(), TerrainChunkState::Staged);
+    QVERIFY(chunk.hasBlockFacesToUpload());
+    QVERIFY(!chunk.needsBlockFaceGeneration());
+
+    // Staged block faces belong to the render context, so they are dropped with the renderer, and
+    // their sections are generated again.
+    chunk.releaseRendererResources();
+    QCOMPARE(chunk.state(), TerrainChunkState::NeighborsReady);
+    QVERIFY(!chunk.hasBlockFacesToUpload());
+    QVERIFY(chunk.needsBlockFaceGeneration());
+
+    generateBlockFaces(chunk);
+    stageBlockFaces(chunk);
+    chunk.uploadBlockFaces();
+    QCOMPARE(chunk.state(), TerrainChunkState::Uploaded);
+    QVERIFY(!chunk.needsBlockFaceGeneration());
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::TerrainChunkTest)
+
+#include "terrain_chunk_test.moc"
@@ -0,0 +1,90 @@
+#include "camera.h"
+#include "performance_counters.h"
+#include "pose.h"
+#include "terrain.h"
+#include "terrain_chunk.h"
+#include "terrain_streamer.h"
+
+#include <QTest>
+#include <QThreadPool>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace minecraft {
+
+class TerrainStreamerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void generationQueue();
+
+private:
+    // Chunks waiting for block face generation, in the order of priority
+    static std::vector<TerrainChunk *> getQueuedChunks(const TerrainStreamer &streamer);
+};
+
+std::vector<TerrainChunk *> TerrainStreamerTest::getQueuedChunks(const TerrainStreamer &streamer)
+{
+    std::vector<TerrainChunk *> chunks;
+    for (const auto &request : streamer._blockFaceGenerationQueue) {
+        chunks.push_back(request.chunk);
+    }
+    return chunks;
+}
+
+void TerrainStreamerTest::generationQueue()
+{
+    // The camera is in chunk a and looks toward -Z, where chunk b is. Chunks c and d are behind it,
+    // and c is closer than b. All chunks are air, so their block faces are generated quickly.
+    Terrain terrain;
+    for (const auto z : {0, -128, 64, 128}) {
+        terrain.setChunk(std::make_unique<TerrainChunk>(glm::ivec2{0, z}));
+        terrain.getChunk({0, z})->markNeighborsReady();
+    }
+    const auto a{terrain.getChunk({0, 0})};
+    const auto b{terrain.getChunk({0, -128})};
+    const auto c{terrain.getChunk({0, 64})};
+    const auto d{terrain.getChunk({0, 128})};
+    const Camera camera{Pose{glm::vec3{32.0f, 100.0f, 32.0f}}, 1920, 1080};
+    TerrainStreamer streamer{&terrain};
+    auto &counters{PerformanceCounters::instance()};
+    const auto threadPool{QThreadPool::globalInstance()};
+    const auto maxThreadCount{threadPool->maxThreadCount()};
+
+    // Without free threads, all chunks wait. Chunks in view come first, and then the closest.
+    threadPool->setMaxThreadCount(0);
+    streamer.scheduleBlockFaceGeneration({d, c, b, a}, camera);
+    QCOMPARE(getQueuedChunks(streamer), (std::vector{a, b, c, d}));
+    QCOMPARE(counters.queuedBlockFaceGenerationCount.load(), std::int64_t{4});
+
+    // Chunks that are no longer drawn are dropped from the queue.
+    streamer.scheduleBlockFaceGeneration({d, b}, camera);
+    QCOMPARE(getQueuedChunks(streamer), (std::vector{b, d}));
+    QCOMPARE(counters.queuedBlockFaceGenerationCount.load(), std::int64_t{2});
+    QVERIFY(c->needsBlockFaceGeneration());
+
+    // Tasks are only started for free threads, in the order of the queue.
+    threadPool->setMaxThreadCount(1);
+    streamer.scheduleBlockFaceGeneration({d, c, b, a}, camera);
+    QCOMPARE(counters.queuedBlockFaceGenerationCount.load(), std::int64_t{3});
+    QVERIFY(!a->needsBlockFaceGeneration());
+    QVERIFY(b->needsBlockFaceGeneration());
+    threadPool->waitForDone();
+
+    // Chunks with block faces waiting for upload are not queued again.
+    streamer.scheduleBlockFaceGeneration({d, c, b, a}, camera);
+    QCOMPARE(getQueuedChunks(streamer), (std::vector{b, c, d}));
+    QCOMPARE(counters.queuedBlockFaceGenerationCount.load(), std::int64_t{2});
+    QVERIFY(!b->needsBlockFaceGeneration());
+    threadPool->waitForDone();
+    threadPool->setMaxThreadCount(maxThreadCount);
+}
+
+} // namespace minecraft
+
+QTEST_APPLESS_MAIN(minecraft::TerrainStreamerTest)
+
+#include "terrain_streamer_test.moc"